@@ -1,5 +1,6 @@
 #include "ast.h"
 
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
 
@@ -51,6 +52,54 @@ std::pair<ISR*, ISR*> Expr_AST::Expr_Binary::to_isr_pair(ISR_Tree* tree) const {
     };
 }
 
+// a missing child matches anything, as far as the summary can tell
+std::pair<bool, bool> Expr_AST::Expr_Binary::may_match_pair(const TermSummaries& summaries, size_t chunk) const {
+    return {
+        !left || left->may_match(summaries, chunk),
+        !right || right->may_match(summaries, chunk)
+    };
+}
+
+namespace {
+
+// a term as the protocol sends it, up to its PHRASE_END
+void append_escaped(std::string& out, const std::string& term) {
+    for (char ch : term) {
+        if (ch == Query::Protocol::ESCAPE || ch == Query::Protocol::PHRASE_END) out += Query::Protocol::ESCAPE;
+        out += ch;
+    }
+}
+
+}   // namespace
+
+template <typename Op>
+void Expr_AST::Expr_Binary::operands(std::vector<std::string>& out) const {
+    for (const Expr* child : { left, right }) {
+        if (auto* chain = dynamic_cast<const Op*>(child)) {
+            chain->template operands<Op>(out);
+            continue;
+        }
+        // a missing operand reads as PHRASE_END in the protocol
+        std::string operand(1, Query::Protocol::PHRASE_END);
+        if (child) {
+            operand.clear();
+            child->canonical(operand);
+        }
+        if (std::find(out.begin(), out.end(), operand) == out.end()) out.push_back(std::move(operand));
+    }
+}
+
+// the chain's distinct operands, nested to the right: a & b & c is written &a&bc
+template <typename Op>
+void Expr_AST::Expr_Binary::canonical_chain(char symbol, std::string& out) const {
+    std::vector<std::string> chain;
+    operands<Op>(chain);
+    for (size_t i = 0; i < chain.size(); ++i) {
+        if (i + 1 < chain.size()) out += symbol;
+        out += chain[i];
+    }
+}
+
 /*void Expr_AST::debug_print() const {
     std::function<void(Expr*, int)> print = [&](Expr* node, int depth) {
         if (!node) return;
@@ -83,6 +132,15 @@ ISR* Expr_AST::Expr_AND::to_ISR(ISR_Tree* tree) const {
     return new ISRAnd(tree, l, r);
 }
 
+bool Expr_AST::Expr_AND::may_match(const TermSummaries& summaries, size_t chunk) const {
+    auto [l, r] = may_match_pair(summaries, chunk);
+    return l && r;
+}
+
+void Expr_AST::Expr_AND::canonical(std::string& out) const {
+    canonical_chain<Expr_AND>(Query::Protocol::AND, out);
+}
+
 // end Expr_AND
 
 // start Expr_OR
@@ -96,6 +154,15 @@ ISR* Expr_AST::Expr_OR::to_ISR(ISR_Tree* tree) const {
     return new ISROr(tree, l, r);
 }
 
+bool Expr_AST::Expr_OR::may_match(const TermSummaries& summaries, size_t chunk) const {
+    auto [l, r] = may_match_pair(summaries, chunk);
+    return l || r;
+}
+
+void Expr_AST::Expr_OR::canonical(std::string& out) const {
+    canonical_chain<Expr_OR>(Query::Protocol::OR, out);
+}
+
 // end Expr_OR
 
 // start Expr_OR_SYN
@@ -111,6 +178,20 @@ ISR* Expr_AST::Expr_OR_SYN::to_ISR(ISR_Tree* tree) const {
     return new ISRSynOr(tree, l, r, advance_right, advance_left);
 }
 
+bool Expr_AST::Expr_OR_SYN::may_match(const TermSummaries& summaries, size_t chunk) const {
+    auto [l, r] = may_match_pair(summaries, chunk);
+    return l || r;
+}
+
+// the steps decide how results are drawn from each side, so they are part of the query
+void Expr_AST::Expr_OR_SYN::canonical(std::string& out) const {
+    out += Query::Protocol::OR_SYN;
+    left->canonical(out);
+    right->canonical(out);
+    out += std::to_string(advance_right) + Query::Protocol::STEP_DELIM;
+    out += std::to_string(advance_left) + Query::Protocol::STEP_DELIM;
+}
+
 // end Expr_OR_SYN
 
 // start Expr_NOT
@@ -125,26 +206,69 @@ ISR* Expr_AST::Expr_NOT::to_ISR(ISR_Tree* tree) const {
     return new ISRContainer(tree, l, r);
 }
 
+// only the pages matching the expression are needed; what it excludes may be anywhere
+bool Expr_AST::Expr_NOT::may_match(const TermSummaries& summaries, size_t chunk) const {
+    return !left || left->may_match(summaries, chunk);
+}
+
+void Expr_AST::Expr_NOT::canonical(std::string& out) const {
+    out += Query::Protocol::NOT;
+    if (left)
+        left->canonical(out);
+    else
+        out += Query::Protocol::PHRASE_END;
+    out += Query::Protocol::PHRASE_END;
+}
+
 // end Expr_NOT
 
 // ---------- Leaf: Word ----------
 Expr_AST::Expr_Leaf_Word::Expr_Leaf_Word(std::string&& term) : 
-    term { std::move(term) } 
+    term { std::move(term) },
+    hash { TermSummary::Hash(this->term.c_str()) }
 {}
 
 ISR* Expr_AST::Expr_Leaf_Word::to_ISR(ISR_Tree* tree) const {
     return tree->get_ISRWord(term.c_str());
 }
 
+bool Expr_AST::Expr_Leaf_Word::may_match(const TermSummaries& summaries, size_t chunk) const {
+    return summaries.MayContain(chunk, hash);
+}
+
+void Expr_AST::Expr_Leaf_Word::canonical(std::string& out) const {
+    out += Query::Protocol::WORD_START;
+    append_escaped(out, term);
+    out += Query::Protocol::PHRASE_END;
+}
+
 // ---------- Leaf: Phrase ----------
 Expr_AST::Expr_Leaf_Phrase::Expr_Leaf_Phrase(std::vector<std::string>&& terms) :
     terms { std::move(terms) } 
-{}
+{
+    for (const auto& term : this->terms) hashes.push_back(TermSummary::Hash(term.c_str()));
+}
 
 ISR* Expr_AST::Expr_Leaf_Phrase::to_ISR(ISR_Tree* tree) const {
     return new ISRPhrase(tree, terms);
 }
 
+// a phrase needs every one of its words
+bool Expr_AST::Expr_Leaf_Phrase::may_match(const TermSummaries& summaries, size_t chunk) const {
+    for (uint64_t hash : hashes)
+        if (!summaries.MayContain(chunk, hash)) return false;
+    return true;
+}
+
+void Expr_AST::Expr_Leaf_Phrase::canonical(std::string& out) const {
+    out += Query::Protocol::PHRASE_START;
+    for (size_t i = 0; i < terms.size(); ++i) {
+        if (i) out += ' ';
+        append_escaped(out, terms[i]);
+    }
+    out += Query::Protocol::PHRASE_END;
+}
+
 // ---------- Template helper function ----------
 template <typename Aggregate, typename Ret>
 Ret Expr_AST::read_to_cond() const {
@@ -314,3 +438,16 @@ Expr_AST::~Expr_AST() {
 ISR* Expr_AST::to_ISR(ISR_Tree* tree) const {
     return (root) ? root->to_ISR(tree) : nullptr;
 }
+
+bool Expr_AST::may_match(const TermSummaries& summaries, size_t chunk) const {
+    return root && root->may_match(summaries, chunk);
+}
+
+std::string Expr_AST::canonical() const {
+    std::string out;
+    if (root)
+        root->canonical(out);
+    else
+        out += Query::Protocol::PHRASE_END;
+    return out;
+}
@@ -8,6 +8,7 @@
 
 #include <sys/socket.h>   // for recv
 
+#include "../indexer/TermSummary.hpp"
 #include "../lib/networking.h"   // for recv_looping_crashing
 #include "../query/protocol_query.h"
 #include "isr.h"   // for ISR and ISR_Tree
@@ -23,6 +24,9 @@ private:
     class Expr {
     public:
         virtual ISR* to_ISR(ISR_Tree* tree) const = 0;
+        // false only if no page in the chunk can match, going by its term summary
+        virtual bool may_match(const TermSummaries& summaries, size_t chunk) const = 0;
+        virtual void canonical(std::string& out) const = 0;
     };
 
     // Base class for AST nodes.
@@ -32,6 +36,10 @@ private:
         Expr* right;
 
         std::pair<ISR*, ISR*> to_isr_pair(ISR_Tree* tree) const;
+        std::pair<bool, bool> may_match_pair(const TermSummaries& summaries, size_t chunk) const;
+
+        template <typename Op>
+        void canonical_chain(char symbol, std::string& out) const;
 
     public:
         Expr_Binary(Expr* left, Expr* right);
@@ -40,6 +48,10 @@ private:
 
         inline Expr* get_left() const { return left; }
         inline Expr* get_right() const { return right; }
+
+        // the canonical forms of the operands of a chain of Op, such as a, b and c for (a & b) & c, each once
+        template <typename Op>
+        void operands(std::vector<std::string>& out) const;
     };
 
     // Internal node (operators AND, OR, NOT).
@@ -47,12 +59,16 @@ private:
     public:
         Expr_AND(Expr* left, Expr* right);
         ISR* to_ISR(ISR_Tree* tree) const override;
+        bool may_match(const TermSummaries& summaries, size_t chunk) const override;
+        void canonical(std::string& out) const override;
     };
 
     class Expr_OR : public Expr_Binary {
     public:
         Expr_OR(Expr* left, Expr* right);
         ISR* to_ISR(ISR_Tree* tree) const override;
+        bool may_match(const TermSummaries& summaries, size_t chunk) const override;
+        void canonical(std::string& out) const override;
     };
 
     class Expr_OR_SYN : public Expr_Binary {
@@ -62,22 +78,29 @@ private:
     public:
         Expr_OR_SYN(Expr* left, Expr_OR_SYN* right, int advance_right, int advance_left);
         ISR* to_ISR(ISR_Tree* tree) const override;
+        bool may_match(const TermSummaries& summaries, size_t chunk) const override;
+        void canonical(std::string& out) const override;
     };
 
     class Expr_NOT : public Expr_Binary {
     public:
         Expr_NOT(Expr* expr, Expr*);
         ISR* to_ISR(ISR_Tree* tree) const override;
+        bool may_match(const TermSummaries& summaries, size_t chunk) const override;
+        void canonical(std::string& out) const override;
     };
 
     // Leaf node for single word searches.
     class Expr_Leaf_Word : public Expr {
     private:
         std::string term;
+        uint64_t hash;   // TermSummary::Hash of term
 
     public:
         Expr_Leaf_Word(std::string&& term);
         ISR* to_ISR(ISR_Tree* tree) const override;
+        bool may_match(const TermSummaries& summaries, size_t chunk) const override;
+        void canonical(std::string& out) const override;
 
         std::string get_term() const { return term; }
     };
@@ -86,10 +109,13 @@ private:
     class Expr_Leaf_Phrase : public Expr {
     private:
         std::vector<std::string> terms;
+        std::vector<uint64_t> hashes;
 
     public:
         Expr_Leaf_Phrase(std::vector<std::string>&& terms);
         ISR* to_ISR(ISR_Tree* tree) const override;
+        bool may_match(const TermSummaries& summaries, size_t chunk) const override;
+        void canonical(std::string& out) const override;
 
         std::vector<std::string> get_terms() const { return terms; }
     };
@@ -114,6 +140,14 @@ public:
     ~Expr_AST();
 
     ISR* to_ISR(ISR_Tree* tree) const;
+    bool may_match(const TermSummaries& summaries, size_t chunk) const;
+
+    // The query in the protocol's notation, written so that queries that are
+    // bound to rank the same pages the same way are written the same: chains
+    // of AND or of OR are flattened, and an operand repeated in a chain is
+    // kept only the first time.  Operands are not reordered, since the ranker
+    // scores the terms' order.
+    std::string canonical() const;
 
     // void debug_print() const;
 };
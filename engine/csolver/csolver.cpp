@@ -1,9 +1,12 @@
 #include "csolver.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <iomanip>   // for std::setprecision and std::fixed
 #include <iostream>
+#include <limits>
 #include <vector>
 
 #include <pthread.h>
@@ -12,11 +15,48 @@
 #include <arpa/inet.h>
 
 #include "../lib/HashTable.h"
+#include "../lib/cv.h"
+#include "../lib/metrics.h"
+#include "../lib/mutex.h"
+#include "../lib/tournament_tree.h"
 
 // Constructor sets up server socket and binding.
-CSolver::CSolver(const std::string& ip, unsigned int port, const std::vector<IndexBlob*>& blobs)
+CSolver::CSolver(const std::string& ip, unsigned int port, const std::vector<IndexBlob*>& blobs,
+                 const std::vector<std::string>& files)
     : fd_serv { -1 }
+    , connections { QUERY_QUEUE_SIZE }
+    , chunk_pool { NUM_CHUNK_WORKERS, CHUNK_QUEUE_SIZE }
+    , results_cache { RESULT_CACHE_SHARDS, RESULT_CACHE_ENTRIES, RESULT_CACHE_BYTES }
     , blobs { blobs } {
+    // Chunks written before term summaries existed have none on disk; summarize them from their dictionaries.
+    size_t built = 0;
+    for (size_t i = 0; i < blobs.size(); ++i) {
+        TermSummary summary;
+        if (i >= files.size() || !summary.Read(TermSummary::FileName(files[i]))) {
+            summary = TermSummary::Build(blobs[i]->GetHashBlob());
+            ++built;
+        }
+        summaries.Add(summary);
+    }
+    std::cout << "Term summaries: " << summaries.Bytes() << " bytes for " << summaries.Chunks() << " chunks, " << built
+              << " built at startup\n";
+
+    Metrics& metrics = Metrics::get_instance();
+    metrics.counter_function("csolver_result_cache_hits_total", "Queries answered from the result cache",
+                             [this] { return results_cache.get_hits(); });
+    metrics.counter_function("csolver_result_cache_misses_total", "Queries ranked because their results were not cached",
+                             [this] { return results_cache.get_misses(); });
+    metrics.counter_function("csolver_result_cache_evictions_total", "Cached results dropped to make room",
+                             [this] { return results_cache.get_evictions(); });
+    metrics.counter_function("csolver_result_cache_invalidations_total", "Times the chunk set changed",
+                             [this] { return chunk_set.load(std::memory_order_relaxed); });
+    metrics.gauge("csolver_result_cache_entries", "Queries with cached results",
+                  [this] { return results_cache.size(); });
+    metrics.gauge("csolver_result_cache_bytes", "Bytes held by the result cache",
+                  [this] { return results_cache.bytes(); });
+    if (!start_metrics_server(port + METRICS_PORT_OFFSET))
+        std::cerr << "Could not serve metrics on port " << port + METRICS_PORT_OFFSET << '\n';
+
     addr_serv.sin_family = AF_INET;
     addr_serv.sin_port = htons(port);
     addr_serv.sin_addr.s_addr = ip.empty() ? INADDR_ANY : inet_addr(ip.c_str());
@@ -80,9 +120,10 @@ void CSolver::serialize_results(int fd_client, const std::vector<RankingResult>&
     }
 }
 
-void CSolver::init_instance(const std::string& ip, unsigned int port, const std::vector<IndexBlob*>& blobs) {
+void CSolver::init_instance(const std::string& ip, unsigned int port, const std::vector<IndexBlob*>& blobs,
+                            const std::vector<std::string>& files) {
     assert(!instance);
-    instance = new CSolver(ip, port, blobs);
+    instance = new CSolver(ip, port, blobs, files);
 }
 
 CSolver* CSolver::get_instance() {
@@ -91,35 +132,42 @@ CSolver* CSolver::get_instance() {
 }
 
 #ifndef TEST_NETWORK_ONLY
-std::vector<RankingResult> mergeSortedArrays(const std::vector<std::vector<RankingResult>>& arrays) {
-    int k = arrays.size();
-    std::vector<int> indices(k, 0);   // track current position in each array
-    std::vector<RankingResult> result;
-
-    while (result.size() < MAX_RESULTS) {
-        double maxVal = std::numeric_limits<double>::lowest();
-        int minArray = -1;
-
-        // Find the smallest element among current heads
-        for (int i = 0; i < k; ++i) {
-            if (indices[i] < arrays[i].size()) {
-                if (arrays[i][indices[i]].score > maxVal) {
-                    maxVal = arrays[i][indices[i]].score;
-                    minArray = i;
-                }
-            }
-        }
+namespace {
+
+// The results of one query, gathered from its chunks as they are ranked.
+struct Query_Results {
+    Mutex mutex;
+    CV ranked;
+    size_t chunks_left;
+    std::vector<std::vector<RankingResult>> chunks;   // each chunk's best, best first
+    bool failed = false;                              // a chunk could not be ranked
+    std::atomic<double> score_to_beat { std::numeric_limits<double>::lowest() };
+};
+
+bool scores_higher(const RankingResult& a, const RankingResult& b) {
+    return a.score > b.score;
+}
 
-        if (minArray == -1) break;   // all arrays are exhausted
+}   // namespace
+#endif /* TEST_NETWORK_ONLY */
 
-        result.push_back(arrays[minArray][indices[minArray]]);
-        indices[minArray]++;   // move forward in the chosen array
-    }
+size_t CSolver::Result_Cost::operator()(const std::vector<RankingResult>& results) const {
+    return results.capacity() * sizeof(RankingResult);
+}
 
-    return result;
+void CSolver::invalidate_results() {
+    chunk_set.fetch_add(1);
+    results_cache.clear();
 }
-#endif /* TEST_NETWORK_ONLY */
 
+// Answers from results_cache when the same query, as Expr_AST::canonical
+// writes it, was ranked before on the same chunks.  Otherwise ranks every
+// chunk as its own task on chunk_pool, so a query takes about as long as its
+// chunks divided among the cores.  Chunks whose term summaries show they lack
+// a term the query needs are skipped.  The chunks share the lowest score in
+// the best MAX_RESULTS any of them has found, so each skips pages that could
+// not make the query's results, and their results are merged once all of them
+// are ranked.
 bool CSolver::process_client_request(int fd_client) {
     try {
         auto start = std::chrono::high_resolution_clock::now();
@@ -127,35 +175,64 @@ bool CSolver::process_client_request(int fd_client) {
         Expr_AST ast(fd_client);
 
 #ifndef TEST_NETWORK_ONLY
-        std::vector<std::vector<RankingResult>> all;
-#endif
-
-        u_int32_t results_size = 0;
-
-        for (IndexBlob* b : blobs) {
-            ISR_Tree tree(b, &ast);
+        std::string key = std::to_string(chunk_set.load()) + ':' + ast.canonical();
+        std::vector<RankingResult> results;
+        bool cached = results_cache.get(key, results);
+
+        std::vector<size_t> candidates;
+        if (!cached) {
+            for (size_t i = 0; i < blobs.size(); ++i)
+                if (ast.may_match(summaries, i)) candidates.push_back(i);
+
+            Query_Results query;
+            query.chunks_left = candidates.size();
+            query.chunks.resize(candidates.size());
+
+            for (size_t c = 0; c < candidates.size(); ++c) {
+                chunk_pool.submit([b = blobs[candidates[c]], &ast, &query, &partial = query.chunks[c]] {
+                    bool ok = true;
+                    try {
+                        ISR_Tree tree(b, &ast);
+                        // one thread a chunk; the pool already keeps every core busy
+                        Ranker::Ranker rk(b, MAX_RESULTS, 1, &query.score_to_beat);
+                        partial = rk.RankResults(&tree);
+                    } catch (...) {
+                        std::cerr << "Error ranking a chunk\n";
+                        ok = false;
+                    }
+
+                    Lock_Guard<Mutex, &Mutex::lock> guard(query.mutex);
+                    if (!ok) query.failed = true;
+                    if (--query.chunks_left == 0) query.ranked.signal();
+                });
+            }
 
-#ifndef TEST_NETWORK_ONLY
-            Ranker::Ranker rk(b);
-            auto partial = rk.RankResults(&tree);
-            results_size += partial.size();
+            {
+                Lock_Guard<Mutex, &Mutex::lock> guard(query.mutex);
+                while (query.chunks_left) query.ranked.wait(query.mutex);
+            }
 
-            all.push_back(partial);
+            Tournament_Tree<RankingResult, decltype(&scores_higher)> best(query.chunks, scores_higher);
+            for (; !best.empty() && results.size() < MAX_RESULTS; best.pop()) results.push_back(best.top());
 
-            if (results_size > MAX_RANKED_DOCS) {
-                break;
-            }
-#endif /* TEST_NETWORK_ONLY */
+            // a chunk that failed may have held better results next time
+            if (!query.failed) results_cache.put(key, results);
         }
 
-#ifndef TEST_NETWORK_ONLY
-        serialize_results(fd_client, mergeSortedArrays(all));
+        serialize_results(fd_client, results);
 #endif
 
         auto end = std::chrono::high_resolution_clock::now();
         std::chrono::duration<double> elapsed = end - start;
         std::cout << "[Timing] process_client_request took " << std::fixed << std::setprecision(2) << elapsed.count()
-                  << " seconds\n";
+                  << " seconds";
+#ifndef TEST_NETWORK_ONLY
+        if (cached)
+            std::cout << ", from the result cache";
+        else
+            std::cout << ", ranking " << candidates.size() << " of " << blobs.size() << " chunks";
+#endif
+        std::cout << '\n';
 
         return true;
     } catch (...) {
@@ -164,14 +241,38 @@ bool CSolver::process_client_request(int fd_client) {
     }
 }
 
+// Serves the connections the accept loop queues, one query at a time.
+void* CSolver::worker(void* arg) {
+    auto* solver = static_cast<CSolver*>(arg);
+    while (true) {
+        int fd = solver->connections.pop();
+        if (!solver->process_client_request(fd)) std::cerr << "Failed to handle query on fd " << fd << '\n';
 
+        close(fd);   // done with the client
+    }
+    return nullptr;
+}
+
+// Accepts connections and queues them for NUM_QUERY_WORKERS workers. While
+// QUERY_QUEUE_SIZE connections are waiting, the accept loop blocks and new
+// clients wait in the listen backlog.
 void CSolver::serve_requests() {
     if (listen(fd_serv, SOMAXCONN) < 0) {
         perror("listen");
         close(fd_serv);
         std::exit(EXIT_FAILURE);
     }
-    std::cout << "Server listening …\n";
+
+    long workers = NUM_QUERY_WORKERS ? NUM_QUERY_WORKERS : std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    for (long i = 0; i < workers; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, nullptr, CSolver::worker, this) != 0) {
+            perror("pthread_create");
+            std::exit(EXIT_FAILURE);
+        }
+        pthread_detach(thread);
+    }
+    std::cout << "Server listening with " << workers << " query workers …\n";
 
     while (true) {
         sockaddr_in client_addr;
@@ -186,8 +287,6 @@ void CSolver::serve_requests() {
         inet_ntop(AF_INET, &client_addr.sin_addr, ip, sizeof(ip));
         std::cout << "Connection from " << ip << ':' << ntohs(client_addr.sin_port) << '\n';
 
-        if (!process_client_request(fd)) std::cerr << "Failed to handle query from " << ip << '\n';
-
-        close(fd);   // done with the client
+        connections.push(fd);
     }
 }
@@ -1,17 +1,29 @@
 #ifndef CSOLVER_H
 #define CSOLVER_H
 
+#include <atomic>
 #include <string>
 #include <vector>
 
 #include <netinet/in.h>
 
 #include "../indexer/Indexer.hpp"   // for IndexBlob
+#include "../indexer/TermSummary.hpp"
+#include "../lib/clock_cache.h"
+#include "../lib/mpmc_queue.h"
+#include "../lib/work_stealing_pool.h"
 #include "../ranker/Ranker.hpp"
 #include "ast.h"
 
 const uint32_t MAX_RESULTS = 10;
-const uint32_t MAX_RANKED_DOCS = 200;
+const unsigned NUM_QUERY_WORKERS = 0;   // queries served at once; 0: one per core
+const size_t QUERY_QUEUE_SIZE = 256;    // accepted connections waiting for a worker
+const unsigned NUM_CHUNK_WORKERS = 0;   // threads ranking chunks, shared by all queries; 0: one per core
+const size_t CHUNK_QUEUE_SIZE = 4096;   // chunks waiting to be ranked
+const size_t RESULT_CACHE_SHARDS = 16;
+const size_t RESULT_CACHE_ENTRIES = 1 << 16;   // queries whose results are kept
+const size_t RESULT_CACHE_BYTES = 64 << 20;
+const unsigned METRICS_PORT_OFFSET = 1;        // metrics are served on 127.0.0.1 at the query port plus this
 
 namespace Ranker {
 class Ranker;
@@ -21,23 +33,44 @@ struct RankingResult;
 
 class CSolver {
 private:
+    // results point into the blobs, so only the vector itself is counted
+    struct Result_Cost {
+        size_t operator()(const std::vector<RankingResult>& results) const;
+    };
+
     inline static CSolver* instance = nullptr;
     sockaddr_in addr_serv;
     int fd_serv;
+    Bounded_MPMC_Queue<int> connections;
+    Work_Stealing_Pool chunk_pool;
+    TermSummaries summaries;   // one per blob, to skip the chunks a query cannot match
+
+    // each query's results, keyed by the chunk set they were ranked on and Expr_AST::canonical
+    Sharded_Clock_Cache<std::vector<RankingResult>, Result_Cost> results_cache;
+    std::atomic<uint64_t> chunk_set { 0 };
 
+    static void* worker(void* arg);
 
     ~CSolver();
-    CSolver(const std::string& ip, unsigned port, const std::vector<IndexBlob*>& blobs);
+    CSolver(const std::string& ip, unsigned port, const std::vector<IndexBlob*>& blobs,
+            const std::vector<std::string>& files);
 
 
 public:
     bool process_client_request(int fd_client);
     std::vector<IndexBlob*> blobs;
-    static void init_instance(const std::string& ip, unsigned port, const std::vector<IndexBlob*>& blobs);
+    // files[i], if given, is the chunk blobs[i] was loaded from, beside which its term summary is read
+    static void init_instance(const std::string& ip, unsigned port, const std::vector<IndexBlob*>& blobs,
+                              const std::vector<std::string>& files = {});
     static CSolver* get_instance();
 
     void serve_requests();
 
+    // Forgets every cached result.  Call it whenever blobs changes, before the
+    // blobs that left are unmapped; queries ranked on the old chunks while it
+    // runs are not cached under the new ones.
+    void invalidate_results();
+
     static void serialize_results(int fd_client, const std::vector<RankingResult>& results);
 };
 
@@ -57,6 +57,7 @@ int main(int argc, char* argv[]) {
     }
 
     std::vector<IndexBlob*> blobs;
+    std::vector<std::string> blob_paths;   // the file each blob was loaded from
     std::vector<IndexFile> files;
     files.reserve(bin_paths.size());
 
@@ -95,6 +96,7 @@ int main(int argc, char* argv[]) {
             }
 
             blobs.push_back(blob);
+            blob_paths.push_back(p);
 
         } catch (const std::exception& e) {
             std::cerr << "Skipping " << p << " (" << e.what() << ")\n";
@@ -106,7 +108,7 @@ int main(int argc, char* argv[]) {
         return 4;
     }
 
-    CSolver::init_instance("", port, blobs);
+    CSolver::init_instance("", port, blobs, blob_paths);
     CSolver::get_instance()->serve_requests();
     return 0;
 }
@@ -0,0 +1,163 @@
+// query_bench: measures how many queries a csolver serves a second, and how
+// long they take, as the number of clients querying it at once grows.
+//
+// usage: ./query_bench <ip> <port> <queries file> [seconds per step] [concurrency ...]
+//
+// Each line of the queries file is one query.  A line that starts with a
+// protocol symbol (see query/protocol_query.h) is sent as it is, e.g.
+// "&{cat>{dog>"; otherwise its words are sent as index terms joined by AND.
+// At each concurrency (1 2 4 8 16 32 by default), that many clients send the
+// queries round robin, one connection per query as the query server does,
+// and the queries served a second and the p50, p99 and max latencies are
+// printed.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../../query/protocol_query.h"
+
+using Clock = std::chrono::steady_clock;
+
+sockaddr_in server;
+
+std::string Encode(const std::string& line) {
+    using namespace Query::Protocol;
+    std::string query;
+    if (std::strchr("&|/-{<", line[0])) {
+        query = line;
+    } else {
+        std::istringstream words(line);
+        std::vector<std::string> terms;
+        for (std::string term; words >> term;)
+            terms.push_back(term);
+        for (size_t i = 0; i < terms.size(); ++i) {
+            if (i + 1 < terms.size())
+                query += AND;
+            query += WORD_START + terms[i] + PHRASE_END;
+        }
+    }
+    return query + QUERY_END;
+}
+
+// Sends one query and reads its results; returns false if the connection failed.
+bool Ask(const std::string& query) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&server), sizeof(server)) < 0) {
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    bool ok = send(fd, query.data(), query.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(query.size());
+
+    // count, then a url line, a title line and an 8 byte score per result
+    std::string reply;
+    char buffer[4096];
+    uint32_t results = UINT32_MAX, lines = 0;
+    size_t scan = 4;
+    while (ok) {
+        if (results == UINT32_MAX && reply.size() >= 4) {
+            std::memcpy(&results, reply.data(), 4);
+            results = ntohl(results);
+        }
+        while (results != UINT32_MAX && lines < 2 * results && scan < reply.size()) {
+            size_t newline = reply.find('\n', scan);
+            if (newline == std::string::npos || (lines % 2 && newline + 9 > reply.size()))
+                break;
+            scan = newline + 1 + (lines % 2 ? 8 : 0);
+            ++lines;
+        }
+        if (results != UINT32_MAX && lines == 2 * results && scan <= reply.size())
+            break;
+
+        ssize_t got = recv(fd, buffer, sizeof(buffer), 0);
+        if (got <= 0)
+            ok = false;
+        else
+            reply.append(buffer, got);
+    }
+    close(fd);
+    return ok;
+}
+
+double Percentile(std::vector<double>& sorted, double p) {
+    if (sorted.empty())
+        return 0;
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        std::fprintf(stderr, "usage: %s <ip> <port> <queries file> [seconds per step] [concurrency ...]\n", argv[0]);
+        return 1;
+    }
+    server.sin_family = AF_INET;
+    server.sin_port = htons(std::stoi(argv[2]));
+    if (inet_pton(AF_INET, argv[1], &server.sin_addr) != 1) {
+        std::fprintf(stderr, "bad ip %s\n", argv[1]);
+        return 1;
+    }
+
+    std::vector<std::string> queries;
+    std::ifstream file(argv[3]);
+    for (std::string line; std::getline(file, line);)
+        if (!line.empty())
+            queries.push_back(Encode(line));
+    if (queries.empty()) {
+        std::fprintf(stderr, "no queries in %s\n", argv[3]);
+        return 1;
+    }
+
+    double seconds = argc > 4 ? std::stod(argv[4]) : 10;
+    std::vector<int> steps;
+    for (int i = 5; i < argc; ++i)
+        steps.push_back(std::stoi(argv[i]));
+    if (steps.empty())
+        steps = {1, 2, 4, 8, 16, 32};
+
+    std::printf("%11s %9s %9s %9s %9s %8s\n", "concurrency", "queries/s", "p50 ms", "p99 ms", "max ms", "failed");
+    for (int clients : steps) {
+        std::vector<std::vector<double>> latencies(clients);
+        std::atomic<size_t> failed{0};
+        auto end = Clock::now() + std::chrono::duration<double>(seconds);
+        auto begin = Clock::now();
+
+        std::vector<std::thread> threads;
+        for (int c = 0; c < clients; ++c) {
+            threads.emplace_back([&, c] {
+                for (size_t i = c; Clock::now() < end; i += clients) {
+                    auto sent = Clock::now();
+                    if (Ask(queries[i % queries.size()]))
+                        latencies[c].push_back(std::chrono::duration<double, std::milli>(Clock::now() - sent).count());
+                    else
+                        ++failed;
+                }
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+        double elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+
+        std::vector<double> all;
+        for (auto& client : latencies)
+            all.insert(all.end(), client.begin(), client.end());
+        std::sort(all.begin(), all.end());
+        std::printf("%11d %9.1f %9.2f %9.2f %9.2f %8zu\n", clients, all.size() / elapsed, Percentile(all, 0.5),
+                    Percentile(all, 0.99), all.empty() ? 0 : all.back(), failed.load());
+        std::fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+// test_canonical: checks Expr_AST::canonical, the key csolver caches query
+// results by.  Queries that must rank the same pages the same way have to get
+// the same key, and queries that may not have to get different keys, or one
+// query would be served another's results.
+//
+// usage: ./test_canonical
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "../ast.h"
+
+using namespace Query::Protocol;
+
+size_t failures = 0;
+
+// The key of a query given in protocol bytes, without its QUERY_END.
+std::string Key(const std::string& query) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        perror("socketpair");
+        exit(1);
+    }
+    std::string bytes = query + QUERY_END;
+    if (write(fds[0], bytes.data(), bytes.size()) != static_cast<ssize_t>(bytes.size())) {
+        perror("write");
+        exit(1);
+    }
+    close(fds[0]);
+    Expr_AST ast(fds[1]);
+    close(fds[1]);
+    return ast.canonical();
+}
+
+// An OR_SYN of two expressions, with its steps as the protocol sends them.
+std::string Syn(const std::string& left, const std::string& right, uint32_t advanceRight, uint32_t advanceLeft) {
+    std::string out = OR_SYN + left + right;
+    for (uint32_t step : { advanceRight, advanceLeft }) {
+        uint32_t wire = htonl(step);
+        out.append(reinterpret_cast<const char*>(&wire), sizeof(wire));
+        out += STEP_DELIM;
+    }
+    return out;
+}
+
+void Same(const std::string& a, const std::string& b, const std::string& why) {
+    std::string ka = Key(a), kb = Key(b);
+    if (ka != kb) {
+        ++failures;
+        std::cerr << why << ": " << a << " and " << b << " have keys " << ka << " and " << kb << '\n';
+    }
+}
+
+void Different(const std::string& a, const std::string& b, const std::string& why) {
+    std::string ka = Key(a), kb = Key(b);
+    if (ka == kb) {
+        ++failures;
+        std::cerr << why << ": " << a << " and " << b << " share the key " << ka << '\n';
+    }
+}
+
+int main() {
+    // chains of one operator flatten, however the client nested them
+    Same("&{a>&{b>{c>", "&&{a>{b>{c>", "nested AND");
+    Same("|{a>|{b>{c>", "||{a>{b>{c>", "nested OR");
+    Same("&{a>&{b>&{c>{d>", "&&&{a>{b>{c>{d>", "deeper AND");
+
+    // a repeated operand adds nothing, so only its first place counts
+    Same("|{a>{a>", "{a>", "OR of a word with itself");
+    Same("&{a>{a>", "{a>", "AND of a word with itself");
+    Same("&{a>&{b>{a>", "&{a>{b>", "repeat later in a chain");
+    Same("&<a b>&{c><a b>", "&<a b>{c>", "repeated phrase");
+
+    // NOT reads a second operand and ignores it
+    Same("-{a>{b>", "-{a>>", "NOT's discarded operand");
+
+    // the ranker scores the terms' order
+    Different("&{a>{b>", "&{b>{a>", "swapped AND");
+    Different("|{a>{b>", "|{b>{a>", "swapped OR");
+    Different("&{a>&{b>{c>", "&{a>&{c>{b>", "reordered chain");
+    Different("&{a>&{b>{c>", "&{a>{b>", "chain of three and two");
+
+    // structure
+    Different("<a b>", "&{a>{b>", "phrase and separate words");
+    Different("<a b>", "<b a>", "phrase order");
+    Different("<a b>", "{a b>", "phrase and a word with a space");
+    Different("&{a>{b>", "|{a>{b>", "AND and OR");
+    Different("&{a>|{b>{c>", "|&{a>{b>{c>", "AND of OR and OR of AND");
+    Different("&{a>&{b>{c>", "&{a>|{b>{c>", "AND chain and AND of an OR");
+    Different("&|{a>{b>{c>", "|{a>{b>", "a chain inside a chain is not flattened into it");
+    Different("-{a>>", "{a>", "NOT and its operand");
+    Different("-{a>>", "-{b>>", "NOT of different words");
+    Different("&{a>-{b>>", "&{a>{b>", "AND NOT and AND");
+
+    // OR_SYN's steps decide how results are drawn from each side
+    Same(Syn("{a>", "{b>", 2, 1), Syn("{a>", "{b>", 2, 1), "same OR_SYN");
+    Different(Syn("{a>", "{b>", 2, 1), Syn("{a>", "{b>", 1, 2), "OR_SYN steps swapped");
+    Different(Syn("{a>", "{b>", 2, 1), Syn("{a>", "{b>", 3, 1), "OR_SYN step changed");
+    Different(Syn("{a>", "{b>", 2, 1), Syn("{b>", "{a>", 2, 1), "OR_SYN sides swapped");
+    Different(Syn("{a>", "{b>", 2, 1), "|{a>{b>", "OR_SYN and OR");
+    Different(Syn("{a>", "{b>", 12, 1), Syn("{a>", "{b>", 1, 21), "OR_SYN steps run together");
+
+    // escaped PHRASE_END and ESCAPE stay part of their term
+    Different("{a\\>b>", "&{a>{b>", "escaped > in a word");
+    Different("{a\\>>", "{a\\\\>", "escaped > and escaped \\");
+    Different("{a\\\\>", "{a>", "escaped \\ and nothing");
+    Different("<a\\> b>", "<a \\>b>", "escaped > in a phrase");
+    Different("&{a\\>>{b>", "&{a>{\\>b>", "escaped > moved between words");
+    Different("&{a\\>&{b>{c>", "&{a>&{b>{c>", "escaped > that would end the word and start a chain");
+    Same("&{a\\>>{a\\>>", "{a\\>>", "repeated escaped word");
+
+    std::cout << (failures ? "FAILED" : "passed") << '\n';
+    return failures ? 1 : 0;
+}
@@ -11,10 +11,11 @@
 #include "../lib/HashTable.h"
 #include "../lib/file.h"
 #include "../lib/mutex.h"
-#include "../lib/stemmer.h"
+#include "../lib/stem_cache.h"
 #include "../parser/HtmlParser.h"
 #include "HashBlob.h"
 #include "Posts.hpp"
+#include "TermSummary.hpp"
 
 const size_t UNIQUE_WORDS_THRESHOLD = 20;
 
@@ -332,6 +333,7 @@ struct Index {
     Location DocumentsInIndex = 0;
     Location LocationsInIndex = 0;
     Location MaximumLocation = 0;
+    size_t MemoryBytes = 0;   // heap held by the postings, dictionary and url table, roughly
 
     URLTable urlTable;
     HashTable<const char*, PostingList*> dictionary;
@@ -369,11 +371,14 @@ struct Index {
                 return;
             }
             WordsInIndex++;
+            MemoryBytes += token.size() + 1 + sizeof(PostingList) + sizeof(Bucket<const char*, PostingList*>);
         } else {
             list = entry->value;
         }
 
+        size_t capacity = list->rawPostingData.capacity();
         list->AddWordPost(&post);
+        MemoryBytes += list->rawPostingData.capacity() - capacity;
         LocationsInIndex++;
     }
 
@@ -392,19 +397,25 @@ struct Index {
                 return;
             }
             WordsInIndex++;
+            MemoryBytes += token.size() + 1 + sizeof(PostingList) + sizeof(Bucket<const char*, PostingList*>);
         } else {
             list = entry->value;
         }
 
+        size_t capacity = list->rawPostingData.capacity();
         list->AddWordPost(&post);
+        MemoryBytes += list->rawPostingData.capacity() - capacity;
         LocationsInIndex++;
     }
 
     void Insert(HtmlParser* parsedURL) {
-        if (parsedURL->titleWords.size() >= 40) {
+        size_t titleWordCount = parsedURL->TitleWordCount();
+        size_t wordCount = parsedURL->WordCount();
+
+        if (titleWordCount >= 40) {
             return;
         }
-        size_t totalLocationsNeeded = parsedURL->titleWords.size() + parsedURL->words_flags.size() + 2;
+        size_t totalLocationsNeeded = titleWordCount + wordCount + 2;
 
         char* keyCopyURL = strdup(parsedURL->pageURL.c_str());
         char* titleCopy = strdup(parsedURL->title_chunk.c_str());
@@ -415,27 +426,51 @@ struct Index {
         MaximumLocation += totalLocationsNeeded;
         Location endLocation = startLocation + totalLocationsNeeded - 1;
 
+        size_t urls = urlTable.docAttributes.capacity();
+        size_t docs = docEnd->rawPostingData.capacity();
+        MemoryBytes += parsedURL->pageURL.size() + parsedURL->title_chunk.size() + 2
+                     + sizeof(Bucket<const char*, uint32_t>);
+
         uint32_t id = urlTable.AddURL(keyCopyURL);
-        urlTable.SetDocumentAttributes(titleCopy, id, parsedURL->words_flags.size() + parsedURL->titleWords.size(),
-                                       strlen(keyCopyURL), parsedURL->titleWords.size(), startLocation, endLocation,
+        urlTable.SetDocumentAttributes(titleCopy, id, wordCount + titleWordCount,
+                                       strlen(keyCopyURL), titleWordCount, startLocation, endLocation,
                                        parsedURL->english);
 
         DocumentPost post = { startLocation, endLocation, id };
         docEnd->AddDocumentPost(&post);
+        MemoryBytes += (urlTable.docAttributes.capacity() - urls) * sizeof(DocumentAttributes)
+                     + docEnd->rawPostingData.capacity() - docs;
         DocumentsInIndex++;
         LocationsInIndex++;
 
         Location nextLocation = startLocation;
-        for (auto& token : parsedURL->titleWords) {
-            auto stem = Stemmer::stem(token);
-            if (!stem.empty()) {
-                AddTitle(stem, nextLocation);
+        if (parsedURL->compact) {
+            // compact parses hold spans into the page instead of strings
+            for (auto& span : parsedURL->titleSpans) {
+                auto stem = Stem_Cache::stem(parsedURL->SpanText(span));
+                if (!stem.empty()) {
+                    AddTitle(stem, nextLocation);
+                }
+            }
+            for (size_t i = 0; i < wordCount; ++i) {
+                auto stem = Stem_Cache::stem(parsedURL->SpanText(parsedURL->wordSpans[i]));
+                if (!stem.empty()) {
+                    AddWord(stem, parsedURL->wordFlags[i], nextLocation);
+                }
             }
         }
-        for (auto& token : parsedURL->words_flags) {
-            auto stem = Stemmer::stem(token.word);
-            if (!stem.empty()) {
-                AddWord(stem, token.flags, nextLocation);
+        else {
+            for (auto& token : parsedURL->titleWords) {
+                auto stem = Stem_Cache::stem(token);
+                if (!stem.empty()) {
+                    AddTitle(stem, nextLocation);
+                }
+            }
+            for (auto& token : parsedURL->words_flags) {
+                auto stem = Stem_Cache::stem(token.word);
+                if (!stem.empty()) {
+                    AddWord(stem, token.flags, nextLocation);
+                }
             }
         }
         for (auto& token : parsedURL->links) {
@@ -603,6 +638,7 @@ public:
         }
         IndexBlob::Write(blob, urlBytes, hashBytes, index);
         msync(blob, fileSize, MS_SYNC);
+        TermSummary::Build(blob->GetHashBlob()).Write(TermSummary::FileName(filename));
     }
 
     void close_file() {
@@ -0,0 +1,198 @@
+#ifndef TERM_SUMMARY_HPP
+#define TERM_SUMMARY_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../lib/HashTable.h"
+#include "../lib/constants.h"
+#include "HashBlob.h"
+
+// A term summary is a blocked Bloom filter over the keys of one index
+// chunk's dictionary, written beside the chunk (index_chunk<n>.terms for
+// index_chunk<n>.bin).  It lets csolver tell, without touching the chunk,
+// that a term is not in it.  A term is hashed once with the dictionary's
+// own HashFunction, remixed to 64 bits, and all its probes fall in one
+// 64-byte block.
+//
+// File format, integers in host byte order:
+//     u32 Magic | u32 Version | u32 number of blocks | u32 number of hashes | blocks
+class TermSummary {
+public:
+    static constexpr uint32_t Magic = 0x4d555354;   // "TSUM"
+    static constexpr uint32_t Version = 1;
+    static constexpr size_t BlockWords = 8;         // 512 bits
+    static constexpr uint32_t MaxHashes = 16;
+
+    uint32_t hashes = 0;
+    std::vector<uint64_t> blocks;
+
+    static std::string FileName(const std::string& chunk) {
+        bool bin = chunk.size() >= 4 && chunk.compare(chunk.size() - 4, 4, ".bin") == 0;
+        return (bin ? chunk.substr(0, chunk.size() - 4) : chunk) + ".terms";
+    }
+
+    static uint64_t Hash(const char* term) { return Mix(HashFunction(term)); }
+
+    // Whether the term with this Hash may be in a chunk, given the chunk's
+    // summary blocks.  False means it certainly is not.
+    static bool MayContain(const uint64_t* blocks, size_t numBlocks, uint32_t hashes, uint64_t hash) {
+        const uint64_t* block = blocks + BlockOf(hash, numBlocks) * BlockWords;
+        uint64_t mask[BlockWords];
+        Mask(hash, hashes, mask);
+        for (size_t w = 0; w < BlockWords; ++w) {
+            if ((block[w] & mask[w]) != mask[w]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Summarizes every key in a chunk's dictionary, sized for
+    // INDEX_TERM_SUMMARY_FP_RATE.
+    static TermSummary Build(const HashBlob* dictionary) {
+        size_t keys = 0;
+        ForEachTuple(dictionary, [&](const SerialTuple*) { ++keys; });
+
+        // blocks fill unevenly, so size for a somewhat lower rate to meet the requested one
+        TermSummary summary;
+        keys = std::max<size_t>(keys, 1);
+        double bits = -1 * (keys * std::log(INDEX_TERM_SUMMARY_FP_RATE * 0.8) / (std::log(2) * std::log(2)));
+        size_t numBlocks = std::max<size_t>(1, static_cast<size_t>(std::ceil(bits / (BlockWords * 64))));
+        summary.hashes = std::clamp<uint32_t>(static_cast<uint32_t>(std::round(bits / keys * std::log(2))), 1, MaxHashes);
+        summary.blocks.assign(numBlocks * BlockWords, 0);
+
+        ForEachTuple(dictionary, [&](const SerialTuple* tuple) {
+            uint64_t hash = Mix(tuple->HashValue);   // the key's HashFunction, kept in the dictionary
+            uint64_t* block = summary.blocks.data() + BlockOf(hash, numBlocks) * BlockWords;
+            uint64_t mask[BlockWords];
+            Mask(hash, summary.hashes, mask);
+            for (size_t w = 0; w < BlockWords; ++w) {
+                block[w] |= mask[w];
+            }
+        });
+        return summary;
+    }
+
+    bool Write(const std::string& filename) const {
+        int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            perror("open");
+            return false;
+        }
+        uint32_t header[4] = { Magic, Version, static_cast<uint32_t>(blocks.size() / BlockWords), hashes };
+        size_t bytes = blocks.size() * sizeof(uint64_t);
+        bool ok = write(fd, header, sizeof(header)) == static_cast<ssize_t>(sizeof(header))
+               && write(fd, blocks.data(), bytes) == static_cast<ssize_t>(bytes);
+        close(fd);
+        if (!ok) {
+            unlink(filename.c_str());
+        }
+        return ok;
+    }
+
+    // Returns false, leaving the summary empty, if the file is missing or not a whole summary.
+    bool Read(const std::string& filename) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        uint32_t header[4];
+        bool ok = read(fd, header, sizeof(header)) == static_cast<ssize_t>(sizeof(header)) && header[0] == Magic
+               && header[1] == Version && header[2] && header[3] && header[3] <= MaxHashes;
+        if (ok) {
+            hashes = header[3];
+            blocks.resize(static_cast<size_t>(header[2]) * BlockWords);
+            size_t bytes = blocks.size() * sizeof(uint64_t);
+            char extra;
+            ok = read(fd, blocks.data(), bytes) == static_cast<ssize_t>(bytes) && read(fd, &extra, 1) == 0;
+        }
+        close(fd);
+        if (!ok) {
+            hashes = 0;
+            blocks.clear();
+        }
+        return ok;
+    }
+
+private:
+    static uint64_t Mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static size_t BlockOf(uint64_t hash, size_t numBlocks) {
+        return static_cast<size_t>((static_cast<__uint128_t>(hash) * numBlocks) >> 64);
+    }
+
+    // The bits of a key within its block, 9 bits of a remixed hash per probe.
+    static void Mask(uint64_t hash, uint32_t hashes, uint64_t (&mask)[BlockWords]) {
+        std::fill(mask, mask + BlockWords, 0);
+        uint64_t bits = Mix(hash + 0x9e3779b97f4a7c15ULL);
+        for (uint32_t i = 0, used = 0; i < hashes; ++i, used += 9) {
+            if (used + 9 > 64) {
+                bits = Mix(bits + hash);
+                used = 0;
+            }
+            size_t bit = (bits >> used) & (BlockWords * 64 - 1);
+            mask[bit / 64] |= uint64_t(1) << (bit % 64);
+        }
+    }
+
+    template <typename Visit>
+    static void ForEachTuple(const HashBlob* dictionary, const Visit& visit) {
+        for (uint32_t i = 0; i < dictionary->NumberOfBuckets; ++i) {
+            uint32_t offset = dictionary->Buckets[i];
+            if (offset == 0) {
+                continue;
+            }
+            const char* ptr = reinterpret_cast<const char*>(dictionary) + offset;
+            for (auto tuple = reinterpret_cast<const SerialTuple*>(ptr); tuple->Length != 0;
+                 tuple = reinterpret_cast<const SerialTuple*>(ptr)) {
+                visit(tuple);
+                ptr += tuple->Length;
+            }
+        }
+    }
+};
+
+// The term summaries of every chunk a csolver searches, in one array so that
+// checking a query against all of them walks contiguous memory.
+class TermSummaries {
+public:
+    void Add(const TermSummary& summary) {
+        chunks.push_back({ blocks.size(), summary.blocks.size() / TermSummary::BlockWords, summary.hashes });
+        blocks.insert(blocks.end(), summary.blocks.begin(), summary.blocks.end());
+    }
+
+    bool MayContain(size_t chunk, uint64_t hash) const {
+        const Chunk& c = chunks[chunk];
+        return TermSummary::MayContain(blocks.data() + c.offset, c.numBlocks, c.hashes, hash);
+    }
+
+    size_t Chunks() const { return chunks.size(); }
+    size_t Bytes() const { return blocks.size() * sizeof(uint64_t); }
+
+private:
+    struct Chunk {
+        size_t offset;
+        size_t numBlocks;
+        uint32_t hashes;
+    };
+
+    std::vector<uint64_t> blocks;
+    std::vector<Chunk> chunks;
+};
+
+#endif   // TERM_SUMMARY_HPP
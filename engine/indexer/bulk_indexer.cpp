@@ -0,0 +1,240 @@
+// bulk_indexer: builds index chunks from page dump files, so that an index
+// can be rebuilt (after a format change, say) without crawling again.
+//
+// usage: ./bulk_indexer <dump directory> [chunk directory]
+//
+// Every file in the dump directory is read as page dump records (see
+// parser/protocol_parser.h).  A reader thread hands the pages to a parse
+// worker per core, index threads insert the parsed pages into chunks cut at
+// the same limits as the parser's, and save threads write each chunk as an
+// index_chunk<n>.bin, numbered on from any chunks already in the chunk
+// directory.  Pages are parsed with the parser's deadline and byte cap, so
+// the chunks hold what the online path would have made of the same pages.
+//
+// A url may be in the dumps more than once: the parser dumps a page as it
+// arrives, before it drops duplicates, and after a crash a crawler sends
+// again every page it had not been credited for.  As in the parser, only
+// the first page with a url is indexed.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Indexer.hpp"
+#include "../lib/BloomFilter.h"
+#include "../lib/constants.h"
+#include "../lib/iostream.h"
+#include "../lib/mpmc_queue.h"
+#include "../lib/work_stealing_pool.h"
+#include "../parser/HtmlParser.h"
+#include "../parser/protocol_parser.h"
+
+const size_t QUEUE_SIZE = 2048;
+const size_t DUMP_BYTES_PER_PAGE = 512;     // fewer than any real page takes, to size the url filter
+const double DEDUP_FP_RATE = 1e-4;          // the share of new urls taken for repeats and not indexed
+const size_t DEDUP_MIN_URLS = 1 << 20;      // so that a dump of tiny test pages does not overfill it
+
+struct Chunk {
+    Index* index;
+    int number;
+};
+
+Bounded_MPMC_Queue<HtmlParser*> parsedPages{QUEUE_SIZE};
+Bounded_MPMC_Queue<Chunk> toSave{NUM_INDEX_SAVE_THREADS};
+std::string chunkDirectory;
+std::atomic<int> chunkCount{0};
+
+std::atomic<uint64_t> pagesRead{0};
+std::atomic<uint64_t> pagesDuplicate{0};
+std::atomic<uint64_t> bytesRead{0};
+std::atomic<uint64_t> pagesIndexed{0};
+std::atomic<uint64_t> chunksSaved{0};
+std::atomic<uint64_t> chunkBytes{0};
+
+std::string ChunkName(int number) {
+    return chunkDirectory + "/" + INDEX_CHUNK_NAME + std::to_string(number) + ".bin";
+}
+
+// Inserts parsed pages into a chunk until it reaches MIN_PAGES_PER_CHUNK or
+// INDEX_CHUNK_MAX_BYTES, then hands it on and starts the next.  A null page
+// means the input has ended.
+void IndexThread() {
+    Index* index = new Index{};
+    while (true) {
+        HtmlParser* page = parsedPages.pop();
+        if (page) {
+            index->Insert(page);
+            delete page;
+            ++pagesIndexed;
+        }
+
+        bool last = !page;
+        if (last || index->DocumentsInIndex >= MIN_PAGES_PER_CHUNK || index->MemoryBytes >= INDEX_CHUNK_MAX_BYTES) {
+            if (index->DocumentsInIndex) {
+                toSave.push(Chunk{index, chunkCount++});
+                index = last ? nullptr : new Index{};
+            }
+            if (last) {
+                delete index;
+                return;
+            }
+        }
+    }
+}
+
+// Writes chunks to disk until it is handed a null one.
+void SaveThread() {
+    while (true) {
+        Chunk chunk = toSave.pop();
+        if (!chunk.index) {
+            return;
+        }
+        IndexFile file(ChunkName(chunk.number).c_str(), chunk.index);
+        chunkBytes += file.Size();
+        file.close_file();
+        ++chunksSaved;
+        delete chunk.index;
+    }
+}
+
+// Submits a parse task for every record in the dump file whose url is not in
+// seen, and adds the url.
+void ReadDump(const std::string& filename, Work_Stealing_Pool& parsers, Blocked_Bloomfilter& seen) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        perror(filename.c_str());
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    if (info.st_size == 0) {
+        close(fd);
+        return;
+    }
+    void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        perror(filename.c_str());
+        return;
+    }
+    madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+
+    std::string_view dump(static_cast<const char*>(mapped), info.st_size);
+    while (!dump.empty()) {
+        std::string_view url, body;
+        uint32_t depth;
+        size_t size = ParserProtocol::parse_dump_record(dump, url, depth, body);
+        if (!size) {
+            irs::cerr << filename.c_str() << " ends in a partial or malformed record; skipped its last "
+                      << dump.size() << " bytes" << irs::endl;
+            break;
+        }
+        dump.remove_prefix(size);
+        ++pagesRead;
+        bytesRead += body.size();
+        if (seen.test_and_insert(url)) {
+            ++pagesDuplicate;
+            continue;
+        }
+
+        // as the parser would: at most PARSER_PARSE_MAX_BYTES of the page, within the parse budget
+        std::string html(body.substr(0, PARSER_PARSE_MAX_BYTES));
+        parsers.submit([html = std::move(html), url = std::string(url)]() mutable {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(PARSER_PARSE_BUDGET_MS);
+            auto page = new HtmlParser(std::move(html), deadline);
+            page->pageURL = std::move(url);
+            parsedPages.push(page);
+        });
+    }
+    munmap(mapped, info.st_size);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        std::fprintf(stderr, "usage: %s <dump directory> [chunk directory]\n", argv[0]);
+        return 1;
+    }
+    std::string dumpDirectory = argv[1];
+    chunkDirectory = argc > 2 ? argv[2] : ".";
+
+    std::vector<std::string> dumps;
+    size_t dumpBytes = 0;
+    DIR* dir = opendir(dumpDirectory.c_str());
+    if (!dir) {
+        perror(dumpDirectory.c_str());
+        return 1;
+    }
+    while (dirent* entry = readdir(dir)) {
+        std::string name = dumpDirectory + "/" + entry->d_name;
+        struct stat info;
+        if (stat(name.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+            dumps.push_back(name);
+            dumpBytes += info.st_size;
+        }
+    }
+    closedir(dir);
+    std::sort(dumps.begin(), dumps.end());
+
+    // number on from the chunks already there, as the parser does
+    while (access(ChunkName(chunkCount).c_str(), F_OK) == 0) {
+        ++chunkCount;
+    }
+    int firstChunk = chunkCount;
+
+    auto begin = std::chrono::steady_clock::now();
+
+    // index threads share the cores with the parse workers; stemming makes an insert cost about as much as a parse
+    long cores = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    size_t indexThreads = std::max(1L, cores / 2);
+    std::vector<std::thread> indexers, savers;
+    for (size_t i = 0; i < indexThreads; ++i) {
+        indexers.emplace_back(IndexThread);
+    }
+    for (int i = 0; i < NUM_INDEX_SAVE_THREADS; ++i) {
+        savers.emplace_back(SaveThread);
+    }
+
+    {
+        Work_Stealing_Pool parsers{0, QUEUE_SIZE};
+        Blocked_Bloomfilter seen{std::max(dumpBytes / DUMP_BYTES_PER_PAGE, DEDUP_MIN_URLS), DEDUP_FP_RATE};
+        for (const auto& dump : dumps) {
+            ReadDump(dump, parsers, seen);
+        }
+    }   // the pool runs every task submitted before it is gone
+
+    for (size_t i = 0; i < indexThreads; ++i) {
+        parsedPages.push(nullptr);
+    }
+    for (auto& thread : indexers) {
+        thread.join();
+    }
+    for (size_t i = 0; i < savers.size(); ++i) {
+        toSave.push(Chunk{nullptr, 0});
+    }
+    for (auto& thread : savers) {
+        thread.join();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    std::printf("%lu pages (%.1f MB of html) from %zu dump files in %.2f s: %.0f pages/s, %.1f MB/s\n",
+                static_cast<unsigned long>(pagesRead.load()), bytesRead / 1e6, dumps.size(), seconds,
+                pagesRead / seconds, bytesRead / seconds / 1e6);
+    std::printf("%lu pages skipped as repeats of a url already read\n",
+                static_cast<unsigned long>(pagesDuplicate.load()));
+    std::printf("%lu pages indexed into %lu chunks (%s through %s), %.1f MB\n",
+                static_cast<unsigned long>(pagesIndexed.load()), static_cast<unsigned long>(chunksSaved.load()),
+                ChunkName(firstChunk).c_str(), ChunkName(chunkCount - 1).c_str(), chunkBytes / 1e6);
+    return 0;
+}
@@ -0,0 +1,60 @@
+// Checks a chunk's term summary: every term in the chunk must be found, and
+// terms not in it should be found about INDEX_TERM_SUMMARY_FP_RATE of the time.
+//
+// usage: ./test_term_summary <index_chunk.bin> [probes]
+
+#include <cassert>
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include "../Indexer.hpp"
+#include "../TermSummary.hpp"
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <index_chunk.bin> [probes]\n", argv[0]);
+        return 1;
+    }
+    size_t probes = argc > 2 ? std::stoul(argv[2]) : 1000000;
+
+    IndexFile file(argv[1]);
+    const HashBlob* dictionary = file.blob->GetHashBlob();
+    TermSummary built = TermSummary::Build(dictionary);
+    TermSummaries summaries;
+    summaries.Add(built);
+
+    // no false negatives
+    size_t terms = 0;
+    for (uint32_t i = 0; i < dictionary->NumberOfBuckets; ++i) {
+        if (dictionary->Buckets[i] == 0) continue;
+        const char* ptr = reinterpret_cast<const char*>(dictionary) + dictionary->Buckets[i];
+        for (auto tuple = reinterpret_cast<const SerialTuple*>(ptr); tuple->Length;
+             tuple = reinterpret_cast<const SerialTuple*>(ptr += tuple->Length)) {
+            assert(summaries.MayContain(0, TermSummary::Hash(tuple->Key)));
+            ++terms;
+        }
+    }
+
+    // false positives, on random terms the chunk lacks
+    std::mt19937_64 random(42);
+    size_t absent = 0, found = 0;
+    while (absent < probes) {
+        std::string term = "~" + std::to_string(random());
+        if (dictionary->Find(term.c_str())) continue;
+        ++absent;
+        found += summaries.MayContain(0, TermSummary::Hash(term.c_str()));
+    }
+
+    // the summary written beside the chunk, if any, matches one built from it
+    TermSummary read;
+    if (read.Read(TermSummary::FileName(argv[1]))) {
+        assert(read.hashes == built.hashes && read.blocks == built.blocks);
+        std::printf("%s matches the chunk\n", TermSummary::FileName(argv[1]).c_str());
+    }
+
+    std::printf("%zu terms in %zu bytes (%.1f bits a term), %u hashes\n", terms, summaries.Bytes(),
+                8.0 * summaries.Bytes() / terms, built.hashes);
+    std::printf("false positive rate %.4f (target %.4f)\n", double(found) / absent, INDEX_TERM_SUMMARY_FP_RATE);
+    return 0;
+}
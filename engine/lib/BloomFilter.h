@@ -4,9 +4,15 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <vector>
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <string>
+#include <string_view>
 #include <string.h>
+#include <sys/stat.h>
 #include <openssl/md5.h>
 
 #include "dynamic_bitset.h"
@@ -133,4 +139,329 @@ public:
     }
 };
 
+/*
+    A blocked Bloom filter: every key sets and tests its k bits inside one 512-bit, cache-line-aligned block, so a
+    lookup touches one cache line instead of k random ones. One 64-bit hash picks the block and the bits, nothing is
+    allocated per call, and the test is a mask compare over the block's eight words that the compiler vectorizes.
+
+    Keeping the bits of a key together costs some false positives at a given size; the bench in
+    testing/bench_bloom.cpp measures both filters.
+
+    Every method is safe to call from any number of threads without a lock: bits are only ever set, with an atomic
+    fetch_or per word, and read with atomic loads. test_and_insert sets a key's bits and reports whether they were all
+    set already. Two threads racing to insert the same new key may both be told it was new, never that it was seen.
+    save() copies the words while inserts go on, so the file holds every key inserted before the save began and
+    perhaps some inserted during it.
+
+    A filter opened with a filename, a size and a rate lives in that file through a shared mapping (see
+    Dynamic_Bitset::map_file): inserts land in the page cache, sync() writes back only the blocks changed since the
+    last sync, and reopening the file after a restart reads nothing up front.
+
+    File format, the same for mapped files and saved copies, integers in host byte order:
+        u32 BLOCKED_BLOOM_MAGIC | u32 version | u64 number of blocks | u64 number of hashes, padded to HEADER_BYTES
+        | blocks
+    A file without the magic and version, such as one saved by Bloomfilter, is not loaded; see loaded().
+*/
+class Blocked_Bloomfilter
+{
+    using Bitset = Dynamic_Bitset;
+
+public:
+    static constexpr uint32_t BLOCKED_BLOOM_MAGIC = 0x46424c42;     // "BLBF"
+    static constexpr uint32_t VERSION = 2;
+    static constexpr size_t HEADER_BYTES = 1 << 16;                 // a whole number of pages on any machine
+    static constexpr size_t BLOCK_BITS = 512;
+    static constexpr size_t BLOCK_WORDS = BLOCK_BITS / 64;
+    static constexpr size_t MAX_HASHES = 16;
+
+private:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t num_blocks;
+        uint64_t num_hashes;
+    };
+
+    size_t num_blocks;
+    size_t num_hashes;
+    Bitset data;
+    uint64_t* blocks;       // data's num_blocks * BLOCK_WORDS words, 64-byte aligned
+
+    static inline uint64_t load64(const char* p) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    /* 64x64 -> 128-bit multiply, folded */
+    static inline uint64_t mum(uint64_t a, uint64_t b) {
+        __uint128_t r = static_cast<__uint128_t>(a) * b;
+        return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+    }
+
+    static inline uint64_t mix64(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static void geometry(size_t num_objects, double false_positive_rate, size_t& num_blocks, size_t& num_hashes) {
+        /* blocks fill unevenly, so size for a somewhat lower rate to meet the requested one */
+        double m = -1 * (num_objects * std::log(false_positive_rate * 0.8) / (std::log(2) * std::log(2)));
+
+        num_blocks = std::max<size_t>(1, static_cast<size_t>(std::ceil(m / BLOCK_BITS)));
+        num_hashes = std::clamp<size_t>(static_cast<size_t>(std::round(m / num_objects * std::log(2))), 1, MAX_HASHES);
+    }
+
+    static bool read_header(int fd, Header& header) {
+        return pread(fd, &header, sizeof(header), 0) == sizeof(header) && header.magic == BLOCKED_BLOOM_MAGIC
+               && header.version == VERSION && header.num_blocks && header.num_hashes
+               && header.num_hashes <= MAX_HASHES;
+    }
+
+    void clear() {
+        num_blocks = num_hashes = 0;
+        data = Bitset();
+        blocks = nullptr;
+    }
+
+    /**
+     * @brief computes the block for h and the mask of the key's bits within it
+     */
+    inline uint64_t* locate(uint64_t h, uint64_t (&mask)[BLOCK_WORDS]) const {
+        uint64_t* block = blocks + static_cast<size_t>((static_cast<__uint128_t>(h) * num_blocks) >> 64) * BLOCK_WORDS;
+
+        for (size_t w = 0; w < BLOCK_WORDS; ++w)
+            mask[w] = 0;
+
+        /* 9 bits per probe, 7 probes per mix of the hash */
+        uint64_t bits = mix64(h);
+        for (size_t i = 0, used = 0; i < num_hashes; ++i, used += 9) {
+            if (used + 9 > 64) {
+                bits = mix64(bits + h);
+                used = 0;
+            }
+            size_t bit = (bits >> used) & (BLOCK_BITS - 1);
+            mask[bit / 64] |= uint64_t(1) << (bit % 64);
+        }
+        return block;
+    }
+
+public:
+
+    /**
+     * @brief a wyhash-style 64-bit hash, 16 bytes per step
+     */
+    static uint64_t hash(const char* p, size_t n) {
+        constexpr uint64_t s0 = 0xa0761d6478bd642fULL, s1 = 0xe7037ed1a0b428dbULL, s2 = 0x8ebc6af09c88c6e3ULL;
+        uint64_t h = s0 ^ mum(n ^ s1, s2);
+        const size_t length = n;
+
+        for (; n >= 16; p += 16, n -= 16)
+            h = mum(load64(p) ^ s1, load64(p + 8) ^ h);
+        if (n >= 8) {
+            h = mum(load64(p) ^ s1, h ^ s2);
+            p += 8;
+            n -= 8;
+        }
+        if (n) {
+            uint64_t tail = 0;
+            memcpy(&tail, p, n);
+            h = mum(tail ^ s2, h ^ s1);
+        }
+        return mum(h ^ s0, length ^ s1);
+    }
+
+    /**
+     * @brief an empty filter in memory
+     */
+    Blocked_Bloomfilter(size_t num_objects, double false_positive_rate) {
+        geometry(num_objects, false_positive_rate, num_blocks, num_hashes);
+        data = Bitset(num_blocks * BLOCK_BITS);
+        blocks = data.words();
+    }
+
+    /**
+     * @brief a copy in memory of a file written by save() or mapped by the constructor below
+     */
+    Blocked_Bloomfilter(const char* filename) : num_blocks(0), num_hashes(0), data(), blocks(nullptr) {
+        auto filter_fd = open(filename, O_RDONLY);
+        if (filter_fd == -1) {
+            return;
+        }
+
+        Header header;
+        if (read_header(filter_fd, header)) {
+            num_blocks = header.num_blocks;
+            num_hashes = header.num_hashes;
+            data = Bitset(num_blocks * BLOCK_BITS);
+            blocks = data.words();
+
+            size_t bytes = num_blocks * BLOCK_WORDS * sizeof(uint64_t);
+            if (pread(filter_fd, blocks, bytes, HEADER_BYTES) != static_cast<ssize_t>(bytes))
+                clear();
+        }
+
+        close(filter_fd);
+    }
+
+    /**
+     * @brief the filter mapped from filename, created empty for num_objects at false_positive_rate if the file
+     *        does not exist or is empty; an existing filter keeps its own size
+     */
+    Blocked_Bloomfilter(const char* filename, size_t num_objects, double false_positive_rate)
+        : num_blocks(0), num_hashes(0), data(), blocks(nullptr) {
+        auto filter_fd = open(filename, O_RDONLY);
+        struct stat file_stat;
+        bool existing = filter_fd != -1 && fstat(filter_fd, &file_stat) == 0 && file_stat.st_size > 0;
+
+        Header header;
+        if (existing && !read_header(filter_fd, header)) {
+            close(filter_fd);
+            return;
+        }
+        if (filter_fd != -1) {
+            close(filter_fd);
+        }
+
+        if (existing) {
+            num_blocks = header.num_blocks;
+            num_hashes = header.num_hashes;
+        } else {
+            geometry(num_objects, false_positive_rate, num_blocks, num_hashes);
+            header = Header{BLOCKED_BLOOM_MAGIC, VERSION, num_blocks, num_hashes};
+        }
+
+        data = Bitset::map_file(filename, HEADER_BYTES, num_blocks * BLOCK_BITS);
+        if (!data.is_mapped()) {
+            clear();
+            return;
+        }
+        blocks = data.words();
+
+        if (!existing) {
+            memcpy(data.mapped_file(), &header, sizeof(header));
+            data.sync();
+        }
+    }
+
+    Blocked_Bloomfilter(const Blocked_Bloomfilter&) = delete;
+    Blocked_Bloomfilter& operator=(const Blocked_Bloomfilter&) = delete;
+
+    Blocked_Bloomfilter(Blocked_Bloomfilter&& other)
+        : num_blocks(other.num_blocks), num_hashes(other.num_hashes), data(std::move(other.data)),
+          blocks(other.blocks) {
+        other.clear();
+    }
+
+    Blocked_Bloomfilter& operator=(Blocked_Bloomfilter&& other) {
+        if (this == &other)
+            return *this;
+
+        num_blocks = other.num_blocks;
+        num_hashes = other.num_hashes;
+        data = std::move(other.data);
+        blocks = other.blocks;
+        other.clear();
+        return *this;
+    }
+
+    /**
+     * @brief whether the filter has bits, i.e. the constructor could read or map its file
+     */
+    bool loaded() const {
+        return blocks != nullptr;
+    }
+
+    bool is_mapped() const {
+        return data.is_mapped();
+    }
+
+    size_t size_in_bits() const {
+        return num_blocks * BLOCK_BITS;
+    }
+
+    size_t hashes() const {
+        return num_hashes;
+    }
+
+    void insert(std::string_view s) {
+        test_and_insert(s);
+    }
+
+    bool contains(std::string_view s) const {
+        uint64_t mask[BLOCK_WORDS];
+        const uint64_t* block = locate(hash(s.data(), s.size()), mask);
+
+        uint64_t missing = 0;
+        for (size_t w = 0; w < BLOCK_WORDS; ++w)
+            missing |= mask[w] & ~__atomic_load_n(&block[w], __ATOMIC_RELAXED);
+        return !missing;
+    }
+
+    /**
+     * @brief inserts s
+     * @return whether s was (probably) in the filter already
+     */
+    bool test_and_insert(std::string_view s) {
+        uint64_t mask[BLOCK_WORDS];
+        uint64_t* block = locate(hash(s.data(), s.size()), mask);
+
+        uint64_t missing = 0;
+        for (size_t w = 0; w < BLOCK_WORDS; ++w) {
+            /* a word that has the bits already needs no locked write, which keeps repeat keys cheap */
+            if ((__atomic_load_n(&block[w], __ATOMIC_RELAXED) & mask[w]) != mask[w])
+                missing |= mask[w] & ~__atomic_fetch_or(&block[w], mask[w], __ATOMIC_RELAXED);
+        }
+
+        if (missing)
+            data.mark_dirty((block - blocks) * sizeof(uint64_t));
+        return !missing;
+    }
+
+    /**
+     * @brief writes the blocks changed since the last sync back to a mapped filter's file; inserts go on meanwhile
+     * @return the number of bytes written back
+     */
+    size_t sync() {
+        return data.sync();
+    }
+
+    /**
+     * @brief writes a copy of the filter to a temporary file and renames it over filename, so a crash mid-save
+     *        leaves the previous file intact; inserts go on meanwhile
+     */
+    void save(const char* filename) const {
+        std::string temporary = std::string(filename) + ".tmp";
+        auto filter_fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (filter_fd == -1) {
+            return;
+        }
+
+        std::vector<char> header(HEADER_BYTES);
+        Header fields{BLOCKED_BLOOM_MAGIC, VERSION, num_blocks, num_hashes};
+        memcpy(header.data(), &fields, sizeof(fields));
+        bool ok = write(filter_fd, header.data(), header.size()) == static_cast<ssize_t>(header.size());
+
+        /* copy out a chunk at a time, each word read atomically */
+        std::vector<uint64_t> chunk(std::min<size_t>(num_blocks * BLOCK_WORDS, 1 << 17));
+        for (size_t done = 0; ok && done < num_blocks * BLOCK_WORDS; done += chunk.size()) {
+            size_t count = std::min(chunk.size(), num_blocks * BLOCK_WORDS - done);
+            for (size_t i = 0; i < count; ++i)
+                chunk[i] = __atomic_load_n(&blocks[done + i], __ATOMIC_RELAXED);
+            ok = write(filter_fd, chunk.data(), count * sizeof(uint64_t)) == static_cast<ssize_t>(count * sizeof(uint64_t));
+        }
+
+        ok = fsync(filter_fd) == 0 && ok;
+        close(filter_fd);
+        if (ok)
+            rename(temporary.c_str(), filename);
+        else
+            unlink(temporary.c_str());
+    }
+};
+
 #endif
@@ -0,0 +1,303 @@
+#ifndef CLOCK_CACHE_H
+#define CLOCK_CACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mutex.h"
+
+/**
+ * @brief A concurrent, string-keyed cache split into independently locked shards; each shard evicts with the CLOCK
+ * (second chance) policy and is bounded both in entry count and in bytes
+ * @note Cost(const Value&) -> size_t reports the heap bytes owned by a value, on top of the key and slot overhead
+ * @warning Value must be default constructible and copy-assignable
+ */
+template <typename Value, typename Cost>
+class Sharded_Clock_Cache {
+private:
+
+    struct Slot {
+        std::string key;
+        Value value;
+        uint64_t hash = 0;
+        size_t bytes = 0;
+        bool occupied = false;
+        bool referenced = false;
+    };
+
+    /* index entries store slot + 1 so that 0 can mark an empty bucket */
+    static constexpr uint32_t EMPTY = 0;
+
+    struct alignas(64) Shard {
+        mutable Mutex lock;
+
+        std::vector<Slot> slots;
+        std::vector<uint32_t> index;
+        size_t hand = 0;
+        size_t count = 0;
+        size_t bytes = 0;
+    };
+
+    size_t num_shards;
+    size_t slots_per_shard;
+    size_t bytes_per_shard;
+    Shard* shards;
+    Cost cost;
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> evictions{0};
+
+    inline static size_t round_up_pow2(size_t n) {
+        size_t p = 1;
+        while (p < n)
+            p <<= 1;
+        return p;
+    }
+
+    inline static uint64_t hash_key(std::string_view key) {
+        return std::hash<std::string_view>{}(key);
+    }
+
+    inline Shard& shard_for(uint64_t hash) const {
+        return shards[(hash >> 32) % num_shards];
+    }
+
+    inline size_t bucket_of(const Shard& shard, uint64_t hash) const {
+        return hash & (shard.index.size() - 1);
+    }
+
+    /**
+     * @pre shard.lock is held
+     * @return the index bucket holding key, or the empty bucket where it would be inserted
+     */
+    size_t probe(const Shard& shard, std::string_view key, uint64_t hash) const {
+        size_t mask = shard.index.size() - 1;
+        size_t b = bucket_of(shard, hash);
+        while (shard.index[b] != EMPTY) {
+            const Slot& slot = shard.slots[shard.index[b] - 1];
+            if (slot.hash == hash && slot.key == key)
+                return b;
+            b = (b + 1) & mask;
+        }
+        return b;
+    }
+
+    /**
+     * @brief removes the index bucket b using backward shift deletion so probe chains stay intact
+     * @pre shard.lock is held
+     */
+    void unlink_bucket(Shard& shard, size_t b) {
+        size_t mask = shard.index.size() - 1;
+        size_t hole = b;
+        size_t next = (hole + 1) & mask;
+        while (shard.index[next] != EMPTY) {
+            size_t home = bucket_of(shard, shard.slots[shard.index[next] - 1].hash);
+            /* move next into the hole only if its home bucket is not in (hole, next] */
+            if (((next - home) & mask) >= ((next - hole) & mask)) {
+                shard.index[hole] = shard.index[next];
+                hole = next;
+            }
+            next = (next + 1) & mask;
+        }
+        shard.index[hole] = EMPTY;
+    }
+
+    /**
+     * @pre shard.lock is held and slot i is occupied
+     */
+    void evict_slot(Shard& shard, size_t i) {
+        Slot& slot = shard.slots[i];
+        unlink_bucket(shard, probe(shard, slot.key, slot.hash));
+        shard.bytes -= slot.bytes;
+        --shard.count;
+        slot.occupied = false;
+        slot.referenced = false;
+        slot.key.clear();
+        slot.key.shrink_to_fit();
+        slot.value = Value{};
+        evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief sweeps the clock hand until it rests on a free slot, giving referenced entries a second chance
+     * @pre shard.lock is held
+     */
+    size_t claim_slot(Shard& shard) {
+        while (true) {
+            Slot& slot = shard.slots[shard.hand];
+            size_t i = shard.hand;
+            shard.hand = (shard.hand + 1) % shard.slots.size();
+
+            if (!slot.occupied)
+                return i;
+
+            if (slot.referenced)
+                slot.referenced = false;
+            else {
+                evict_slot(shard, i);
+                return i;
+            }
+        }
+    }
+
+    /**
+     * @brief evicts entries in clock order until another `bytes` fit under the shard budget
+     * @pre shard.lock is held
+     */
+    void make_room(Shard& shard, size_t bytes) {
+        while (shard.count > 0 && shard.bytes + bytes > bytes_per_shard) {
+            Slot& slot = shard.slots[shard.hand];
+            size_t i = shard.hand;
+            shard.hand = (shard.hand + 1) % shard.slots.size();
+
+            if (!slot.occupied)
+                continue;
+
+            if (slot.referenced)
+                slot.referenced = false;
+            else
+                evict_slot(shard, i);
+        }
+    }
+
+public:
+
+    /**
+     * @param num_shards number of independently locked partitions
+     * @param max_entries upper bound on the number of cached keys across all shards
+     * @param max_bytes upper bound on the bytes held by keys, values and slots across all shards
+     */
+    Sharded_Clock_Cache(size_t num_shards, size_t max_entries, size_t max_bytes, Cost cost = Cost{}) :
+        num_shards{num_shards ? num_shards : 1},
+        slots_per_shard{max_entries / (num_shards ? num_shards : 1)},
+        bytes_per_shard{max_bytes / (num_shards ? num_shards : 1)},
+        shards{new Shard[num_shards ? num_shards : 1]},
+        cost{cost}
+    {
+        if (slots_per_shard == 0)
+            slots_per_shard = 1;
+
+        for (size_t i = 0; i < this->num_shards; ++i) {
+            shards[i].slots.resize(slots_per_shard);
+            shards[i].index.assign(round_up_pow2(2 * slots_per_shard), EMPTY);
+        }
+    }
+
+    ~Sharded_Clock_Cache() {
+        delete[] shards;
+    }
+
+    Sharded_Clock_Cache(const Sharded_Clock_Cache&) = delete;
+    Sharded_Clock_Cache& operator=(const Sharded_Clock_Cache&) = delete;
+
+    /**
+     * @brief copies the cached value for key into result and marks it recently used
+     * @return true on a hit
+     */
+    bool get(std::string_view key, Value& result) {
+        uint64_t hash = hash_key(key);
+        Shard& shard = shard_for(hash);
+
+        Lock_Guard<Mutex, &Mutex::lock> guard{shard.lock};
+
+        size_t b = probe(shard, key, hash);
+        if (shard.index[b] == EMPTY) {
+            guard.unlock();
+            misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        Slot& slot = shard.slots[shard.index[b] - 1];
+        slot.referenced = true;
+        result = slot.value;
+        guard.unlock();
+
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * @brief inserts or replaces the value for key, evicting in clock order to stay within the shard budgets
+     * @note values larger than a whole shard's byte budget are not cached
+     */
+    void put(std::string_view key, const Value& value) {
+        uint64_t hash = hash_key(key);
+        Shard& shard = shard_for(hash);
+        size_t bytes = sizeof(Slot) + key.size() + cost(value);
+
+        if (bytes > bytes_per_shard)
+            return;
+
+        Lock_Guard<Mutex, &Mutex::lock> guard{shard.lock};
+
+        size_t b = probe(shard, key, hash);
+        if (shard.index[b] != EMPTY) {
+            evict_slot(shard, shard.index[b] - 1);
+        }
+
+        make_room(shard, bytes);
+        size_t i = claim_slot(shard);
+
+        Slot& slot = shard.slots[i];
+        slot.key.assign(key.data(), key.size());
+        slot.value = value;
+        slot.hash = hash;
+        slot.bytes = bytes;
+        slot.occupied = true;
+        slot.referenced = false;
+
+        /* eviction may have shifted the index, so probe again for the insertion point */
+        shard.index[probe(shard, key, hash)] = static_cast<uint32_t>(i + 1);
+        shard.bytes += bytes;
+        ++shard.count;
+    }
+
+    /**
+     * @brief drops every entry; counters are preserved
+     */
+    void clear() {
+        for (size_t s = 0; s < num_shards; ++s) {
+            Shard& shard = shards[s];
+            Lock_Guard<Mutex, &Mutex::lock> guard{shard.lock};
+
+            for (auto& slot : shard.slots)
+                slot = Slot{};
+            std::fill(shard.index.begin(), shard.index.end(), EMPTY);
+            shard.hand = 0;
+            shard.count = 0;
+            shard.bytes = 0;
+        }
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (size_t s = 0; s < num_shards; ++s) {
+            Lock_Guard<Mutex, &Mutex::lock> guard{shards[s].lock};
+            total += shards[s].count;
+        }
+        return total;
+    }
+
+    size_t bytes() const {
+        size_t total = 0;
+        for (size_t s = 0; s < num_shards; ++s) {
+            Lock_Guard<Mutex, &Mutex::lock> guard{shards[s].lock};
+            total += shards[s].bytes;
+        }
+        return total;
+    }
+
+    uint64_t get_hits() const { return hits.load(std::memory_order_relaxed); }
+    uint64_t get_misses() const { return misses.load(std::memory_order_relaxed); }
+    uint64_t get_evictions() const { return evictions.load(std::memory_order_relaxed); }
+
+}; /* class Sharded_Clock_Cache<Value, Cost> */
+
+#endif /* CLOCK_CACHE_H */
@@ -1,13 +1,14 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 
 // Thread Count Constants
 constexpr const int NUM_CRAWL_THREADS = 256;
 constexpr const int NUM_FRONTIER_TALK_THREADS = 64;
-constexpr const int NUM_PARSER_TALK_THREADS = 64;
-constexpr const int NUM_PARSE_THREADS = 256;
-constexpr const int NUM_SEND_THREADS = 64;
+constexpr const int NUM_PARSER_REACTORS = 0;        // 0: one per core; they parse as they read
+constexpr const int NUM_PARSE_WORKERS = 0;          // 0: one per core
+constexpr const int NUM_SEND_THREADS_PER_CRAWLER = 2;
 constexpr const int NUM_INDEX_SAVE_THREADS = 4;
 
 // Save Times
@@ -16,15 +17,45 @@ constexpr const int PARSER_SAVE_TIME = 60;
 
 // Parser Constants
 constexpr const int PARSER_PORT = 1024;
+constexpr const int PARSER_METRICS_PORT = 1026;      // Prometheus text on 127.0.0.1
+constexpr const int PARSER_LISTEN_BACKLOG = 4096;
+constexpr const int PARSER_REACTOR_EVENTS = 256;
+constexpr const int PARSER_IDLE_TIMEOUT = 120;
+constexpr const size_t PARSER_MAX_URL_SIZE = 1 << 16;
+constexpr const size_t PARSER_MAX_PAGE_SIZE = 1 << 26;
+constexpr const uint32_t PARSER_STREAM_CREDITS = 64;
+constexpr const int PARSER_PARSE_BUDGET_MS = 1000;
+constexpr const size_t PARSER_PARSE_MAX_BYTES = 1 << 23;    // of a page parsed; the rest is read and dropped
+constexpr const size_t PARSER_RECV_CHUNK = 1 << 16;         // bytes of a page body read, then parsed, at a time
+constexpr const size_t PARSER_LINK_SEND_BYTES = 1 << 16;
+constexpr const int PARSER_LINK_WAIT_MS = 100;              // for room in a connected crawler's full link queue
 constexpr const int BLOOM_FRONTIER_SIZE = 200000000;
 constexpr const double FRONTIER_FP_RATE = 0.02;
 
 constexpr const char* INDEX_CHUNK_NAME = "index_chunk";
 constexpr const char* PARSER_FILTER_FILE = "parser_filter.bin";
 constexpr const char* PARSER_PEERS_FILE = "parser_peers.txt";
+constexpr const char* PARSER_LOG_FILE = "parser_log";          // segments are parser_log.<n>
+constexpr const bool PARSER_DUMP_PAGES = false;                // record as if started with "html_parser record"
+constexpr const char* PARSER_DUMP_FILE = "page_dump";           // page_dump.<start time>.<reactor>.<n>
+constexpr const size_t PARSER_DUMP_FILE_BYTES = 1 << 30;
 
 constexpr const int MAX_FRONTIER_SIZE = 500000;
+// An index chunk is cut at whichever of these it reaches first.
 constexpr const int MIN_PAGES_PER_CHUNK = 5000;
+constexpr const size_t INDEX_CHUNK_MAX_BYTES = 256 << 20;     // of the chunk in memory, before it is written
+constexpr const int INDEX_CHUNK_MAX_AGE = 300;                // seconds since its first page
+constexpr const double INDEX_TERM_SUMMARY_FP_RATE = 0.01;     // of a chunk's term summary; see indexer/TermSummary.hpp
+
+// Parser Queue Constants (each is rounded up to a power of two)
+constexpr const size_t PARSER_PARSE_QUEUE_SIZE = 2048;         // pages waiting for a parse worker
+constexpr const size_t PARSER_PARSED_QUEUE_SIZE = 2048;
+constexpr const size_t PARSER_SAVE_QUEUE_SIZE = NUM_INDEX_SAVE_THREADS;
+constexpr const size_t PARSER_LINK_QUEUE_SIZE = 4096;         // batches of links, one per page and crawler
+constexpr const size_t PARSER_LOG_QUEUE_SIZE = 2048;          // parsed pages waiting to be logged
+constexpr const size_t PARSER_LOG_BATCH = 256;                // most pages committed to the log with one fdatasync
+constexpr const size_t PARSER_LOG_SEGMENT_BYTES = 64 << 20;
+constexpr const int PARSER_LOG_DEFLATE_LEVEL = 1;             // 0 stores pages as they are, for less parse cpu
 
 // Frontier Constants
 constexpr const int FRONTIER_N = 50000;
@@ -39,6 +70,15 @@ constexpr const int FRONTIER_PORT = 1025;
 // Crawler Constants
 constexpr const char* CRAWLER_PEERS_FILE = "crawler_peers.txt";
 
+// Stem Cache Constants
+constexpr const size_t STEM_CACHE_SHARDS = 64;
+constexpr const size_t STEM_CACHE_ENTRIES = 1 << 20;
+constexpr const size_t STEM_CACHE_BYTES = 128 << 20;
+constexpr const size_t STEM_TABLE_ENTRIES = 100000;
+constexpr const size_t STEM_BUFFER_SIZE = 256;
+
+constexpr const char* STEM_TABLE_FILE = "stem_table.bin";
+
 // IOStream Constants
 constexpr const size_t COUT_BUFFER_SIZE = 2048;
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <pthread.h>
+#include <ctime>
 #include "mutex.h"
 
 class CV {
@@ -13,6 +14,11 @@ public:
         pthread_cond_wait(&_cv, &mutex._mutex);
     }
 
+    // Returns false if deadline, on CLOCK_REALTIME, passed first.
+    inline bool wait_until(Mutex& mutex, const timespec& deadline) {
+        return pthread_cond_timedwait(&_cv, &mutex._mutex, &deadline) == 0;
+    }
+
     inline void broadcast() {
         pthread_cond_broadcast(&_cv);
     }
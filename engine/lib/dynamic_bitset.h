@@ -5,13 +5,71 @@
 #include <cstddef>
 #include <cstring>
 #include <cassert>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+/*
+    A bitset in heap memory, or mapped from a file with map_file().
+
+    A mapped bitset lives in the page cache: every set goes straight to the file's pages, the kernel writes them back
+    on its own schedule, and reopening the file costs nothing until the bits are touched. sync() forces out only the
+    ranges written since the last sync, tracked per DIRTY_CHUNK bytes.
+
+    Heap storage is 64-byte aligned, so callers can lay cache-line-sized blocks over words().
+*/
 class Dynamic_Bitset {
+public:
+
+    static constexpr size_t ALIGNMENT = 64;
+    static constexpr size_t DIRTY_CHUNK = 1 << 16;
+
 private:
 
     size_t size;
     uint8_t* data;
+    bool owned = false;             // data was allocated here; a mapped bitset's data points into the mapping
+
+    /* set when mapped */
+    uint8_t* mapping = nullptr;
+    size_t mapping_length = 0;
+    uint8_t* dirty = nullptr;       // one flag per DIRTY_CHUNK bytes of data
+
+    inline static uint8_t* allocate(size_t bytes) {
+        return new (std::align_val_t(ALIGNMENT)) uint8_t[bytes ? bytes : 1];
+    }
+
+    inline static void release(uint8_t* p) {
+        if (p)
+            ::operator delete[](p, std::align_val_t(ALIGNMENT));
+    }
+
+    inline size_t num_bytes() const {
+        return min_multiple_of_8_geq_than(size) >> 3;
+    }
+
+    inline size_t num_chunks() const {
+        return (num_bytes() + DIRTY_CHUNK - 1) / DIRTY_CHUNK;
+    }
+
+    void unmap() {
+        if (mapping) {
+            sync();
+            munmap(mapping, mapping_length);
+            delete[] dirty;
+            mapping = nullptr;
+            mapping_length = 0;
+            dirty = nullptr;
+            data = nullptr;
+        } else {
+            if (owned)
+                release(data);
+            data = nullptr;
+            owned = false;
+        }
+    }
 
     inline constexpr static size_t min_multiple_of_8_geq_than(size_t n) {
         return (n + 7) & ~7;
@@ -34,34 +92,46 @@ public:
      */
     Dynamic_Bitset(size_t size) :
         size{size},
-        data{new uint8_t[min_multiple_of_8_geq_than(size) >> 3]}
+        data{allocate(min_multiple_of_8_geq_than(size) >> 3)},
+        owned{true}
     {
         for(size_t i = 0; i < min_multiple_of_8_geq_than(size) >> 3; ++i)
             data[i] = 0;
     }
 
+    /* a copy always lives on the heap */
     Dynamic_Bitset(const Dynamic_Bitset& other) :
         size{other.size},
-        data{new uint8_t[min_multiple_of_8_geq_than(size) >> 3]}
+        data{allocate(min_multiple_of_8_geq_than(size) >> 3)},
+        owned{true}
     {
         memcpy(data, other.data, min_multiple_of_8_geq_than(size) >> 3);
     }
 
     Dynamic_Bitset(Dynamic_Bitset&& other) :
         size{other.size},
-        data{other.data}
+        data{other.data},
+        owned{other.owned},
+        mapping{other.mapping},
+        mapping_length{other.mapping_length},
+        dirty{other.dirty}
     {
         other.size = 0;
         other.data = nullptr;
+        other.owned = false;
+        other.mapping = nullptr;
+        other.mapping_length = 0;
+        other.dirty = nullptr;
     }
 
     Dynamic_Bitset& operator=(const Dynamic_Bitset& other) {
         if(this == &other)
             return *this;
 
+        unmap();
         size = other.size;
-        delete[] data;
-        data = new uint8_t[min_multiple_of_8_geq_than(size) >> 3];
+        data = allocate(min_multiple_of_8_geq_than(size) >> 3);
+        owned = true;
         memcpy(data, other.data, min_multiple_of_8_geq_than(size) >> 3);
 
         return *this;
@@ -71,17 +141,121 @@ public:
         if(this == &other)
             return *this;
 
+        unmap();
         size = other.size;
-        delete[] data;
         data = other.data;
+        owned = other.owned;
+        mapping = other.mapping;
+        mapping_length = other.mapping_length;
+        dirty = other.dirty;
         other.size = 0;
         other.data = nullptr;
+        other.owned = false;
+        other.mapping = nullptr;
+        other.mapping_length = 0;
+        other.dirty = nullptr;
 
         return *this;
     }
 
     ~Dynamic_Bitset() {
-        delete[] data;
+        unmap();
+    }
+
+    /**
+     * @brief Maps size bits of a file, starting offset bytes in, creating the file or extending it with zeros as
+     *        needed. The bits before offset are the caller's, e.g. for a header; see mapped_file().
+     * @param offset A multiple of the page size.
+     * @return The bitset, or an empty one if the file could not be mapped.
+     */
+    static Dynamic_Bitset map_file(const char* filename, size_t offset, size_t size) {
+        assert(offset % sysconf(_SC_PAGESIZE) == 0);
+
+        Dynamic_Bitset bitset;
+        int fd = open(filename, O_RDWR | O_CREAT, 0644);
+        if (fd == -1)
+            return bitset;
+
+        size_t length = offset + (min_multiple_of_8_geq_than(size) >> 3);
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) == -1
+            || (static_cast<size_t>(file_stat.st_size) < length && ftruncate(fd, length) == -1)) {
+            close(fd);
+            return bitset;
+        }
+
+        void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED)
+            return bitset;
+
+        bitset.size = size;
+        bitset.mapping = static_cast<uint8_t*>(mapping);
+        bitset.mapping_length = length;
+        bitset.data = bitset.mapping + offset;
+        bitset.dirty = new uint8_t[bitset.num_chunks() ? bitset.num_chunks() : 1]();
+        return bitset;
+    }
+
+    bool is_mapped() const {
+        return mapping != nullptr;
+    }
+
+    /**
+     * @brief The start of a mapped file, where its header goes, or nullptr if the bitset is on the heap.
+     */
+    uint8_t* mapped_file() const {
+        return mapping;
+    }
+
+    /**
+     * @brief Notes a write made through words() to the byte at byte_index; set_bit_* note their own.
+     */
+    inline void mark_dirty(size_t byte_index) {
+        if (dirty) {
+            uint8_t* flag = &dirty[byte_index / DIRTY_CHUNK];
+            if (!__atomic_load_n(flag, __ATOMIC_RELAXED))
+                __atomic_store_n(flag, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    /**
+     * @brief Writes the header and the chunks changed since the last sync back to a mapped file. Does nothing for
+     *        a heap bitset. Safe to call while other threads set bits.
+     * @return The number of bytes synced.
+     */
+    size_t sync() {
+        if (!mapping)
+            return 0;
+
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t synced = data - mapping;
+        if (synced)
+            msync(mapping, synced, MS_SYNC);
+        for (size_t chunk = 0; chunk < num_chunks(); ++chunk) {
+            if (!__atomic_exchange_n(&dirty[chunk], 0, __ATOMIC_RELAXED))
+                continue;
+
+            /* the chunk boundaries are page aligned within data, which is page aligned within the mapping */
+            size_t begin = chunk * DIRTY_CHUNK;
+            size_t end = begin + DIRTY_CHUNK < num_bytes() ? begin + DIRTY_CHUNK : num_bytes();
+            uint8_t* first = data + begin;
+            size_t length = (end - begin + page - 1) / page * page;
+            if (first + length > mapping + mapping_length)
+                length = mapping + mapping_length - first;
+
+            msync(first, length, MS_SYNC);
+            synced += length;
+        }
+
+        return synced;
+    }
+
+    /**
+     * @brief The bits as 64-bit words, least significant bit first on little-endian machines.
+     */
+    uint64_t* words() const {
+        return reinterpret_cast<uint64_t*>(data);
     }
 
     size_t get_size() const {
@@ -89,10 +263,15 @@ public:
     }
 
     void resize(size_t size_new) {
-        uint8_t* data_new = new uint8_t[min_multiple_of_8_geq_than(size_new) >> 3];
-        memcpy(data_new, data, min_multiple_of_8_geq_than(size) >> 3);
-        delete[] data;
+        assert(!mapping);
+
+        uint8_t* data_new = allocate(min_multiple_of_8_geq_than(size_new) >> 3);
+        if (data)
+            memcpy(data_new, data, min_multiple_of_8_geq_than(size) >> 3);
+        if (owned)
+            release(data);
         data = data_new;
+        owned = true;
         size = size_new;
     }
 
@@ -116,6 +295,7 @@ public:
         size_t segment = segment_bit >> 3;
 
         data[segment] |= (1 << offset);
+        mark_dirty(segment);
     }
 
     void set_bit_false(size_t idx) {
@@ -127,6 +307,7 @@ public:
         size_t segment = segment_bit >> 3;
 
         data[segment] &= ~(1 << offset);
+        mark_dirty(segment);
     }
     
     /**
@@ -142,13 +323,15 @@ public:
         size_t segment = segment_bit >> 3;
 
         data[segment] ^= (1 << offset);
+        mark_dirty(segment);
         return data[segment] & (1 << offset);
     }
 
     void read_from_file(int fd) {
+        unmap();
         read(fd, &size, sizeof(size));
-        delete[] data;
-        data = new uint8_t[min_multiple_of_8_geq_than(size) >> 3];
+        data = allocate(min_multiple_of_8_geq_than(size) >> 3);
+        owned = true;
         read(fd, data, min_multiple_of_8_geq_than(size) >> 3);
     }
 
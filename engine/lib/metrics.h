@@ -0,0 +1,421 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "mutex.h"
+
+/*
+    Counters, gauges and latency histograms for a long-running process, rendered in the Prometheus text format and
+    served over HTTP by start_metrics_server().
+
+    Hot paths only ever do relaxed atomic adds, and each thread adds into its own shard (picked once per thread), so
+    threads updating the same metric do not share a cache line. Shards are summed only when the metrics are rendered.
+    Gauges are sampled by a callback at render time, so they cost nothing in between.
+*/
+
+constexpr size_t METRIC_SHARDS = 16;
+
+inline size_t metric_shard() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t shard = next.fetch_add(1, std::memory_order_relaxed) % METRIC_SHARDS;
+    return shard;
+}
+
+/**
+ * @brief a monotonically increasing count, rendered multiplied by scale (e.g. 1e-9 to count nanoseconds and show
+ * seconds)
+ */
+class Metric_Counter {
+private:
+
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value{0};
+    };
+
+    Shard shards[METRIC_SHARDS];
+
+public:
+
+    const double scale;
+
+    explicit Metric_Counter(double scale = 1) : scale(scale) {}
+
+    inline void add(uint64_t n = 1) {
+        shards[metric_shard()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    inline Metric_Counter& operator++() {
+        add(1);
+        return *this;
+    }
+
+    inline Metric_Counter& operator+=(uint64_t n) {
+        add(n);
+        return *this;
+    }
+
+    uint64_t value() const {
+        uint64_t sum = 0;
+        for (const auto& shard : shards)
+            sum += shard.value.load(std::memory_order_relaxed);
+        return sum;
+    }
+};
+
+/**
+ * @brief a log-linear histogram in the style of HdrHistogram: exact below 16, then 8 buckets per power of two, so any
+ * value is off by at most 12.5%, from nanoseconds to centuries in 496 buckets
+ */
+class Metric_Histogram {
+public:
+
+    static constexpr size_t SUB_BITS = 3;
+    static constexpr size_t SUB_BUCKETS = 1 << SUB_BITS;
+    static constexpr size_t LINEAR = 2 * SUB_BUCKETS;
+    static constexpr size_t NUM_BUCKETS = LINEAR + (64 - SUB_BITS - 1) * SUB_BUCKETS;
+
+private:
+
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> buckets[NUM_BUCKETS];
+        std::atomic<uint64_t> sum{0};
+
+        Shard() {
+            for (auto& bucket : buckets)
+                bucket.store(0, std::memory_order_relaxed);
+        }
+    };
+
+    std::unique_ptr<Shard[]> shards{new Shard[METRIC_SHARDS]};
+
+public:
+
+    const double scale;
+
+    explicit Metric_Histogram(double scale = 1) : scale(scale) {}
+
+    inline static size_t bucket_of(uint64_t value) {
+        if (value < LINEAR)
+            return value;
+        size_t exponent = 63 - __builtin_clzll(value);
+        size_t sub = (value >> (exponent - SUB_BITS)) & (SUB_BUCKETS - 1);
+        return LINEAR + (exponent - SUB_BITS - 1) * SUB_BUCKETS + sub;
+    }
+
+    /**
+     * @brief the largest value that falls in bucket
+     */
+    inline static uint64_t bucket_limit(size_t bucket) {
+        if (bucket < LINEAR)
+            return bucket;
+        size_t exponent = (bucket - LINEAR) / SUB_BUCKETS + SUB_BITS + 1;
+        size_t sub = (bucket - LINEAR) % SUB_BUCKETS;
+        uint64_t lower = (SUB_BUCKETS + sub) << (exponent - SUB_BITS);
+        return lower + ((uint64_t(1) << (exponent - SUB_BITS)) - 1);
+    }
+
+    inline void record(uint64_t value) {
+        Shard& shard = shards[metric_shard()];
+        shard.buckets[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    struct Snapshot {
+        std::vector<uint64_t> buckets;
+        uint64_t count = 0;
+        uint64_t sum = 0;
+
+        /**
+         * @brief the value at quantile q in [0, 1], to within the bucket's precision; 0 if nothing was recorded
+         */
+        uint64_t quantile(double q) const {
+            if (!count)
+                return 0;
+            uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * count + 0.5));
+            uint64_t seen = 0;
+            for (size_t b = 0; b < buckets.size(); ++b) {
+                seen += buckets[b];
+                if (seen >= rank)
+                    return bucket_limit(b);
+            }
+            return bucket_limit(buckets.size() - 1);
+        }
+    };
+
+    Snapshot snapshot() const {
+        Snapshot snapshot;
+        snapshot.buckets.assign(NUM_BUCKETS, 0);
+        for (size_t s = 0; s < METRIC_SHARDS; ++s) {
+            for (size_t b = 0; b < NUM_BUCKETS; ++b)
+                snapshot.buckets[b] += shards[s].buckets[b].load(std::memory_order_relaxed);
+            snapshot.sum += shards[s].sum.load(std::memory_order_relaxed);
+        }
+        for (uint64_t n : snapshot.buckets)
+            snapshot.count += n;
+        return snapshot;
+    }
+};
+
+/**
+ * @brief times a scope into a histogram of nanoseconds, and optionally adds the time to a busy counter
+ */
+class Metric_Timer {
+private:
+
+    Metric_Histogram* histogram;
+    Metric_Counter* busy;
+    timespec begin;
+
+public:
+
+    /**
+     * @brief the monotonic clock in nanoseconds, for spans that do not fit a scope
+     */
+    inline static uint64_t now_ns() {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    inline Metric_Timer(Metric_Histogram* histogram, Metric_Counter* busy = nullptr)
+        : histogram(histogram), busy(busy) {
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+    }
+
+    inline uint64_t elapsed_ns() const {
+        return now_ns() - (static_cast<uint64_t>(begin.tv_sec) * 1000000000 + begin.tv_nsec);
+    }
+
+    inline ~Metric_Timer() {
+        uint64_t elapsed = elapsed_ns();
+        if (histogram)
+            histogram->record(elapsed);
+        if (busy)
+            busy->add(elapsed);
+    }
+};
+
+/**
+ * @brief every metric of the process, by name; names may carry Prometheus labels, as in
+ * parser_thread_busy_seconds_total{thread="reactor-0"}
+ * @note registering takes a lock and is meant for startup; the metrics themselves live as long as the process
+ */
+class Metrics {
+private:
+
+    enum class Kind { Counter, Gauge, CounterFunction, Histogram };
+
+    struct Entry {
+        std::string name;
+        std::string help;
+        Kind kind;
+        std::unique_ptr<Metric_Counter> counter;
+        std::unique_ptr<Metric_Histogram> histogram;
+        std::function<double()> sample;
+    };
+
+    Mutex mutex;
+    std::vector<std::unique_ptr<Entry>> entries;
+
+    Metrics() = default;
+
+    Entry& add(const std::string& name, const std::string& help, Kind kind) {
+        entries.push_back(std::make_unique<Entry>());
+        Entry& entry = *entries.back();
+        entry.name = name;
+        entry.help = help;
+        entry.kind = kind;
+        return entry;
+    }
+
+    static std::string family(const std::string& name) {
+        return name.substr(0, name.find('{'));
+    }
+
+    /**
+     * @brief name with one more label, e.g. name{thread="x"} + quantile="0.5"
+     */
+    static std::string with_label(const std::string& name, const std::string& label) {
+        size_t brace = name.find('{');
+        if (brace == std::string::npos)
+            return name + "{" + label + "}";
+        return name.substr(0, name.size() - 1) + "," + label + "}";
+    }
+
+    static std::string with_suffix(const std::string& name, const char* suffix) {
+        size_t brace = name.find('{');
+        return brace == std::string::npos ? name + suffix : name.substr(0, brace) + suffix + name.substr(brace);
+    }
+
+    static void append_sample(std::string& out, const std::string& name, double value) {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), " %.9g\n", value);
+        out += name;
+        out += buffer;
+    }
+
+public:
+
+    static Metrics& get_instance() {
+        static Metrics instance;
+        return instance;
+    }
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    Metric_Counter& counter(const std::string& name, const std::string& help, double scale = 1) {
+        Lock_Guard<Mutex, &Mutex::lock> guard(mutex);
+        Entry& entry = add(name, help, Kind::Counter);
+        entry.counter = std::make_unique<Metric_Counter>(scale);
+        return *entry.counter;
+    }
+
+    /**
+     * @brief a histogram, rendered as a summary: quantiles, sum and count, each multiplied by scale
+     */
+    Metric_Histogram& histogram(const std::string& name, const std::string& help, double scale = 1) {
+        Lock_Guard<Mutex, &Mutex::lock> guard(mutex);
+        Entry& entry = add(name, help, Kind::Histogram);
+        entry.histogram = std::make_unique<Metric_Histogram>(scale);
+        return *entry.histogram;
+    }
+
+    /**
+     * @brief a value sampled when the metrics are rendered, such as a queue depth
+     */
+    void gauge(const std::string& name, const std::string& help, std::function<double()> sample) {
+        Lock_Guard<Mutex, &Mutex::lock> guard(mutex);
+        add(name, help, Kind::Gauge).sample = std::move(sample);
+    }
+
+    /**
+     * @brief a count kept elsewhere, sampled when the metrics are rendered
+     */
+    void counter_function(const std::string& name, const std::string& help, std::function<double()> sample) {
+        Lock_Guard<Mutex, &Mutex::lock> guard(mutex);
+        add(name, help, Kind::CounterFunction).sample = std::move(sample);
+    }
+
+    /**
+     * @brief every metric in the Prometheus text exposition format, families in name order
+     */
+    std::string render() {
+        Lock_Guard<Mutex, &Mutex::lock> guard(mutex);
+
+        std::vector<Entry*> sorted;
+        for (auto& entry : entries)
+            sorted.push_back(entry.get());
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [](const Entry* a, const Entry* b) { return family(a->name) < family(b->name); });
+
+        std::string out;
+        std::string last_family;
+        for (const Entry* entry : sorted) {
+            std::string name_family = family(entry->name);
+            if (name_family != last_family) {
+                static const char* TYPES[] = {"counter", "gauge", "counter", "summary"};
+                out += "# HELP " + name_family + " " + entry->help + "\n";
+                out += "# TYPE " + name_family + " " + TYPES[static_cast<int>(entry->kind)] + "\n";
+                last_family = name_family;
+            }
+
+            switch (entry->kind) {
+            case Kind::Counter:
+                append_sample(out, entry->name, entry->counter->value() * entry->counter->scale);
+                break;
+            case Kind::Gauge:
+            case Kind::CounterFunction:
+                append_sample(out, entry->name, entry->sample());
+                break;
+            case Kind::Histogram: {
+                auto snapshot = entry->histogram->snapshot();
+                double scale = entry->histogram->scale;
+                for (const char* q : {"0.5", "0.9", "0.99", "0.999", "1"})
+                    append_sample(out, with_label(entry->name, std::string("quantile=\"") + q + "\""),
+                                  snapshot.quantile(atof(q)) * scale);
+                append_sample(out, with_suffix(entry->name, "_sum"), snapshot.sum * scale);
+                append_sample(out, with_suffix(entry->name, "_count"), snapshot.count);
+                break;
+            }
+            }
+        }
+        return out;
+    }
+};
+
+/**
+ * @brief serves Metrics::render() to any HTTP GET on 127.0.0.1:port from a detached thread
+ * @return false if the port could not be bound
+ */
+inline bool start_metrics_server(int port) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0)
+        return false;
+
+    const int enable = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listener, 16) < 0) {
+        close(listener);
+        return false;
+    }
+
+    auto serve = [](void* arg) -> void* {
+        int listener = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+        while (true) {
+            int sock = accept(listener, nullptr, nullptr);
+            if (sock < 0)
+                continue;
+
+            /* one short request per connection; whatever was asked for, the answer is the metrics */
+            timeval timeout{1, 0};
+            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            char request[4096];
+            recv(sock, request, sizeof(request), 0);
+
+            std::string body = Metrics::get_instance().render();
+            std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                                   + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+            for (size_t sent = 0; sent < response.size();) {
+                ssize_t n = send(sock, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+                if (n <= 0)
+                    break;
+                sent += n;
+            }
+            close(sock);
+        }
+        return nullptr;
+    };
+
+    pthread_t thread;
+    if (pthread_create(&thread, nullptr, serve, reinterpret_cast<void*>(static_cast<intptr_t>(listener))) != 0) {
+        close(listener);
+        return false;
+    }
+    pthread_detach(thread);
+    return true;
+}
+
+#endif /* METRICS_H */
@@ -0,0 +1,269 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include <pthread.h>
+
+#include "cv.h"
+#include "mutex.h"
+
+/**
+ * @brief A bounded, FIFO, multi-producer multi-consumer queue. try_push and try_pop are lock-free: each cell carries a
+ * sequence number that tells producers and consumers whose turn it is, so the only contention is one CAS on the head or
+ * tail counter. push and pop block when the queue is full or empty, which is how a slow stage applies backpressure to
+ * the stages feeding it
+ * @note the mutex and condition variables are only touched when a thread has to sleep, or when one is asleep
+ * @note blocking waits are cancellation points; a cancelled waiter leaves the queue in a consistent state
+ * @warning T must be default constructible and move-assignable
+ */
+template <typename T>
+class Bounded_MPMC_Queue {
+private:
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    Cell* cells;
+    size_t mask;
+
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) std::atomic<size_t> dequeue_pos{0};
+
+    alignas(64) Mutex mut_wait;
+    CV cv_not_empty;
+    CV cv_not_full;
+    std::atomic<size_t> waiting_push{0};
+    std::atomic<size_t> waiting_pop{0};
+
+    struct Wait_Cleanup {
+        Mutex* mutex;
+        std::atomic<size_t>* waiting;
+    };
+
+    inline static size_t round_up_pow2(size_t n) {
+        size_t p = 2;
+        while (p < n)
+            p <<= 1;
+        return p;
+    }
+
+    static void cleanup_wait(void* arg) {
+        auto cleanup = static_cast<Wait_Cleanup*>(arg);
+        cleanup->waiting->fetch_sub(1);
+        cleanup->mutex->unlock();
+    }
+
+    /**
+     * @brief wakes one thread sleeping on cv, if there is one
+     * @note the fence pairs with the one in wait_until: either the sleeper sees our update before it sleeps, or we see
+     * its waiting count
+     */
+    void wake(std::atomic<size_t>& waiting, CV& cv) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed) == 0)
+            return;
+
+        mut_wait.lock();
+        cv.signal();
+        mut_wait.unlock();
+    }
+
+    /**
+     * @brief sleeps on cv until attempt() succeeds, or until deadline passes if there is one
+     * @return whether attempt() succeeded
+     */
+    template <typename Attempt>
+    bool wait_until(std::atomic<size_t>& waiting, CV& cv, const Attempt& attempt, const timespec* deadline = nullptr) {
+        Wait_Cleanup cleanup{&mut_wait, &waiting};
+        bool done;
+
+        mut_wait.lock();
+        waiting.fetch_add(1);
+        pthread_cleanup_push(cleanup_wait, &cleanup);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!(done = attempt())) {
+            if (!deadline)
+                cv.wait(mut_wait);
+            else if (!cv.wait_until(mut_wait, *deadline)) {
+                done = attempt();
+                break;
+            }
+        }
+
+        pthread_cleanup_pop(1);
+        return done;
+    }
+
+    /**
+     * @return false, leaving value untouched, if the queue is full
+     */
+    bool enqueue(T& value) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        Cell* cell;
+
+        while (true) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @return false if the queue is empty
+     */
+    bool dequeue(T& value) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        Cell* cell;
+
+        while (true) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        value = std::move(cell->value);
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+public:
+
+    /**
+     * @param capacity rounded up to a power of two
+     */
+    explicit Bounded_MPMC_Queue(size_t capacity) :
+        cells{new Cell[round_up_pow2(capacity)]},
+        mask{round_up_pow2(capacity) - 1}
+    {
+        for (size_t i = 0; i <= mask; ++i)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    ~Bounded_MPMC_Queue() {
+        delete[] cells;
+    }
+
+    Bounded_MPMC_Queue(const Bounded_MPMC_Queue&) = delete;
+    Bounded_MPMC_Queue& operator=(const Bounded_MPMC_Queue&) = delete;
+
+    /**
+     * @return false, leaving value untouched, if the queue is full
+     */
+    bool try_push(T& value) {
+        if (!enqueue(value))
+            return false;
+
+        wake(waiting_pop, cv_not_empty);
+        return true;
+    }
+
+    /**
+     * @return false if the queue is empty
+     */
+    bool try_pop(T& value) {
+        if (!dequeue(value))
+            return false;
+
+        wake(waiting_push, cv_not_full);
+        return true;
+    }
+
+    /**
+     * @warning blocks while the queue is full
+     */
+    void push(T value) {
+        if (!enqueue(value))
+            wait_until(waiting_push, cv_not_full, [&] { return enqueue(value); });
+
+        wake(waiting_pop, cv_not_empty);
+    }
+
+    /**
+     * @param deadline on CLOCK_REALTIME, as for pthread_cond_timedwait
+     * @return false, leaving value untouched, if the queue stayed full until deadline
+     */
+    bool push_until(T& value, const timespec& deadline) {
+        if (!enqueue(value) && !wait_until(waiting_push, cv_not_full, [&] { return enqueue(value); }, &deadline))
+            return false;
+
+        wake(waiting_pop, cv_not_empty);
+        return true;
+    }
+
+    /**
+     * @warning blocks while the queue is empty
+     */
+    T pop() {
+        T value;
+        if (!dequeue(value))
+            wait_until(waiting_pop, cv_not_empty, [&] { return dequeue(value); });
+
+        wake(waiting_push, cv_not_full);
+        return value;
+    }
+
+    /**
+     * @param deadline on CLOCK_REALTIME, as for pthread_cond_timedwait
+     * @return false, leaving value untouched, if the queue stayed empty until deadline
+     */
+    bool pop_until(T& value, const timespec& deadline) {
+        if (!dequeue(value) && !wait_until(waiting_pop, cv_not_empty, [&] { return dequeue(value); }, &deadline))
+            return false;
+
+        wake(waiting_push, cv_not_full);
+        return true;
+    }
+
+    /**
+     * @note only a snapshot; other threads may push or pop before the caller acts on it
+     */
+    size_t size() const {
+        size_t tail = dequeue_pos.load(std::memory_order_acquire);
+        size_t head = enqueue_pos.load(std::memory_order_acquire);
+        return head > tail ? head - tail : 0;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    bool full() const {
+        return size() >= capacity();
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+}; /* class Bounded_MPMC_Queue */
+
+#endif /* MPMC_QUEUE_H */
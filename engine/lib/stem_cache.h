@@ -0,0 +1,273 @@
+#ifndef STEM_CACHE_H
+#define STEM_CACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "clock_cache.h"
+#include "constants.h"
+#include "stemmer.h"
+#include "stemmer_fast.h"
+
+/**
+ * @brief Memoizes Stemmer::stem for the indexer and the query compiler. Lookups first binary search an optional,
+ * read-only table of precomputed stems for the most frequent words (mmap'd from STEM_TABLE_FILE), then fall back to a
+ * sharded CLOCK cache, and only stem (with Stemmer_Fast) on a miss in both
+ * @note Stemmer::stem is a pure function of its input, so cached stems never need invalidating
+ */
+class Stem_Cache {
+private:
+
+    /*
+        Stem table layout:
+            Table_Header
+            Table_Entry[count], sorted by word
+            char pool[pool_size]
+    */
+    struct Table_Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t count;
+        uint32_t pool_size;
+    };
+
+    struct Table_Entry {
+        uint32_t word_offset;
+        uint32_t stem_offset;
+        uint16_t word_length;
+        uint16_t stem_length;
+    };
+
+    static constexpr uint32_t TABLE_MAGIC = 0x53544D54; /* "STMT" */
+    static constexpr uint32_t TABLE_VERSION = 1;
+
+    struct String_Cost {
+        size_t operator()(const std::string& str) const {
+            /* short strings live in the SSO buffer, which is already counted as part of the slot */
+            return str.capacity() > 15 ? str.capacity() : 0;
+        }
+    };
+
+    Sharded_Clock_Cache<std::string, String_Cost> cache;
+
+    void* table_map = nullptr;
+    size_t table_size = 0;
+    const Table_Entry* entries = nullptr;
+    const char* pool = nullptr;
+    uint32_t count = 0;
+
+    std::atomic<uint64_t> table_hits{0};
+
+    Stem_Cache() :
+        cache{STEM_CACHE_SHARDS, STEM_CACHE_ENTRIES, STEM_CACHE_BYTES}
+    {
+        load_table(STEM_TABLE_FILE);
+    }
+
+    inline std::string_view entry_word(const Table_Entry& e) const {
+        return {pool + e.word_offset, e.word_length};
+    }
+
+    inline std::string_view entry_stem(const Table_Entry& e) const {
+        return {pool + e.stem_offset, e.stem_length};
+    }
+
+    /**
+     * @return true and sets result if word is in the precomputed table
+     */
+    bool lookup_table(std::string_view word, std::string& result) const {
+        if (!count)
+            return false;
+
+        const Table_Entry* it = std::lower_bound(entries, entries + count, word,
+            [this](const Table_Entry& e, std::string_view w) { return entry_word(e) < w; });
+
+        if (it == entries + count || entry_word(*it) != word)
+            return false;
+
+        result.assign(entry_stem(*it));
+        return true;
+    }
+
+    void unload_table() {
+        if (table_map)
+            munmap(table_map, table_size);
+
+        table_map = nullptr;
+        table_size = 0;
+        entries = nullptr;
+        pool = nullptr;
+        count = 0;
+    }
+
+public:
+
+    Stem_Cache(const Stem_Cache&) = delete;
+    Stem_Cache& operator=(const Stem_Cache&) = delete;
+
+    ~Stem_Cache() {
+        unload_table();
+    }
+
+    static Stem_Cache& get_instance() {
+        static Stem_Cache instance;
+        return instance;
+    }
+
+    /**
+     * @brief equivalent to Stemmer::stem(word), but memoized
+     */
+    static std::string stem(std::string_view word) {
+        return get_instance().lookup(word);
+    }
+
+    std::string lookup(std::string_view word) {
+        std::string result;
+
+        if (lookup_table(word, result)) {
+            table_hits.fetch_add(1, std::memory_order_relaxed);
+            return result;
+        }
+
+        if (cache.get(word, result))
+            return result;
+
+        char buffer[STEM_BUFFER_SIZE];
+        size_t n = Stemmer_Fast::stem(word, buffer, sizeof(buffer));
+        if (n != Stemmer_Fast::npos)
+            result.assign(buffer, n);
+        else
+            result = Stemmer::stem(std::string(word));
+
+        cache.put(word, result);
+        return result;
+    }
+
+    /**
+     * @brief maps a stem table written by write_table; a missing or malformed file leaves the table empty
+     * @warning not thread safe with concurrent lookups - only call before the cache is shared
+     * @return true if the table was loaded
+     */
+    bool load_table(const char* filename) {
+        unload_table();
+
+        int fd = open(filename, O_RDONLY);
+        if (fd == -1)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(Table_Header)) {
+            close(fd);
+            return false;
+        }
+
+        void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+            return false;
+
+        const Table_Header* header = static_cast<const Table_Header*>(map);
+        size_t expected = sizeof(Table_Header) + size_t(header->count) * sizeof(Table_Entry) + header->pool_size;
+        if (header->magic != TABLE_MAGIC || header->version != TABLE_VERSION
+            || expected != static_cast<size_t>(st.st_size)) {
+            munmap(map, st.st_size);
+            return false;
+        }
+
+        /* the table is probed on every stem, so keep it resident */
+        madvise(map, st.st_size, MADV_WILLNEED);
+
+        table_map = map;
+        table_size = st.st_size;
+        entries = reinterpret_cast<const Table_Entry*>(header + 1);
+        pool = reinterpret_cast<const char*>(entries + header->count);
+        count = header->count;
+        return true;
+    }
+
+    /**
+     * @brief stems each of the given words and writes them as a table that load_table can map
+     * @note words should be ordered most frequent first; only the first max_words distinct words are kept
+     * @param written if given, set to the number of words in the table
+     * @return true on success
+     */
+    static bool write_table(const char* filename, const std::vector<std::string>& words,
+                            size_t max_words = STEM_TABLE_ENTRIES, size_t* written = nullptr) {
+        std::vector<std::pair<std::string, std::string>> pairs;
+        pairs.reserve(std::min(words.size(), max_words));
+
+        /* a repeated word takes no slot, so the cap counts distinct words */
+        std::unordered_set<std::string_view> seen;
+        for (const auto& word : words) {
+            if (pairs.size() == max_words)
+                break;
+            if (word.empty() || word.size() > UINT16_MAX || !seen.insert(word).second)
+                continue;
+            pairs.emplace_back(word, Stemmer::stem(word));
+        }
+
+        std::sort(pairs.begin(), pairs.end());
+
+        std::vector<Table_Entry> table;
+        std::string table_pool;
+        table.reserve(pairs.size());
+
+        for (const auto& [word, stem] : pairs) {
+            Table_Entry e;
+            e.word_offset = table_pool.size();
+            e.word_length = word.size();
+            table_pool += word;
+            e.stem_offset = table_pool.size();
+            e.stem_length = stem.size();
+            table_pool += stem;
+            table.push_back(e);
+        }
+
+        Table_Header header{TABLE_MAGIC, TABLE_VERSION, static_cast<uint32_t>(table.size()),
+                            static_cast<uint32_t>(table_pool.size())};
+
+        FILE* file = fopen(filename, "wb");
+        if (!file)
+            return false;
+
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+                  && fwrite(table.data(), sizeof(Table_Entry), table.size(), file) == table.size()
+                  && fwrite(table_pool.data(), 1, table_pool.size(), file) == table_pool.size();
+
+        if (written)
+            *written = table.size();
+        return fclose(file) == 0 && ok;
+    }
+
+    size_t table_size_words() const { return count; }
+
+    uint64_t get_table_hits() const { return table_hits.load(std::memory_order_relaxed); }
+    uint64_t get_hits() const { return cache.get_hits(); }
+    uint64_t get_misses() const { return cache.get_misses(); }
+    uint64_t get_evictions() const { return cache.get_evictions(); }
+
+    /**
+     * @return the fraction of lookups served without running the stemmer
+     */
+    double hit_rate() const {
+        uint64_t served = get_table_hits() + get_hits();
+        uint64_t total = served + get_misses();
+        return total ? double(served) / total : 0.0;
+    }
+
+}; /* class Stem_Cache */
+
+#endif /* STEM_CACHE_H */
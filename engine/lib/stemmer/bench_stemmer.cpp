@@ -0,0 +1,81 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../stemmer.h"
+#include "../stemmer_fast.h"
+
+/*
+    Stemming throughput of Stemmer against Stemmer_Fast.
+
+    usage: ./bench_stemmer [word list] [passes]
+
+    Words are read whitespace / semicolon separated, defaulting to the query synonym list.
+*/
+
+template <typename Func>
+double time_passes(size_t passes, Func&& func) {
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < passes; ++i)
+        func();
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(end - begin).count();
+}
+
+int main(int argc, char** argv) {
+    const char* filename = argc > 1 ? argv[1] : "../../../query/synsets.txt";
+    size_t passes = argc > 2 ? std::stoul(argv[2]) : 5;
+
+    std::ifstream in(filename);
+    if (!in) {
+        std::cerr << "Unable to open " << filename << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> words;
+    std::string word;
+    while (in >> word) {
+        size_t begin = 0, end;
+        while ((end = word.find(';', begin)) != std::string::npos) {
+            if (end > begin) words.push_back(word.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        if (begin < word.size()) words.push_back(word.substr(begin));
+    }
+
+    size_t bytes = 0;
+    for (const auto& w : words)
+        bytes += w.size();
+
+    size_t checksum_legacy = 0, checksum_fast = 0;
+
+    double legacy = time_passes(passes, [&] {
+        for (const auto& w : words)
+            checksum_legacy += Stemmer::stem(w).size();
+    });
+
+    char buffer[1024];
+    double fast = time_passes(passes, [&] {
+        for (const auto& w : words) {
+            size_t n = Stemmer_Fast::stem(w, buffer, sizeof(buffer));
+            checksum_fast += n == Stemmer_Fast::npos ? Stemmer::stem(w).size() : n;
+        }
+    });
+
+    double total = double(words.size()) * passes;
+
+    std::cout << words.size() << " words (" << bytes << " bytes) x " << passes << " passes\n";
+    std::cout << "Stemmer:      " << total / legacy / 1e6 << " M words/s\n";
+    std::cout << "Stemmer_Fast: " << total / fast / 1e6 << " M words/s\n";
+    std::cout << "speedup:      " << legacy / fast << "x\n";
+
+    if (checksum_legacy != checksum_fast) {
+        std::cerr << "stem lengths differ between implementations" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
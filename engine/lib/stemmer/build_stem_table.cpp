@@ -0,0 +1,32 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../stem_cache.h"
+
+/*
+    Reads words from stdin, one per line and ordered most frequent first, and writes the stems of the first N distinct
+    ones as a table that Stem_Cache maps on startup.
+
+    usage: ./build_stem_table [output file] [N] < vocabulary.txt
+*/
+int main(int argc, char** argv) {
+    const char* filename = argc > 1 ? argv[1] : STEM_TABLE_FILE;
+    size_t max_words = argc > 2 ? strtoull(argv[2], nullptr, 10) : STEM_TABLE_ENTRIES;
+
+    std::vector<std::string> words;
+    std::string word;
+
+    while (std::cin >> word)
+        words.push_back(std::move(word));
+
+    size_t written;
+    if (!Stem_Cache::write_table(filename, words, max_words, &written)) {
+        std::cerr << "Unable to write " << filename << std::endl;
+        return 1;
+    }
+
+    std::cout << "Wrote " << written << " stems to " << filename << std::endl;
+    return 0;
+}
@@ -0,0 +1,532 @@
+#include "../stemmer_fast.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+/*
+    Every phase of Stemmer walks its rules in the order they are listed and stops at the first suffix that matches,
+    whether or not the rule's condition then changes the word. Two suffixes can only both match if they share a last
+    character, so bucketing the rules by last character while keeping their listed order picks the same rule.
+*/
+
+struct Rule {
+    std::string_view suffix;
+    std::string_view replacement;
+    uint8_t kind = 0;
+};
+
+template <size_t N>
+struct Suffix_Table {
+    Rule rules[N] = {};
+    uint16_t bucket[257] = {};
+
+    constexpr Suffix_Table(const Rule (&listed)[N]) {
+        for (size_t i = 0; i < N; ++i)
+            ++bucket[static_cast<unsigned char>(listed[i].suffix.back()) + 1];
+
+        for (size_t c = 1; c < 257; ++c)
+            bucket[c] += bucket[c - 1];
+
+        uint16_t next[256] = {};
+        for (size_t i = 0; i < N; ++i) {
+            unsigned char last = static_cast<unsigned char>(listed[i].suffix.back());
+            rules[bucket[last] + next[last]++] = listed[i];
+        }
+    }
+
+    constexpr const Rule* begin(char last) const {
+        return rules + bucket[static_cast<unsigned char>(last)];
+    }
+
+    constexpr const Rule* end(char last) const {
+        return rules + bucket[static_cast<unsigned char>(last) + 1];
+    }
+};
+
+template <size_t N>
+constexpr bool is_sorted(const std::string_view (&words)[N]) {
+    for (size_t i = 1; i < N; ++i)
+        if (!(words[i - 1] < words[i]))
+            return false;
+    return true;
+}
+
+struct Exception {
+    std::string_view word;
+    std::string_view stem;
+};
+
+template <size_t N>
+constexpr bool is_sorted(const Exception (&exceptions)[N]) {
+    for (size_t i = 1; i < N; ++i)
+        if (!(exceptions[i - 1].word < exceptions[i].word))
+            return false;
+    return true;
+}
+
+constexpr std::string_view STOP_WORDS[] = {
+    "a",    "an",   "and",   "are",   "as",  "at",   "be",   "been", "being", "but",  "by",
+    "for",  "he",   "her",   "his",   "i",   "if",   "in",   "is",   "it",    "its",  "me",
+    "my",   "of",   "on",    "or",    "our", "she",  "that", "the",  "their", "them", "these",
+    "they", "this", "those", "to",    "was", "we",   "were", "with", "you",   "your"
+};
+
+static_assert(is_sorted(STOP_WORDS), "STOP_WORDS must be sorted for binary search");
+
+constexpr Exception EXCEPTIONS[] = {
+    {   "analysis",    "analysis"},
+    {      "buses",         "bus"},
+    {   "children",       "child"},
+    {       "data",        "data"},
+    {       "dice",         "die"},
+    {     "echoes",        "echo"},
+    {       "feet",        "foot"},
+    {      "geese",       "goose"},
+    {     "heroes",        "hero"},
+    {    "indices",       "index"},
+    {"information", "information"},
+    {     "knives",       "knife"},
+    {     "leaves",        "leaf"},
+    {      "lives",        "life"},
+    {   "matrices",      "matrix"},
+    {      "media",       "media"},
+    {        "men",         "man"},
+    {       "mice",       "mouse"},
+    {      "money",       "money"},
+    {       "news",        "news"},
+    {       "oxen",          "ox"},
+    {     "people",      "people"},
+    {     "person",      "person"},
+    {     "polite",      "polite"},
+    {   "potatoes",      "potato"},
+    {     "series",      "series"},
+    {    "species",     "species"},
+    {      "teeth",       "tooth"},
+    {    "thieves",       "thief"},
+    {   "tomatoes",      "tomato"},
+    {      "wives",        "wife"},
+    {     "wolves",        "wolf"},
+    {      "women",       "woman"}
+};
+
+static_assert(is_sorted(EXCEPTIONS), "EXCEPTIONS must be sorted for binary search");
+
+/* rule kinds, interpreted per phase */
+enum : uint8_t {
+    REPLACE,      /* replace the suffix unconditionally */
+    KEEP,         /* match, but leave the word alone */
+    IN_R1,        /* replace if the stem reaches R1 */
+    IN_R2,        /* replace if the stem reaches R2 */
+    IES,          /* phase 1a ied / ies */
+    PLURAL_S,     /* phase 1a s */
+    EED,          /* phase 1b eed / eedly */
+    ED,           /* phase 1b ed / edly / ing / ingly */
+    DOUBLE,       /* phase 1b double consonant */
+    Y_TO_I,       /* phase 1c */
+    OGI,          /* phase 2 ogi */
+    LI,           /* phase 2 li */
+    IZE,          /* phase 4 ize */
+    ION,          /* phase 4 ion */
+    FINAL_E,      /* phase 5 e */
+    FINAL_L       /* phase 5 l */
+};
+
+constexpr Rule PHASE0_LIST[] = {
+    {"'s'", "", REPLACE},
+    { "'s", "", REPLACE},
+    {  "'", "", REPLACE}
+};
+
+constexpr Rule PHASE1A_LIST[] = {
+    {"sses", "ss",  REPLACE},
+    { "ied",   "",      IES},
+    { "ies",   "",      IES},
+    {  "ws",   "",     KEEP},
+    {  "us",   "",     KEEP},
+    {  "ss",   "",     KEEP},
+    {   "s",   "", PLURAL_S}
+};
+
+constexpr Rule PHASE1B_LIST[] = {
+    {  "eed", "ee", EED},
+    {"eedly", "ee", EED},
+    {   "ed",   "",  ED},
+    { "edly",   "",  ED},
+    {  "ing",   "",  ED},
+    {"ingly",   "",  ED}
+};
+
+constexpr Rule PHASE1B_DEL_LIST[] = {
+    {"at", "ate", REPLACE},
+    {"bl", "ble", REPLACE},
+    {"iz", "ize", REPLACE},
+    {"bb",     "", DOUBLE},
+    {"dd",     "", DOUBLE},
+    {"ff",     "", DOUBLE},
+    {"gg",     "", DOUBLE},
+    {"mm",     "", DOUBLE},
+    {"nn",     "", DOUBLE},
+    {"pp",     "", DOUBLE},
+    {"rr",     "", DOUBLE},
+    {"tt",     "", DOUBLE}
+};
+
+constexpr Rule PHASE1C_LIST[] = {
+    {"y", "i", Y_TO_I},
+    {"Y", "i", Y_TO_I}
+};
+
+constexpr Rule PHASE2_LIST[] = {
+    { "tional", "tion", REPLACE},
+    {   "enci", "ence", REPLACE},
+    {   "anci", "ance", REPLACE},
+    {   "abli", "able", REPLACE},
+    {  "entli",  "ent", REPLACE},
+    {   "izer",  "ize", REPLACE},
+    {"ization",  "ize", REPLACE},
+    {"ational",  "ate", REPLACE},
+    {  "ation",  "ate", REPLACE},
+    {   "ator",  "ate", REPLACE},
+    {  "alism",   "al", REPLACE},
+    {  "aliti",   "al", REPLACE},
+    {   "alli",   "al", REPLACE},
+    {"fulness",  "ful", REPLACE},
+    {  "ousli",  "ous", REPLACE},
+    {"ousness",  "ous", REPLACE},
+    {"iveness",  "ive", REPLACE},
+    {  "iviti",  "ive", REPLACE},
+    { "biliti",  "ble", REPLACE},
+    {    "bli",  "ble", REPLACE},
+    {    "ogi",   "og",     OGI},
+    {  "fulli",  "ful", REPLACE},
+    { "lessli", "less", REPLACE},
+    {     "li",     "",      LI}
+};
+
+constexpr Rule PHASE3_LIST[] = {
+    { "tional", "tion", IN_R1},
+    {"ational",  "ate", IN_R1},
+    {  "alize",   "al", IN_R1},
+    {  "icate",   "ic", IN_R1},
+    {  "iciti",   "ic", IN_R1},
+    {   "ical",   "ic", IN_R1},
+    {    "ful",     "", IN_R1},
+    {   "ness",     "", IN_R1},
+    {  "ative",     "", IN_R2}
+};
+
+constexpr Rule PHASE4_LIST[] = {
+    {   "al", "", IN_R2},
+    { "ance", "", IN_R2},
+    { "ence", "", IN_R2},
+    {   "er", "", IN_R2},
+    {   "ic", "", IN_R2},
+    { "able", "", IN_R2},
+    { "ible", "", IN_R2},
+    {  "ant", "", IN_R2},
+    {"ement", "", IN_R2},
+    { "ment", "", IN_R2},
+    {  "ent", "", IN_R2},
+    {  "ism", "", IN_R2},
+    {  "ate", "", IN_R2},
+    {  "iti", "", IN_R2},
+    {  "ous", "", IN_R2},
+    {  "ive", "", IN_R2},
+    {  "ize", "",   IZE},
+    {  "ion", "",   ION}
+};
+
+constexpr Rule PHASE5_LIST[] = {
+    {"e", "", FINAL_E},
+    {"l", "", FINAL_L}
+};
+
+constexpr Rule PHASE6_LIST[] = {
+    { "er", "", IN_R1},
+    {"est", "", IN_R1}
+};
+
+constexpr Suffix_Table PHASE0 { PHASE0_LIST };
+constexpr Suffix_Table PHASE1A { PHASE1A_LIST };
+constexpr Suffix_Table PHASE1B { PHASE1B_LIST };
+constexpr Suffix_Table PHASE1B_DEL { PHASE1B_DEL_LIST };
+constexpr Suffix_Table PHASE1C { PHASE1C_LIST };
+constexpr Suffix_Table PHASE2 { PHASE2_LIST };
+constexpr Suffix_Table PHASE3 { PHASE3_LIST };
+constexpr Suffix_Table PHASE4 { PHASE4_LIST };
+constexpr Suffix_Table PHASE5 { PHASE5_LIST };
+constexpr Suffix_Table PHASE6 { PHASE6_LIST };
+
+inline bool is_vowel(char ch) {
+    return (ch == 'a' || ch == 'e' || ch == 'i' || ch == 'o' || ch == 'u' || ch == 'y');
+}
+
+inline bool is_li_ending(char ch) {
+    return (ch == 'c' || ch == 'd' || ch == 'e' || ch == 'g' || ch == 'h' || ch == 'k' || ch == 'm' || ch == 'n'
+            || ch == 'r' || ch == 't');
+}
+
+inline bool is_punct(char ch) {
+    switch (ch) {
+        case '.': case ',': case ';': case ':': case '!': case '?': case '"': case ')': case ']': case '}': case '\'':
+            return true;
+        default:
+            return false;
+    }
+}
+
+inline bool contains_vowel(const char* begin, const char* end) {
+    for (; begin != end; ++begin)
+        if (is_vowel(*begin)) return true;
+
+    return false;
+}
+
+/**
+ * @return the length of the prefix before R1 of the n characters at w
+ */
+inline size_t find_r1(const char* w, size_t n) {
+    bool found_vowel = false;
+    for (size_t i = 0; i < n; ++i) {
+        if (is_vowel(w[i]))
+            found_vowel = true;
+        else if (found_vowel)
+            return i + 1;
+    }
+
+    return n;
+}
+
+inline bool is_past(const char* w, size_t n) {
+    return n == 4 && memcmp(w, "past", 4) == 0;
+}
+
+/**
+ * @brief Stemmer::is_short_syllable for the character at v of the n characters at w
+ */
+inline bool is_short_syllable(const char* w, size_t n, size_t v) {
+    bool found;
+
+    if (v != 0)
+        found = v + 1 < n && !is_vowel(w[v - 1]) && is_vowel(w[v])
+                && (!is_vowel(w[v + 1]) && w[v + 1] != 'w' && w[v + 1] != 'x' && w[v + 1] != 'Y');
+    else
+        found = v + 1 < n && is_vowel(w[v]) && !is_vowel(w[v + 1]);
+
+    return found || is_past(w, n);
+}
+
+/**
+ * @brief finds the first rule of the table matching the end of the word and hands it to apply along with the length
+ * of the word without the suffix
+ * @return true if a rule matched
+ */
+template <size_t N, typename Apply>
+inline bool apply_table(const Suffix_Table<N>& table, const char* w, size_t n, Apply&& apply) {
+    if (n == 0)
+        return false;
+
+    const char last = w[n - 1];
+    for (const Rule* rule = table.begin(last); rule != table.end(last); ++rule) {
+        const size_t len = rule->suffix.size();
+        if (n < len || memcmp(w + n - len, rule->suffix.data(), len) != 0)
+            continue;
+
+        apply(*rule, n - len);
+        return true;
+    }
+
+    return false;
+}
+
+inline void replace(char* w, size_t& n, size_t stem, std::string_view replacement) {
+    memcpy(w + stem, replacement.data(), replacement.size());
+    n = stem + replacement.size();
+}
+
+inline void phase0(char* w, size_t& n) {
+    apply_table(PHASE0, w, n, [&](const Rule& rule, size_t stem) { replace(w, n, stem, rule.replacement); });
+}
+
+inline void phase1a(char* w, size_t& n) {
+    apply_table(PHASE1A, w, n, [&](const Rule& rule, size_t stem) {
+        switch (rule.kind) {
+            case REPLACE:
+                replace(w, n, stem, rule.replacement);
+                break;
+            case IES:
+                replace(w, n, stem, 1 < stem ? "i" : "ie");
+                break;
+            case PLURAL_S:
+                if (stem > 2 && contains_vowel(w, w + stem - 1))
+                    n = stem;
+                break;
+            default:
+                break;
+        }
+    });
+}
+
+/**
+ * @return true if an ed / edly / ing / ingly suffix was deleted
+ */
+inline bool phase1b(char* w, size_t& n, size_t r1) {
+    bool deleted = false;
+
+    apply_table(PHASE1B, w, n, [&](const Rule& rule, size_t stem) {
+        if (rule.kind == EED) {
+            if (r1 <= stem)
+                replace(w, n, stem, rule.replacement);
+        }
+        else if (contains_vowel(w, w + stem)) {
+            n = stem;
+            deleted = true;
+        }
+    });
+
+    return deleted;
+}
+
+inline void phase1b_del(char* w, size_t& n, size_t r1) {
+    bool matched = apply_table(PHASE1B_DEL, w, n, [&](const Rule& rule, size_t stem) {
+        if (rule.kind == REPLACE)
+            replace(w, n, stem, rule.replacement);
+        else if (!(stem == 1 && (w[0] == 'a' || w[0] == 'e' || w[0] == 'o')))
+            --n;
+    });
+
+    /* Stemmer's generic "  " rule: add e if the word is short */
+    if (!matched && n >= 2 && is_short_syllable(w, n, n - 1) && n <= r1)
+        w[n++] = 'e';
+}
+
+inline void phase1c(char* w, size_t& n) {
+    apply_table(PHASE1C, w, n, [&](const Rule& rule, size_t stem) {
+        if (1 < stem && !is_vowel(w[stem - 1]))
+            replace(w, n, stem, rule.replacement);
+    });
+}
+
+inline void phase2(char* w, size_t& n) {
+    apply_table(PHASE2, w, n, [&](const Rule& rule, size_t stem) {
+        switch (rule.kind) {
+            case REPLACE:
+                replace(w, n, stem, rule.replacement);
+                break;
+            case OGI:
+                if (stem && w[stem - 1] == 'l')
+                    replace(w, n, stem, rule.replacement);
+                break;
+            case LI:
+                if (stem && is_li_ending(w[stem - 1]))
+                    n = stem;
+                break;
+            default:
+                break;
+        }
+    });
+}
+
+inline void phase3(char* w, size_t& n, size_t r1, size_t r2) {
+    apply_table(PHASE3, w, n, [&](const Rule& rule, size_t stem) {
+        if ((rule.kind == IN_R1 ? r1 : r2) <= stem)
+            replace(w, n, stem, rule.replacement);
+    });
+}
+
+inline void phase4(char* w, size_t& n, size_t r2) {
+    apply_table(PHASE4, w, n, [&](const Rule& rule, size_t stem) {
+        if (stem < r2)
+            return;
+
+        switch (rule.kind) {
+            case IN_R2:
+                n = stem;
+                break;
+            case IZE:
+                if (stem >= 5)
+                    n = stem;
+                break;
+            case ION:
+                if (stem && (w[stem - 1] == 's' || w[stem - 1] == 't'))
+                    n = stem;
+                break;
+            default:
+                break;
+        }
+    });
+}
+
+inline void phase5(char* w, size_t& n, size_t r1, size_t r2) {
+    apply_table(PHASE5, w, n, [&](const Rule& rule, size_t stem) {
+        if (rule.kind == FINAL_E) {
+            if (r2 <= stem || (r1 <= stem && !is_short_syllable(w, stem, stem - 1)))
+                n = stem;
+        }
+        else if (r2 <= stem && stem && w[stem - 1] == 'l')
+            n = stem;
+    });
+}
+
+inline void phase6(char* w, size_t& n, size_t r1) {
+    apply_table(PHASE6, w, n, [&](const Rule&, size_t stem) {
+        if (r1 <= stem)
+            n = stem;
+    });
+}
+
+} /* namespace */
+
+size_t Stemmer_Fast::stem(std::string_view word, char* buffer, size_t capacity) {
+    if (capacity < buffer_size(word.size()))
+        return npos;
+
+    while (!word.empty() && is_punct(word.back())) word.remove_suffix(1);
+    if (word.empty()) return 0;
+
+    if (std::binary_search(std::begin(STOP_WORDS), std::end(STOP_WORDS), word)) return 0;
+
+    const Exception* exc = std::lower_bound(std::begin(EXCEPTIONS), std::end(EXCEPTIONS), word,
+        [](const Exception& e, std::string_view w) { return e.word < w; });
+    if (exc != std::end(EXCEPTIONS) && exc->word == word) {
+        memcpy(buffer, exc->stem.data(), exc->stem.size());
+        return exc->stem.size();
+    }
+
+    char* w = buffer;
+    size_t n = word.size();
+    memmove(w, word.data(), n);
+
+    if (n < 3) return n;
+
+    /* strip the initial apostrophe */
+    if (w[0] == '\'') {
+        memmove(w, w + 1, --n);
+    }
+
+    /* mark consonant y's */
+    if (w[0] == 'y') w[0] = 'Y';
+    for (size_t i = 1; i < n; ++i)
+        if (w[i] == 'y' && is_vowel(w[i - 1])) w[i] = 'Y';
+
+    const size_t r1 = find_r1(w, n);
+    const size_t r2 = r1 + find_r1(w + r1, n - r1);
+
+    phase0(w, n);
+    phase1a(w, n);
+    if (phase1b(w, n, r1)) phase1b_del(w, n, r1);
+    phase1c(w, n);
+    phase2(w, n);
+    phase3(w, n, r1, r2);
+    phase4(w, n, r2);
+    phase5(w, n, r1, r2);
+    phase6(w, n, r1);
+
+    for (size_t i = 0; i < n; ++i)
+        if (w[i] == 'Y') w[i] = 'y';
+
+    return n;
+}
@@ -0,0 +1,125 @@
+#include <cassert>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "../stemmer.h"
+#include "../stemmer_fast.h"
+
+/*
+    Differential test of Stemmer_Fast against Stemmer.
+
+    usage: ./test_stemmer_fast [word list]...
+
+    Words are read from the given files (split on anything that is not a letter, apostrophe or punctuation Stemmer
+    strips), defaulting to the query synonym list. Every word is also tried with each suffix the stemmer knows about,
+    with leading apostrophes, trailing punctuation and y's, and a fixed-seed random sample of short words over an
+    alphabet dense in vowels, y and doubled consonants covers the corner cases a dictionary misses.
+*/
+
+const char* SUFFIXES[] = {
+    "", "'", "'s", "'s'", "s", "es", "ies", "ied", "sses", "ss", "us", "ws", "ed", "edly", "eed", "eedly", "ing",
+    "ingly", "at", "bl", "iz", "bb", "dd", "ff", "gg", "mm", "nn", "pp", "rr", "tt", "y", "Y", "tional", "enci",
+    "anci", "abli", "entli", "izer", "ization", "ational", "ation", "ator", "alism", "aliti", "alli", "fulness",
+    "ousli", "ousness", "iveness", "iviti", "biliti", "bli", "ogi", "logi", "fulli", "lessli", "li", "cli", "alize",
+    "icate", "iciti", "ical", "ful", "ness", "ative", "al", "ance", "ence", "er", "ic", "able", "ible", "ant",
+    "ement", "ment", "ent", "ism", "ate", "iti", "ous", "ive", "ize", "ion", "sion", "tion", "e", "l", "ll", "est"
+};
+
+const char* DECORATIONS[] = { ".", ",", "!\"", ")", "'", "];" };
+
+bool is_word_char(char c) {
+    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || c == '\'' || c == '.' || c == ',' || c == '!';
+}
+
+void read_words(const char* filename, std::unordered_set<std::string>& words) {
+    std::ifstream in(filename);
+    if (!in) {
+        std::cerr << "Unable to open " << filename << std::endl;
+        exit(1);
+    }
+
+    std::string word;
+    char c;
+    while (in.get(c)) {
+        if (is_word_char(c))
+            word.push_back(c);
+        else if (!word.empty()) {
+            words.insert(std::move(word));
+            word.clear();
+        }
+    }
+    if (!word.empty())
+        words.insert(std::move(word));
+}
+
+size_t failures = 0;
+
+void check(const std::string& word) {
+    std::string expected = Stemmer::stem(word);
+
+    char buffer[256];
+    size_t n = Stemmer_Fast::stem(word, buffer, sizeof(buffer));
+
+    if (n == Stemmer_Fast::npos || std::string_view(buffer, n) != expected) {
+        if (++failures <= 20)
+            std::cerr << "mismatch for '" << word << "': expected '" << expected << "', got '"
+                      << (n == Stemmer_Fast::npos ? "<npos>" : std::string(buffer, n)) << "'\n";
+        return;
+    }
+
+    /* stemming in place must agree as well */
+    std::string in_place = word;
+    in_place.resize(Stemmer_Fast::buffer_size(word.size()));
+    n = Stemmer_Fast::stem(std::string_view(in_place.data(), word.size()), in_place.data(), in_place.size());
+    if (std::string_view(in_place.data(), n) != expected && ++failures <= 20)
+        std::cerr << "in place mismatch for '" << word << "'\n";
+}
+
+int main(int argc, char** argv) {
+    std::unordered_set<std::string> words;
+
+    if (argc > 1)
+        for (int i = 1; i < argc; ++i)
+            read_words(argv[i], words);
+    else
+        read_words("../../../query/synsets.txt", words);
+
+    size_t checked = 0;
+
+    for (const auto& base : words) {
+        for (const char* suffix : SUFFIXES) {
+            std::string word = base + suffix;
+            check(word);
+            check("'" + word);
+            ++checked;
+        }
+        for (const char* decoration : DECORATIONS)
+            check(base + decoration);
+
+        checked += 1 + std::size(DECORATIONS);
+    }
+
+    /* random short words */
+    const char alphabet[] = "aeiouyybbddllnnrsstwxY'";
+    srand(42);
+    for (size_t i = 0; i < 2000000; ++i) {
+        std::string word(1 + rand() % 10, ' ');
+        for (auto& c : word)
+            c = alphabet[rand() % (sizeof(alphabet) - 1)];
+        check(word);
+        ++checked;
+    }
+
+    /* a buffer that is too small is rejected rather than overrun */
+    char small[4];
+    assert(Stemmer_Fast::stem("running", small, sizeof(small)) == Stemmer_Fast::npos);
+
+    std::cout << words.size() << " distinct words, " << checked << " variants checked, " << failures << " mismatches"
+              << std::endl;
+
+    return failures ? 1 : 0;
+}
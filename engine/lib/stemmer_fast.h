@@ -0,0 +1,33 @@
+#ifndef STEMMER_FAST_H
+#define STEMMER_FAST_H
+
+#include <cstddef>
+#include <string_view>
+
+/**
+ * @brief An allocation free reimplementation of Stemmer; suffix rules live in compile-time tables bucketed by their
+ * last character, and every phase edits a caller-provided buffer in place
+ * @note produces output identical to Stemmer::stem for every input, including its deviations from Porter 2
+ */
+class Stemmer_Fast {
+public:
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    /**
+     * @return the buffer capacity stem needs for a word of the given length
+     */
+    static constexpr size_t buffer_size(size_t word_length) {
+        /* the only rule that grows a word is the exception mice -> mouse */
+        return word_length + 1;
+    }
+
+    /**
+     * @brief stems word into buffer; buffer may alias word
+     * @return the length of the stem written to buffer, or npos if capacity < buffer_size(word.size())
+     */
+    static size_t stem(std::string_view word, char* buffer, size_t capacity);
+
+}; /* class Stemmer_Fast */
+
+#endif /* STEMMER_FAST_H */
@@ -0,0 +1,96 @@
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../BloomFilter.h"
+
+/*
+    Compares Bloomfilter and Blocked_Bloomfilter on url-like keys: inserts/s,
+    lookups/s of keys that were never inserted, and the measured false
+    positive rate against the target. Also checks the blocked filter has no
+    false negatives and survives a save and load, and times reopening it by
+    reading versus mapping.
+
+    usage: ./bench_bloom [keys] [false positive rate]
+    build: g++ -std=c++17 -O3 bench_bloom.cpp -lcrypto -o bench_bloom
+*/
+
+std::vector<std::string> make_keys(size_t n, const char* prefix) {
+    std::vector<std::string> keys;
+    keys.reserve(n);
+    for (size_t i = 0; i < n; ++i)
+        keys.push_back(std::string("https://www.") + prefix + std::to_string(i % 997) + ".com/path/" + std::to_string(i));
+    return keys;
+}
+
+template<typename Filter>
+void bench(const char* name, Filter& filter, const std::vector<std::string>& keys,
+           const std::vector<std::string>& absent, double target) {
+    auto begin = std::chrono::steady_clock::now();
+    for (const auto& key : keys)
+        filter.insert(key);
+    std::chrono::duration<double> insert_time = std::chrono::steady_clock::now() - begin;
+
+    begin = std::chrono::steady_clock::now();
+    size_t false_positives = 0;
+    for (const auto& key : absent)
+        false_positives += filter.contains(key);
+    std::chrono::duration<double> lookup_time = std::chrono::steady_clock::now() - begin;
+
+    std::cout << name << ": " << keys.size() / insert_time.count() / 1e6 << " M inserts/s, "
+              << absent.size() / lookup_time.count() / 1e6 << " M lookups/s, false positive rate "
+              << static_cast<double>(false_positives) / absent.size() << " (target " << target << ")\n";
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? std::stoul(argv[1]) : 10000000;
+    double rate = argc > 2 ? std::stod(argv[2]) : 0.02;
+
+    auto keys = make_keys(n, "inserted");
+    auto absent = make_keys(n, "absent");
+
+    {
+        Bloomfilter filter(n, rate);
+        bench("Bloomfilter        ", filter, keys, absent, rate);
+    }
+
+    Blocked_Bloomfilter filter(n, rate);
+    bench("Blocked_Bloomfilter", filter, keys, absent, rate);
+
+    for (const auto& key : keys)
+        assert(filter.contains(key));
+
+    const char* file = "/tmp/bench_bloom.bin";
+    filter.save(file);
+    Blocked_Bloomfilter loaded(file);
+    assert(loaded.loaded() && loaded.size_in_bits() == filter.size_in_bits());
+    for (size_t i = 0; i < keys.size(); i += 97)
+        assert(loaded.contains(keys[i]));
+    unlink(file);
+
+    std::cout << "blocked filter: " << filter.size_in_bits() / 8 / (1 << 20) << " MB, " << filter.hashes()
+              << " hashes, no false negatives, save and load ok" << std::endl;
+
+    /* restart cost: reading a saved filter back versus mapping it */
+    filter.save(file);
+    auto begin = std::chrono::steady_clock::now();
+    {
+        Blocked_Bloomfilter reread(file);
+        assert(reread.contains(keys[0]));
+    }
+    std::chrono::duration<double> read_time = std::chrono::steady_clock::now() - begin;
+
+    begin = std::chrono::steady_clock::now();
+    {
+        Blocked_Bloomfilter mapped(file, n, rate);
+        assert(mapped.is_mapped() && mapped.contains(keys[0]));
+    }
+    std::chrono::duration<double> map_time = std::chrono::steady_clock::now() - begin;
+    unlink(file);
+
+    std::cout << "reopen: read " << read_time.count() * 1e3 << " ms, mapped " << map_time.count() * 1e3 << " ms"
+              << std::endl;
+    return 0;
+}
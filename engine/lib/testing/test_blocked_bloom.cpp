@@ -0,0 +1,113 @@
+#include <cassert>
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+#include "../BloomFilter.h"
+
+/*
+    Hammers one Blocked_Bloomfilter from several threads with no lock, some
+    keys inserted by every thread, while another thread saves it. Checks that
+    no key is lost, that every shared key was reported new at least once, and
+    that a save taken mid-run holds every key inserted before it began. Then
+    checks a filter mapped from a file persists, syncs only what changed and
+    reopens at its own size.
+
+    build: g++ -std=c++17 -O2 -pthread test_blocked_bloom.cpp -o test_blocked_bloom
+*/
+
+constexpr int THREADS = 8;
+constexpr int KEYS = 100000;          /* per thread */
+constexpr int SHARED = 10000;         /* inserted by every thread */
+
+Blocked_Bloomfilter filter(THREADS * KEYS + SHARED, 0.01);
+std::atomic<int> shared_new[SHARED];
+
+std::string key(int thread, int i) {
+    return "https://host" + std::to_string(thread) + ".example.com/page/" + std::to_string(i);
+}
+
+void* inserter(void* arg) {
+    int thread = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+    for (int i = 0; i < KEYS; ++i) {
+        filter.test_and_insert(key(thread, i));
+        if (i < SHARED && !filter.test_and_insert(key(-1, i)))
+            ++shared_new[i];
+    }
+    return nullptr;
+}
+
+int main() {
+    /* keys in place before the save begins must be in the saved file */
+    for (int i = 0; i < KEYS; ++i)
+        filter.insert(key(100, i));
+
+    std::vector<pthread_t> threads(THREADS);
+    for (int t = 0; t < THREADS; ++t)
+        pthread_create(&threads[t], nullptr, inserter, reinterpret_cast<void*>(static_cast<intptr_t>(t)));
+
+    const char* file = "/tmp/test_blocked_bloom.bin";
+    filter.save(file);
+
+    for (auto thread : threads)
+        pthread_join(thread, nullptr);
+
+    for (int t = 0; t < THREADS; ++t)
+        for (int i = 0; i < KEYS; ++i)
+            assert(filter.contains(key(t, i)));
+    for (int i = 0; i < SHARED; ++i) {
+        assert(filter.contains(key(-1, i)));
+        assert(shared_new[i] >= 1);
+    }
+
+    Blocked_Bloomfilter saved(file);
+    assert(saved.loaded());
+    for (int i = 0; i < KEYS; ++i)
+        assert(saved.contains(key(100, i)));
+    unlink(file);
+
+    /* test_and_insert reports a key seen once it is in */
+    assert(!filter.test_and_insert("https://fresh.example.com/"));
+    assert(filter.test_and_insert("https://fresh.example.com/"));
+
+    /* a mapped filter persists without save(), syncs only what changed and keeps its size when reopened */
+    const char* mapped_file = "/tmp/test_blocked_bloom_mapped.bin";
+    unlink(mapped_file);
+    {
+        Blocked_Bloomfilter mapped(mapped_file, 1000000, 0.01);
+        assert(mapped.loaded() && mapped.is_mapped());
+        for (int i = 0; i < 1000; ++i)
+            assert(!mapped.test_and_insert(key(7, i)));
+        mapped.sync();
+
+        mapped.insert("https://one.example.com/");
+        size_t synced = mapped.sync();
+        assert(synced > 0 && synced <= Dynamic_Bitset::DIRTY_CHUNK + Blocked_Bloomfilter::HEADER_BYTES);
+        assert(mapped.sync() == Blocked_Bloomfilter::HEADER_BYTES);
+    }
+    {
+        Blocked_Bloomfilter reopened(mapped_file, 10, 0.5);
+        assert(reopened.is_mapped() && reopened.hashes() > 1);
+        for (int i = 0; i < 1000; ++i)
+            assert(reopened.contains(key(7, i)));
+        assert(reopened.contains("https://one.example.com/"));
+
+        Blocked_Bloomfilter copy(mapped_file);
+        assert(copy.loaded() && !copy.is_mapped() && copy.contains("https://one.example.com/"));
+    }
+    unlink(mapped_file);
+
+    /* a file that is not a blocked filter is left alone */
+    int fd = open(mapped_file, O_WRONLY | O_CREAT, 0644);
+    assert(write(fd, "not a filter", 12) == 12);
+    close(fd);
+    assert(!Blocked_Bloomfilter(mapped_file, 1000, 0.01).loaded());
+    unlink(mapped_file);
+
+    std::cout << "All tests passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,148 @@
+#include <cassert>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+#include "../clock_cache.h"
+#include "../stem_cache.h"
+
+struct Int_Cost {
+    size_t operator()(const int&) const { return 0; }
+};
+
+using Int_Cache = Sharded_Clock_Cache<int, Int_Cost>;
+
+void test_single_threaded() {
+
+    { /* one shard, 3 slots: referenced entries get a second chance */
+        Int_Cache cache{1, 3, 1 << 20};
+        int v;
+
+        cache.put("a", 1);
+        cache.put("b", 2);
+        cache.put("c", 3);
+
+        assert(cache.get("a", v) && v == 1);
+        assert(cache.get("c", v) && v == 3);
+
+        /* b is the only unreferenced entry, so it is the victim */
+        cache.put("d", 4);
+
+        assert(!cache.get("b", v));
+        assert(cache.get("a", v) && v == 1);
+        assert(cache.get("c", v) && v == 3);
+        assert(cache.get("d", v) && v == 4);
+        assert(cache.size() == 3);
+    }
+
+    { /* replacing a key keeps one entry */
+        Int_Cache cache{4, 64, 1 << 20};
+        int v;
+
+        cache.put("key", 1);
+        cache.put("key", 2);
+
+        assert(cache.size() == 1);
+        assert(cache.get("key", v) && v == 2);
+    }
+
+    { /* the byte bound evicts before the entry bound */
+        Int_Cache cache{1, 1024, 16 * 64};
+
+        for (int i = 0; i < 1000; ++i)
+            cache.put(std::to_string(i), i);
+
+        assert(cache.bytes() <= 16 * 64);
+        assert(cache.size() < 1024);
+        assert(cache.get_evictions() > 0);
+    }
+
+    { /* heavy churn keeps the index consistent */
+        Int_Cache cache{2, 100, 1 << 20};
+        int v;
+
+        for (int i = 0; i < 100000; ++i) {
+            cache.put(std::to_string(i % 357), i % 357);
+            if (cache.get(std::to_string((i * 7) % 357), v))
+                assert(v == (i * 7) % 357);
+        }
+        assert(cache.size() <= 100);
+    }
+
+    { /* cached stems match the stemmer */
+        std::vector<std::string> words = {"running", "generously", "hopefulness", "the", "a", "caresses", "ponies",
+                                          "running", "agreed", "feed", "generously", "national", "sensational"};
+
+        for (const auto& word : words)
+            assert(Stem_Cache::stem(word) == Stemmer::stem(word));
+
+        assert(Stem_Cache::get_instance().get_hits() >= 2);
+    }
+
+    { /* stem table round trip */
+        const char* file = "test_stem_table.bin";
+        std::vector<std::string> words = {"running", "ponies", "generously", "running", "feed"};
+
+        size_t written = 0;
+        assert(Stem_Cache::write_table(file, words, STEM_TABLE_ENTRIES, &written) && written == 4);
+        assert(Stem_Cache::get_instance().load_table(file));
+        assert(Stem_Cache::get_instance().table_size_words() == 4);
+
+        uint64_t table_hits = Stem_Cache::get_instance().get_table_hits();
+        for (const auto& word : words)
+            assert(Stem_Cache::stem(word) == Stemmer::stem(word));
+        assert(Stem_Cache::get_instance().get_table_hits() == table_hits + words.size());
+
+        assert(Stem_Cache::stem("hopefulness") == Stemmer::stem("hopefulness"));
+
+        /* the cap counts distinct words: the repeated "running" takes no slot, so "feed" is not crowded out */
+        assert(Stem_Cache::write_table(file, words, 4, &written) && written == 4);
+        assert(Stem_Cache::write_table(file, words, 3, &written) && written == 3);
+        assert(Stem_Cache::get_instance().load_table(file));
+        assert(Stem_Cache::get_instance().table_size_words() == 3);
+        table_hits = Stem_Cache::get_instance().get_table_hits();
+        Stem_Cache::stem("feed");
+        assert(Stem_Cache::get_instance().get_table_hits() == table_hits);
+        remove(file);
+    }
+}
+
+void* test_multi_threaded_aux0(void* cache$) {
+    Int_Cache* cache = static_cast<Int_Cache*>(cache$);
+    int v;
+
+    for (int i = 0; i < 200000; ++i) {
+        int k = (i * 31) % 5000;
+        if (cache->get(std::to_string(k), v))
+            assert(v == k);
+        else
+            cache->put(std::to_string(k), k);
+    }
+
+    return nullptr;
+}
+
+void test_multi_threaded() {
+    Int_Cache cache{8, 2048, 1 << 20};
+    pthread_t threads[8];
+
+    for (auto& t : threads)
+        pthread_create(&t, nullptr, test_multi_threaded_aux0, &cache);
+    for (auto& t : threads)
+        pthread_join(t, nullptr);
+
+    assert(cache.size() <= 2048);
+    std::cout << "hits " << cache.get_hits() << " misses " << cache.get_misses() << " evictions "
+              << cache.get_evictions() << '\n';
+}
+
+int main() {
+
+    test_single_threaded();
+    test_multi_threaded();
+
+    std::cout << "all clock cache tests passed\n";
+}
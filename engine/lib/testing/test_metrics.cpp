@@ -0,0 +1,84 @@
+#include <cassert>
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../metrics.h"
+
+/*
+    build: g++ -std=c++17 -O2 -pthread test_metrics.cpp -o test_metrics
+*/
+
+void test_buckets() {
+    /* every value falls in a bucket whose limit is at least the value and within 1/8 of it */
+    uint64_t last = 0;
+    for (uint64_t value : {0ull, 1ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull, 1ull << 40, ~0ull}) {
+        size_t bucket = Metric_Histogram::bucket_of(value);
+        assert(bucket < Metric_Histogram::NUM_BUCKETS);
+        uint64_t limit = Metric_Histogram::bucket_limit(bucket);
+        assert(limit >= value);
+        assert(limit - value <= value / 8);
+        assert(bucket == 0 || Metric_Histogram::bucket_limit(bucket - 1) < value);
+        assert(limit >= last);
+        last = limit;
+    }
+}
+
+void test_threads_add_up() {
+    Metric_Counter counter;
+    Metric_Histogram histogram;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t)
+        threads.emplace_back([&] {
+            for (uint64_t i = 1; i <= 10000; ++i) {
+                ++counter;
+                histogram.record(i);
+            }
+        });
+    for (auto& thread : threads)
+        thread.join();
+
+    assert(counter.value() == 80000);
+    auto snapshot = histogram.snapshot();
+    assert(snapshot.count == 80000);
+    assert(snapshot.sum == 8 * 10000ull * 10001 / 2);
+
+    /* quantiles are bucket limits, so high by at most an eighth */
+    uint64_t median = snapshot.quantile(0.5);
+    assert(median >= 5000 && median <= 5000 + 5000 / 8);
+    assert(snapshot.quantile(1) >= 10000);
+}
+
+void test_render() {
+    Metrics& metrics = Metrics::get_instance();
+    metrics.counter("test_requests_total{path=\"/b\"}", "Requests") += 2;
+    metrics.counter("test_requests_total{path=\"/a\"}", "Requests") += 1;
+    metrics.gauge("test_depth", "Depth", [] { return 7; });
+    metrics.histogram("test_seconds", "Latency", 1e-3).record(1023);
+
+    std::string text = metrics.render();
+    std::cout << text;
+
+    /* one HELP and TYPE per family, however many labelled series it has */
+    assert(text.find("# TYPE test_requests_total counter\n") != std::string::npos);
+    assert(text.find("# HELP test_requests_total") == text.rfind("# HELP test_requests_total"));
+    assert(text.find("test_requests_total{path=\"/b\"} 2\n") != std::string::npos);
+    assert(text.find("test_depth 7\n") != std::string::npos);
+    assert(text.find("# TYPE test_seconds summary\n") != std::string::npos);
+    assert(text.find("test_seconds{quantile=\"0.5\"} 1.023\n") != std::string::npos);
+    assert(text.find("test_seconds_count 1\n") != std::string::npos);
+
+    /* families come out in name order */
+    assert(text.find("test_depth") < text.find("test_requests_total"));
+    assert(text.find("test_requests_total") < text.find("test_seconds"));
+}
+
+int main() {
+    test_buckets();
+    test_threads_add_up();
+    test_render();
+    std::cout << "all metrics tests passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,185 @@
+#include <cassert>
+#include <unistd.h>
+
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+#include "../mpmc_queue.h"
+
+void test_single_threaded() {
+    Bounded_MPMC_Queue<size_t> queue{3};
+
+    assert(queue.capacity() == 4 && queue.empty() && !queue.full());
+
+    size_t value = 0;
+    assert(!queue.try_pop(value));
+
+    for (size_t i = 1; i <= 4; ++i) {
+        value = i;
+        assert(queue.try_push(value));
+    }
+
+    assert(queue.full() && queue.size() == 4);
+    value = 5;
+    assert(!queue.try_push(value) && value == 5);
+
+    /* first in, first out, across the wrap-around */
+    for (size_t round = 0; round < 10; ++round) {
+        assert(queue.pop() == round + 1);
+        queue.push(round + 5);
+    }
+
+    for (size_t i = 11; i <= 14; ++i)
+        assert(queue.pop() == i);
+
+    assert(queue.empty());
+}
+
+constexpr size_t PRODUCERS = 4;
+constexpr size_t CONSUMERS = 4;
+constexpr size_t PER_PRODUCER = 200000;
+
+struct Shared {
+    Bounded_MPMC_Queue<size_t> queue{64};
+    std::atomic<size_t> sum{0};
+    std::atomic<size_t> popped{0};
+    std::atomic<bool> order_ok{true};
+};
+
+struct Producer_Args {
+    Shared* shared;
+    size_t id;
+};
+
+void* producer(void* arg) {
+    auto args = static_cast<Producer_Args*>(arg);
+
+    /* the producer id goes in the top bits so consumers can check per-producer order */
+    for (size_t i = 1; i <= PER_PRODUCER; ++i)
+        args->shared->queue.push((args->id << 32) | i);
+
+    return nullptr;
+}
+
+void* consumer(void* arg) {
+    auto shared = static_cast<Shared*>(arg);
+    size_t last[PRODUCERS] = {};
+
+    while (true) {
+        size_t value = shared->queue.pop();
+        if (value == 0)
+            break;
+
+        size_t id = value >> 32, seq = value & 0xFFFFFFFF;
+        if (seq <= last[id])
+            shared->order_ok = false;
+        last[id] = seq;
+
+        shared->sum += seq;
+        ++shared->popped;
+    }
+
+    return nullptr;
+}
+
+void test_multi_threaded() {
+    Shared shared;
+    pthread_t producers[PRODUCERS], consumers[CONSUMERS];
+    Producer_Args args[PRODUCERS];
+
+    for (size_t i = 0; i < CONSUMERS; ++i)
+        pthread_create(&consumers[i], nullptr, consumer, &shared);
+    for (size_t i = 0; i < PRODUCERS; ++i) {
+        args[i] = {&shared, i};
+        pthread_create(&producers[i], nullptr, producer, &args[i]);
+    }
+
+    for (size_t i = 0; i < PRODUCERS; ++i)
+        pthread_join(producers[i], nullptr);
+    for (size_t i = 0; i < CONSUMERS; ++i)
+        shared.queue.push(0);
+    for (size_t i = 0; i < CONSUMERS; ++i)
+        pthread_join(consumers[i], nullptr);
+
+    assert(shared.popped == PRODUCERS * PER_PRODUCER);
+    assert(shared.sum == PRODUCERS * PER_PRODUCER * (PER_PRODUCER + 1) / 2);
+    assert(shared.order_ok);
+    assert(shared.queue.empty());
+}
+
+void* blocked_pop(void* arg) {
+    static_cast<Bounded_MPMC_Queue<size_t>*>(arg)->pop();
+    return nullptr;
+}
+
+void test_cancel_waiter() {
+    Bounded_MPMC_Queue<size_t> queue{2};
+
+    /* a waiter cancelled in pop must release the queue for everyone else */
+    pthread_t waiter;
+    pthread_create(&waiter, nullptr, blocked_pop, &queue);
+    usleep(10000);
+    pthread_cancel(waiter);
+    pthread_join(waiter, nullptr);
+
+    queue.push(7);
+    assert(queue.pop() == 7);
+}
+
+void test_pop_until() {
+    Bounded_MPMC_Queue<size_t> queue{2};
+
+    /* an empty queue gives up at the deadline, not before */
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += 20000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+    }
+    size_t value = 3;
+    assert(!queue.pop_until(value, deadline) && value == 3);
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    assert(now.tv_sec > deadline.tv_sec || (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec));
+
+    /* a value already queued comes out even past the deadline */
+    queue.push(9);
+    assert(queue.pop_until(value, deadline) && value == 9);
+}
+
+void test_push_until() {
+    Bounded_MPMC_Queue<size_t> queue{2};
+    queue.push(1);
+    queue.push(2);
+
+    /* a full queue gives up at the deadline, leaving the value with the caller */
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += 20000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+    }
+    size_t value = 3;
+    assert(!queue.push_until(value, deadline) && value == 3);
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    assert(now.tv_sec > deadline.tv_sec || (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec));
+
+    /* room made goes to it even past the deadline */
+    assert(queue.pop() == 1);
+    assert(queue.push_until(value, deadline));
+    assert(queue.pop() == 2 && queue.pop() == 3);
+}
+
+int main() {
+    test_single_threaded();
+    test_multi_threaded();
+    test_cancel_waiter();
+    test_pop_until();
+    test_push_until();
+
+    std::cout << "all tests passed" << std::endl;
+}
@@ -0,0 +1,67 @@
+#include <cassert>
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../tournament_tree.h"
+
+/*
+    build: g++ -std=c++17 -O2 test_tournament_tree.cpp -o test_tournament_tree
+*/
+
+std::vector<int> merge_all(const std::vector<std::vector<int>>& runs) {
+    std::vector<int> merged;
+    Tournament_Tree<int, std::greater<int>> tree(runs);
+    while (!tree.empty()) {
+        merged.push_back(tree.top());
+        tree.pop();
+    }
+    return merged;
+}
+
+void test_edges() {
+    assert(merge_all({}).empty());
+    assert(merge_all({{}}).empty());
+    assert(merge_all({{}, {}, {}}).empty());
+    assert((merge_all({{3, 2, 1}}) == std::vector<int>{3, 2, 1}));
+    assert((merge_all({{}, {5, 1}, {}}) == std::vector<int>{5, 1}));
+}
+
+void test_matches_sort() {
+    std::mt19937 rng(7);
+    for (int trial = 0; trial < 200; ++trial) {
+        std::vector<std::vector<int>> runs(1 + rng() % 37);
+        std::vector<int> expected;
+        for (auto& run : runs) {
+            run.resize(rng() % 12);
+            for (auto& x : run)
+                x = rng() % 100;
+            std::sort(run.begin(), run.end(), std::greater<int>());
+            expected.insert(expected.end(), run.begin(), run.end());
+        }
+        std::sort(expected.begin(), expected.end(), std::greater<int>());
+        assert(merge_all(runs) == expected);
+    }
+}
+
+void test_ties_take_earlier_run() {
+    std::vector<std::vector<std::pair<int, int>>> runs = {{{1, 0}}, {{1, 1}}, {{1, 2}}};
+    auto by_score = [](const std::pair<int, int>& a, const std::pair<int, int>& b) { return a.first > b.first; };
+    Tournament_Tree<std::pair<int, int>, decltype(by_score)> tree(runs, by_score);
+    for (int run = 0; run < 3; ++run) {
+        assert(tree.top().second == run);
+        tree.pop();
+    }
+    assert(tree.empty());
+}
+
+int main() {
+    test_edges();
+    test_matches_sort();
+    test_ties_take_earlier_run();
+    std::cout << "all tournament tree tests passed" << std::endl;
+    return 0;
+}
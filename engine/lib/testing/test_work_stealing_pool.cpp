@@ -0,0 +1,77 @@
+#include <cassert>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "../work_stealing_pool.h"
+
+/*
+    build: g++ -std=c++17 -O2 -pthread test_work_stealing_pool.cpp -o test_work_stealing_pool
+*/
+
+void test_runs_everything() {
+    std::atomic<size_t> sum{0};
+    {
+        Work_Stealing_Pool pool(4, 64);
+        for (size_t i = 1; i <= 10000; ++i)
+            pool.submit([&sum, i] { sum += i; });
+    } /* the destructor runs what is left */
+    assert(sum == 10000 * 10001 / 2);
+}
+
+void test_nested_and_stealing() {
+    /* one task fans out onto its own worker's deque; the idle workers must steal to help */
+    std::atomic<size_t> done{0};
+    Work_Stealing_Pool pool(4, 16);
+    pool.submit([&] {
+        for (int i = 0; i < 1000; ++i)
+            pool.submit([&] {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+                ++done;
+            });
+    });
+    while (done < 1000)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    assert(pool.steals() > 0);
+}
+
+void test_backpressure() {
+    /* with every worker busy and the queue full, an outside submit waits for room */
+    std::atomic<bool> release{false};
+    std::atomic<int> started{0};
+    Work_Stealing_Pool pool(2, 2);
+    for (int i = 0; i < 2; ++i)
+        pool.submit([&] {
+            ++started;
+            while (!release)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        });
+    while (started < 2)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    pool.submit([] {});
+    pool.submit([] {});
+    assert(pool.pending_tasks() == 2);
+
+    std::atomic<bool> submitted{false};
+    std::thread blocked([&] {
+        pool.submit([] {});
+        submitted = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    assert(!submitted);
+
+    release = true;
+    blocked.join();
+    assert(submitted);
+}
+
+int main() {
+    test_runs_everything();
+    test_nested_and_stealing();
+    test_backpressure();
+    std::cout << "All tests passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,75 @@
+#ifndef TOURNAMENT_TREE_H
+#define TOURNAMENT_TREE_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/**
+ * @brief Merges k runs, each sorted best first, by playing their heads off in a tournament. Building the tree takes
+ * O(k) comparisons and each pop replays only the popped run's path to the root, so taking n items costs O(k + n log k)
+ * instead of the O(nk) of scanning every head for each item
+ * @note the runs are read in place and must outlive the tree
+ */
+template <typename T, typename Better = std::less<T>>
+class Tournament_Tree {
+private:
+
+    static constexpr size_t NONE = static_cast<size_t>(-1);
+
+    const std::vector<std::vector<T>>& runs;
+    Better better;
+    std::vector<size_t> next;       // the position of each run's head
+    std::vector<size_t> winners;    // winners[1] is the overall winner; leaves start at winners[leaves]
+    size_t leaves;
+
+    size_t play(size_t a, size_t b) const {
+        if (a == NONE || next[a] == runs[a].size())
+            return b;
+        if (b == NONE || next[b] == runs[b].size())
+            return a;
+        return better(runs[b][next[b]], runs[a][next[a]]) ? b : a;
+    }
+
+public:
+
+    /**
+     * @param runs the runs to merge, each sorted so that better(x, y) holds when x comes before y
+     */
+    Tournament_Tree(const std::vector<std::vector<T>>& runs, Better better = Better())
+        : runs(runs), better(better), next(runs.size(), 0) {
+        leaves = 1;
+        while (leaves < runs.size())
+            leaves <<= 1;
+
+        winners.assign(2 * leaves, NONE);
+        for (size_t i = 0; i < runs.size(); ++i)
+            winners[leaves + i] = i;
+        for (size_t node = leaves - 1; node > 0; --node)
+            winners[node] = play(winners[2 * node], winners[2 * node + 1]);
+    }
+
+    bool empty() const {
+        size_t winner = winners[1];
+        return winner == NONE || next[winner] == runs[winner].size();
+    }
+
+    /**
+     * @pre !empty()
+     */
+    const T& top() const {
+        return runs[winners[1]][next[winners[1]]];
+    }
+
+    /**
+     * @pre !empty()
+     */
+    void pop() {
+        size_t run = winners[1];
+        ++next[run];
+        for (size_t node = (leaves + run) / 2; node > 0; node /= 2)
+            winners[node] = play(winners[2 * node], winners[2 * node + 1]);
+    }
+};
+
+#endif /* TOURNAMENT_TREE_H */
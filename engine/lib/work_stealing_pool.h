@@ -0,0 +1,225 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "cv.h"
+#include "mutex.h"
+
+/**
+ * @brief A fixed set of worker threads, one per core by default, each with its own deque of tasks. A worker runs its
+ * own tasks oldest first and, when it has none, steals the newest task of another worker, so a worker stuck on a long
+ * task holds up only that task while the others drain its deque. Tasks submitted from outside the pool are dealt to
+ * the workers in turn; tasks submitted by a task go to its own worker
+ * @note submit blocks callers outside the pool while capacity tasks are waiting, which is how the stage feeding the
+ * pool feels backpressure. Tasks submitted from inside the pool never block, so workers cannot deadlock on each other
+ * @note tasks are not cancelled or preempted; a task that may run long should check a deadline of its own
+ */
+class Work_Stealing_Pool {
+public:
+
+    using Task = std::function<void()>;
+
+private:
+
+    struct alignas(64) Worker {
+        Work_Stealing_Pool* pool;
+        size_t index;
+        pthread_t thread;
+        Mutex mutex;
+        std::deque<Task> tasks;
+        std::atomic<uint64_t> busy_ns{0};
+    };
+
+    inline static uint64_t now_ns() {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    const size_t capacity;
+
+    alignas(64) std::atomic<size_t> pending{0};        // submitted and not yet taken by a worker
+    std::atomic<size_t> next_worker{0};
+    std::atomic<size_t> num_steals{0};
+    std::atomic<bool> stopping{false};
+
+    alignas(64) Mutex mut_wait;
+    CV cv_work;
+    CV cv_room;
+    std::atomic<size_t> sleeping{0};
+    std::atomic<size_t> waiting_submit{0};
+
+    inline static thread_local Worker* current = nullptr;
+
+    /**
+     * @brief takes the oldest task of self or else the newest task of another worker
+     */
+    bool take(Worker& self, Task& task) {
+        {
+            Lock_Guard<Mutex, &Mutex::lock> guard(self.mutex);
+            if (!self.tasks.empty()) {
+                task = std::move(self.tasks.front());
+                self.tasks.pop_front();
+                return true;
+            }
+        }
+
+        for (size_t i = 1; i < workers.size(); ++i) {
+            Worker& victim = *workers[(self.index + i) % workers.size()];
+            Lock_Guard<Mutex, &Mutex::lock> guard(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.back());
+                victim.tasks.pop_back();
+                num_steals.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void* run(void* arg) {
+        auto& self = *static_cast<Worker*>(arg);
+        auto& pool = *self.pool;
+        current = &self;
+
+        while (true) {
+            Task task;
+            if (pool.take(self, task)) {
+                pool.pending.fetch_sub(1);
+                if (pool.waiting_submit.load()) {
+                    Lock_Guard<Mutex, &Mutex::lock> guard(pool.mut_wait);
+                    pool.cv_room.signal();
+                }
+                uint64_t begin = now_ns();
+                task();
+                self.busy_ns.fetch_add(now_ns() - begin, std::memory_order_relaxed);
+                continue;
+            }
+
+            // pending counts a task from just before it is pushed, so it may be nonzero with every deque still
+            // empty for a moment; the loop then simply looks again
+            Lock_Guard<Mutex, &Mutex::lock> guard(pool.mut_wait);
+            pool.sleeping.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            while (pool.pending.load() == 0 && !pool.stopping.load())
+                pool.cv_work.wait(pool.mut_wait);
+            pool.sleeping.fetch_sub(1);
+
+            if (pool.stopping.load() && pool.pending.load() == 0)
+                return nullptr;
+        }
+    }
+
+public:
+
+    /**
+     * @param num_workers the number of threads, or 0 for one per online core
+     * @param capacity how many tasks may wait before submit blocks callers outside the pool
+     */
+    Work_Stealing_Pool(size_t num_workers, size_t capacity) : capacity(capacity ? capacity : 1) {
+        if (num_workers == 0) {
+            long cores = sysconf(_SC_NPROCESSORS_ONLN);
+            num_workers = cores > 0 ? cores : 1;
+        }
+
+        for (size_t i = 0; i < num_workers; ++i) {
+            workers.push_back(std::make_unique<Worker>());
+            workers.back()->pool = this;
+            workers.back()->index = i;
+        }
+        for (auto& worker : workers)
+            pthread_create(&worker->thread, nullptr, run, worker.get());
+    }
+
+    /**
+     * @brief runs every task already submitted, then stops the workers
+     */
+    ~Work_Stealing_Pool() {
+        {
+            Lock_Guard<Mutex, &Mutex::lock> guard(mut_wait);
+            stopping.store(true);
+            cv_work.broadcast();
+        }
+        for (auto& worker : workers)
+            pthread_join(worker->thread, nullptr);
+    }
+
+    Work_Stealing_Pool(const Work_Stealing_Pool&) = delete;
+    Work_Stealing_Pool& operator=(const Work_Stealing_Pool&) = delete;
+
+    void submit(Task task) {
+        bool inside = current && current->pool == this;
+
+        if (inside) {
+            pending.fetch_add(1);
+        } else {
+            size_t n = pending.load();
+            while (true) {
+                if (n < capacity) {
+                    if (pending.compare_exchange_weak(n, n + 1))
+                        break;
+                    continue;
+                }
+
+                Lock_Guard<Mutex, &Mutex::lock> guard(mut_wait);
+                waiting_submit.fetch_add(1);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                while (pending.load() >= capacity)
+                    cv_room.wait(mut_wait);
+                waiting_submit.fetch_sub(1);
+                n = pending.load();
+            }
+        }
+
+        Worker& target = inside ? *current : *workers[next_worker.fetch_add(1, std::memory_order_relaxed) % workers.size()];
+        {
+            Lock_Guard<Mutex, &Mutex::lock> guard(target.mutex);
+            target.tasks.push_back(std::move(task));
+        }
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load()) {
+            Lock_Guard<Mutex, &Mutex::lock> guard(mut_wait);
+            cv_work.signal();
+        }
+    }
+
+    /**
+     * @brief tasks submitted and not yet started
+     */
+    size_t pending_tasks() const {
+        return pending.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief tasks a worker took from another worker's deque, since the pool started
+     */
+    size_t steals() const {
+        return num_steals.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief nanoseconds worker has spent running tasks, since the pool started
+     */
+    uint64_t busy_ns(size_t worker) const {
+        return workers[worker]->busy_ns.load(std::memory_order_relaxed);
+    }
+
+    size_t size() const {
+        return workers.size();
+    }
+};
+
+#endif /* WORK_STEALING_POOL_H */
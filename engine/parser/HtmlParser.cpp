@@ -11,27 +11,17 @@
 #include <cstdlib>
 #include <unistd.h>
 #include <cstring>
-#include <sstream>
 #include <string>
 #include "HtmlParser.h"
+#include "HtmlScan.h"
 #include "HtmlTags.h"
 
 using std::string;
 
 //int debugCounter = 0;
 
-inline void stringToLower(char* buffer, size_t length) {
-    auto end = buffer + length;
-    for (; buffer < end; ++buffer) {
-        if ('A' <= *buffer && *buffer <= 'Z') {
-            *buffer += 'a' - 'A';
-        }
-    }
-}
-
-inline bool IsWhitespace(char c) {
-    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
-}
+using HtmlScan::IsWhitespace;
+using HtmlScan::Scan;
 
 inline uint8_t convert_flags(bool inBold, bool inHeading, bool inLargeFont) {
     uint8_t flags = 0;
@@ -41,6 +31,73 @@ inline uint8_t convert_flags(bool inBold, bool inHeading, bool inLargeFont) {
     return flags;
 }
 
+// istream >> word splits on the same set
+inline bool IsStreamWhitespace(char c) {
+    return IsWhitespace(c) || c == '\v' || c == '\f';
+}
+
+inline Span MakeSpan(const char* text, const char* start, size_t length) {
+    return Span{ static_cast<uint32_t>(start - text), static_cast<uint32_t>(length) };
+}
+
+// A span for a word of the input.  A streaming parse's input does not stay
+// around, so it copies the word to the end of page, unless it was copied
+// already, as anchor text is and as the words of a run of text are (see
+// ParseText).
+Span HtmlParser::Keep(const char* start, size_t length) {
+    if (!streaming)
+        return MakeSpan(text, start, length);
+    if (start < keptFrom || start + length > keptTo) {
+        keptFrom = start;
+        keptTo = start + length;
+        keptAt = page.size();
+        page.append(start, length);
+    }
+    return Span{ keptAt + static_cast<uint32_t>(start - keptFrom), static_cast<uint32_t>(length) };
+}
+
+void HtmlParser::EmitWord(const char* start, size_t length, uint8_t flags) {
+    if (compact) {
+        wordSpans.push_back(Keep(start, length));
+        wordFlags.push_back(flags);
+    } else {
+        words_flags.push_back(WFs(string(start, length), flags));
+    }
+}
+
+void HtmlParser::EmitTitleWord(const char* start, size_t length) {
+    if (compact)
+        titleSpans.push_back(Keep(start, length));
+    else
+        titleWords.emplace_back(start, length);
+}
+
+void HtmlParser::EmitAnchorWord(const char* start, size_t length) {
+    if (compact)
+        anchorSpans.push_back(AnchorSpan{ static_cast<uint32_t>(links.size() - 1), Keep(start, length) });
+    else
+        links.back().anchorText.emplace_back(start, length);
+}
+
+void HtmlParser::PopWord() {
+    if (compact) {
+        wordSpans.pop_back();
+        wordFlags.pop_back();
+    } else {
+        words_flags.pop_back();
+    }
+}
+
+// Removes the last anchor word of the current link, if it has any.
+void HtmlParser::PopAnchorWord() {
+    if (compact) {
+        if (!anchorSpans.empty() && anchorSpans.back().link == links.size() - 1)
+            anchorSpans.pop_back();
+    } else if (links.back().anchorText.size()) {
+        links.back().anchorText.pop_back();
+    }
+}
+
 inline string ExtractAttribute(const string& tagContent, const string& attribute) {
     string key = attribute + "=\"";
     size_t start = tagContent.find(key);
@@ -55,63 +112,65 @@ inline string ExtractAttribute(const string& tagContent, const string& attribute
 }
 
 const char* FindHrefAttribute(const char* ptr, const char* tagEnd) {
-    const char* nextH = strchr(ptr, 'h');
-    while (nextH && nextH < tagEnd) {
-        if (strncmp(nextH, "href=\"", 6) == 0) {
+    const char* nextH = HtmlScan::Find(ptr, tagEnd, 'h');
+    while (nextH < tagEnd) {
+        if (tagEnd - nextH >= 6 && memcmp(nextH, "href=\"", 6) == 0) {
             return nextH + 6;
         }
-        nextH = strchr(nextH + 1, 'h');
+        nextH = HtmlScan::Find(nextH + 1, tagEnd, 'h');
     }
     return nullptr;
 }
 
+// Returns the character after the next '>', or bufferEnd if there is none.
+inline char* HtmlParser::SkipPastTag(char* ptr) const {
+    ptr = Scan<HtmlScan::GreaterThan>(ptr, bufferEnd);
+    return ptr < bufferEnd ? ptr + 1 : const_cast<char*>(bufferEnd);
+}
+
 void HtmlParser::ParseTag(char*& ptr, string& tagDiscarding, bool& inTitle, bool& inAnchor, bool& inDiscardSection, bool& inHeading, bool& inBold, DesiredAction& discardType, string& currentLink) {
-    pthread_testcancel();
     ++ptr;
-    while (IsWhitespace(*ptr)) ++ptr;
+    ptr = Scan<HtmlScan::NotWhitespace>(ptr, bufferEnd);
     const char* start = ptr;
-    while (*ptr && !IsWhitespace(*ptr) && *ptr != '>')
-        ++ptr;
+    ptr = Scan<HtmlScan::Whitespace | HtmlScan::GreaterThan>(ptr, bufferEnd);
 
-    // currently, closing tag names are as such "/head", "/div", thats fine but if they are recognized closing tags
-    // they should not be treated the same as unrecognized closing tags
-    string tagName(start, ptr - start);
-    if (*start == '/'){
-        tagName = string(start + 1, ptr - start - 1);
-    }
-    if (!tagName.empty() && tagName.back() == '/') {
-        tagName.pop_back();
+    // closing tag names are looked up without their '/', so that recognized closing tags are not treated
+    // the same as unrecognized ones; a self-closing '/' is dropped as well
+    const char* name = *start == '/' ? start + 1 : start;
+    size_t nameLength = ptr - name;
+    if (nameLength && name[nameLength - 1] == '/') {
+        --nameLength;
     }
 
-    //std::cout << "tag found: " << tagName << '\n';
-    DesiredAction action = LookupPossibleTag(tagName.c_str(), tagName.c_str() + tagName.length());
+    TagInfo tag = LookupTag(name, nameLength);
+    DesiredAction action = tag.action;
 
-    if (tagName == "b") {
+    if (tag.style & TagInfo::Bold) {
         inBold = true;
     }
-    else if (tagName == "h1" || tagName == "h2" || tagName == "h3" || tagName == "h4" || tagName == "h5" || tagName == "h6") {
+    else if (tag.style & TagInfo::Heading) {
         inHeading = true;
     }
 
     //it is a recognized closing tag
     if (*start == '/' && action != DesiredAction::OrdinaryText){
-
-        while (*ptr && *ptr != '>')
-            ++ptr;
-        if (*ptr == '>') ++ptr;
+        ptr = SkipPastTag(ptr);
         return;
     }
 
     if (action == DesiredAction::DiscardSection){
-        tagDiscarding = tagName;
+        tagDiscarding.assign(name, nameLength);
         inDiscardSection = true, discardType = action;
 
         //std::cout << "entering discard section\n";
     }
     else if (action == DesiredAction::Comment){
-        while (*ptr && !(ptr[0] == '-' && ptr[1] == '-' && ptr[2] == '>'))
-            ++ptr;
-        if (*ptr) ptr += 3;
+        // the first "-->" starting at or after ptr: look for '>' and check the two characters before it
+        char* close = bufferEnd - ptr >= 2 ? ptr + 2 : const_cast<char*>(bufferEnd);
+        while ((close = Scan<HtmlScan::GreaterThan>(close, bufferEnd)) < bufferEnd
+               && !(close[-1] == '-' && close[-2] == '-'))
+            ++close;
+        ptr = close < bufferEnd ? close + 1 : const_cast<char*>(bufferEnd);
         return;
     }
     else if (action == DesiredAction::Title){
@@ -121,20 +180,25 @@ void HtmlParser::ParseTag(char*& ptr, string& tagDiscarding, bool& inTitle, bool
         // Find the actual ending tag
         char* tagEnd = ptr;
         bool inQuotes = false;
-        
-        while (*tagEnd) {
-            if (*tagEnd == '"') {
+
+        while (tagEnd < bufferEnd) {
+            if (inQuotes) {
+                tagEnd = HtmlScan::Find(tagEnd, bufferEnd, '"');
+            } else {
+                tagEnd = Scan<HtmlScan::Quote | HtmlScan::GreaterThan>(tagEnd, bufferEnd);
+                if (tagEnd < bufferEnd && *tagEnd == '>')
+                    break;
+            }
+            if (tagEnd < bufferEnd) {
                 inQuotes = !inQuotes;
-            } else if (*tagEnd == '>' && !inQuotes) {
-                break;
+                ++tagEnd;
             }
-            ++tagEnd;
         }
-        if (*tagEnd == '>') {
+        if (tagEnd < bufferEnd) {
             const char* hrefPos = FindHrefAttribute(ptr, tagEnd);
             if (hrefPos) {
-                const char* endQuote = strchr(hrefPos, '"');
-                if (endQuote && endQuote < tagEnd) {
+                const char* endQuote = HtmlScan::Find(hrefPos, tagEnd, '"');
+                if (endQuote < tagEnd) {
                     std::string href(hrefPos, endQuote - hrefPos);
                     if (!href.empty()) {
                         links.emplace_back(href);
@@ -147,15 +211,15 @@ void HtmlParser::ParseTag(char*& ptr, string& tagDiscarding, bool& inTitle, bool
         ptr = tagEnd;
     }
     else if (action == DesiredAction::Base && base.empty()){
-        const char* endPtr = strchr(ptr, '>');
-        if (endPtr && *(endPtr - 1) == '/')
+        const char* endPtr = Scan<HtmlScan::GreaterThan>(ptr, bufferEnd);
+        if (endPtr > ptr && *(endPtr - 1) == '/')
             --endPtr;
         base = ExtractAttribute(string(ptr, endPtr - ptr), "href");
         
     } 
     else if (action == DesiredAction::Embed) {
-        auto endPtr = strchr(ptr, '>');
-        if (!endPtr) {
+        auto endPtr = Scan<HtmlScan::GreaterThan>(ptr, bufferEnd);
+        if (endPtr == bufferEnd) {
             ptr = nullptr;
             return;
         }
@@ -168,35 +232,43 @@ void HtmlParser::ParseTag(char*& ptr, string& tagDiscarding, bool& inTitle, bool
 
         // FOR HANDLING BROKEN HTML
         // check if the tag is just literally unclosed
-        // std::cout << "tag found, why are you in ordinary text: " << tagName << '\n';
+        // std::cout << "tag found, why are you in ordinary text: " << string(name, nameLength) << '\n';
         const char* tagStart = start - 1;
-        const char* nextLT = strchr(ptr, '<');
-        char* nextGT = strchr(ptr, '>');
+        char* nextGT = Scan<HtmlScan::LessThan | HtmlScan::GreaterThan>(ptr, bufferEnd);
 
-        if (!nextGT || (nextLT && nextLT < nextGT)) {
+        if (nextGT == bufferEnd || *nextGT == '<') {
             // add the broken UNCLOSED tag as a word or title word ig
+            // looks back no further than the length of the rest of the page (historically
+            // ptr - strlen(ptr)), clamped to the start of the buffer
+            size_t remaining = bufferEnd - ptr;
+            const char* lookBackLimit = static_cast<size_t>(ptr - text) > remaining && !moreInput ? ptr - remaining : text;
             const char* lookBack = tagStart - 1;
-            while (lookBack >= ptr - strlen(ptr) && !IsWhitespace(*lookBack) && *lookBack != '<') {
+            while (lookBack >= lookBackLimit && !IsWhitespace(*lookBack) && *lookBack != '<') {
                 --lookBack;
             }
             ++lookBack;
-            std::string combinedWord;
-            if (!words_flags.empty() && lookBack < tagStart) {
-                combinedWord = std::string(lookBack, ptr - lookBack);
-                words_flags.pop_back();
+            if (moreInput && static_cast<size_t>(ptr - lookBack) > remaining) {
+                // the rest of the page might be short enough to limit the look back; wait until it is known
+                ptr = nullptr;
+                return;
+            }
+            const char* combinedStart;
+            if (WordCount() && lookBack < tagStart) {
+                combinedStart = lookBack;
+                PopWord();
             } else {
-                combinedWord = std::string(tagStart, ptr - tagStart);
+                combinedStart = tagStart;
             }
+            size_t combinedLength = ptr - combinedStart;
             //std::cout<<"word added from parse TAG" << combinedWord << '\n';
             if (inAnchor && !currentLink.empty()){
-                if (links.back().anchorText.size())
-                    links.back().anchorText.pop_back();
-                links.back().anchorText.push_back(combinedWord);
+                PopAnchorWord();
+                EmitAnchorWord(combinedStart, combinedLength);
             }
             if (inTitle) {
-                titleWords.push_back(combinedWord);
+                EmitTitleWord(combinedStart, combinedLength);
             } else {
-                words_flags.push_back(WFs(combinedWord, convert_flags(inBold, inHeading, false)));
+                EmitWord(combinedStart, combinedLength, convert_flags(inBold, inHeading, false));
             }
 
 
@@ -205,15 +277,21 @@ void HtmlParser::ParseTag(char*& ptr, string& tagDiscarding, bool& inTitle, bool
             return;
         }
         else {
-            std::string unrecognizedTag(tagStart, nextGT - tagStart + 1);
-            std::istringstream stream(unrecognizedTag);
-            std::string word;
-            while (stream >> word) {
-                if (inTitle) {
-                    titleWords.push_back(word);
-                } else {
-                    words_flags.push_back(WFs(word, convert_flags(inBold, inHeading, false)));
+            // split the unrecognized tag into words, including the '<' and '>'
+            const char* word = tagStart;
+            const char* tagEnd = nextGT + 1;
+            while (word < tagEnd) {
+                while (word < tagEnd && IsStreamWhitespace(*word)) ++word;
+                const char* wordEnd = word;
+                while (wordEnd < tagEnd && !IsStreamWhitespace(*wordEnd)) ++wordEnd;
+                if (word < wordEnd) {
+                    if (inTitle) {
+                        EmitTitleWord(word, wordEnd - word);
+                    } else {
+                        EmitWord(word, wordEnd - word, convert_flags(inBold, inHeading, false));
+                    }
                 }
+                word = wordEnd;
             }
 
             ptr = nextGT + 1;  // Move the pointer past the '>'
@@ -221,64 +299,48 @@ void HtmlParser::ParseTag(char*& ptr, string& tagDiscarding, bool& inTitle, bool
         }
     }
     else if (action == DesiredAction::HTML) {
-        for (; *ptr && *ptr != '>'; ++ptr) {
-            if (*ptr == 'l' && *(ptr + 1) == 'a' && *(ptr + 2) == 'n' && *(ptr + 3) == 'g' &&
-                *(ptr + 4) == '=' && *(ptr + 5) == '"') {
-                if (*(ptr + 6) == 'e' && *(ptr + 7) == 'n') {
+        for (; ptr < bufferEnd && *ptr != '>'; ++ptr) {
+            if (bufferEnd - ptr >= 6 && memcmp(ptr, "lang=\"", 6) == 0) {
+                if (bufferEnd - ptr >= 8 && *(ptr + 6) == 'e' && *(ptr + 7) == 'n') {
                     english = true;
                 } else {
                     english = false;
                 }
-                ptr += 8;
+                ptr = bufferEnd - ptr >= 8 ? ptr + 8 : const_cast<char*>(bufferEnd);
                 break;
             }
         }
     }
     //go to end of tag name
-    while (*ptr && *ptr != '>')
-        ++ptr;
-    if (*ptr == '>') ++ptr;
+    ptr = SkipPastTag(ptr);
 }
 
 inline void HtmlParser::ParseText(char*& ptr, bool inTitle, bool inAnchor, bool inHeading, bool inBold, const string& currentLink) {
-    const char* start = ptr;
-
-    while (*ptr && *ptr != '<') {
-        if (IsWhitespace(*ptr)) {
-            if (start != ptr) {
-                std::string word(start, ptr - start);
-                if (inAnchor && !currentLink.empty()) {
-                    links.back().anchorText.push_back(word);
-                }
-                if (inTitle) {
-                    titleWords.push_back(word);
-                } else {
-                    words_flags.push_back(WFs(word, convert_flags(inBold, inHeading, false)));
-                }
-            }
-            ++ptr;
-            while (IsWhitespace(*ptr)) ++ptr;
-            start = ptr;
-        } else {
-            ++ptr;
-        }
+    const char* textEnd = Scan<HtmlScan::LessThan>(ptr, bufferEnd);
+    const char* start = Scan<HtmlScan::NotWhitespace>(ptr, textEnd);
+    if (streaming && start < textEnd) {
+        // one copy of the run rather than one per word
+        Keep(start, textEnd - start);
     }
-    if (start != ptr) {
-        std::string word(start, ptr - start);
+
+    while (start < textEnd) {
+        const char* end = Scan<HtmlScan::Whitespace>(start, textEnd);
         if (inAnchor && !currentLink.empty()) {
-            links.back().anchorText.push_back(word);
+            EmitAnchorWord(start, end - start);
         }
         if (inTitle) {
-            titleWords.push_back(word);
+            EmitTitleWord(start, end - start);
         } else {
-            words_flags.push_back(WFs(word, convert_flags(inBold, inHeading, false)));
+            EmitWord(start, end - start, convert_flags(inBold, inHeading, false));
         }
+        start = Scan<HtmlScan::NotWhitespace>(end, textEnd);
     }
+    ptr = const_cast<char*>(textEnd);
 }
 
-inline char* FindFirstClosingTag(char* ptr, const char*& tagType, string& tagDiscarding, int& tagLength) {
-    char* nextTag = strchr(ptr, '<');
-    while (nextTag) {
+inline char* FindFirstClosingTag(char* ptr, const char* end, const char*& tagType, string& tagDiscarding, int& tagLength) {
+    char* nextTag = HtmlScan::Find(ptr, end, '<');
+    while (nextTag < end) {
         if (strncmp(nextTag, "</script>", 9) == 0 && "script" == tagDiscarding) {
             tagType = "</script>";
             tagLength = 9;
@@ -299,7 +361,7 @@ inline char* FindFirstClosingTag(char* ptr, const char*& tagType, string& tagDis
         //     tagLength = 16;
         //     return nextTag;
         // }
-        nextTag = strchr(nextTag + 1, '<');
+        nextTag = HtmlScan::Find(nextTag + 1, end, '<');
     }
     tagType = nullptr;
     tagLength = 0;
@@ -307,73 +369,259 @@ inline char* FindFirstClosingTag(char* ptr, const char*& tagType, string& tagDis
 }
 
 HtmlParser::HtmlParser(char* buffer, size_t length) {
+    Parse(buffer, length);
+}
+
+HtmlParser::HtmlParser(std::string&& html, Deadline deadline)
+    : compact(true), page(std::move(html)), deadline(deadline) {
+    Parse(page.data(), page.size());
+}
+
+HtmlParser::HtmlParser(std::chrono::nanoseconds budget, size_t maxBytes)
+    : compact(true), streaming(true), bytesLeft(maxBytes), budget(budget) {
+}
+
+inline bool HtmlParser::PastDeadline() {
+    if (--stepsUntilClock) {
+        return false;
+    }
+    stepsUntilClock = DeadlineStride;
+    if (deadline != NoDeadline && std::chrono::steady_clock::now() >= deadline) {
+        truncated = true;
+    }
+    return truncated;
+}
+
+void HtmlParser::Parse(char* buffer, size_t length) {
     char* ptr = buffer;
-    stringToLower(buffer, length);
-    std::string tagDiscarding = "";
-    bool inTitle = false, inAnchor = false, inDiscardSection = false, inHeading = false, inBold = false;
-    DesiredAction discardType;
-    string currentLink;
-
-    while (ptr && buffer <= ptr && ptr < buffer + length) {
-        pthread_testcancel();
-        if (*ptr == '<') {
-            if (ptr[1] == '/' && inTitle && strncmp(ptr + 2, "title", 5) == 0){
-                // close title tag
-                inTitle = false;
-                ptr = strchr(ptr, '>') + 1;
-            }
-            else if (ptr[1] == '/' && inAnchor && strncmp(ptr + 2, "a", 1) == 0){
-                // close anchor tag
-                inAnchor = false;
-                ptr = strchr(ptr, '>') + 1;
-            }
-            else if (ptr[1] == '/' && inHeading && ptr[2] == 'h' && ptr[3] >= '1' && ptr[3] <= '6'){
-                // close heading tag
-                inHeading = false;
-                ptr = strchr(ptr, '>') + 1;
+    text = buffer;
+    // the page is read as a C string, so it ends at the first NUL
+    bufferEnd = buffer + strnlen(buffer, length);
+    HtmlScan::ToLower(buffer, buffer + length);
+
+    while (ptr && buffer <= ptr && ptr < bufferEnd && !PastDeadline() && Step(ptr))
+        ;
+
+    JoinTitle();
+}
+
+// Parses the tag or run of text at ptr and moves ptr past it.  Returns false
+// if ptr is in a discard section that does not end in the buffer.
+bool HtmlParser::Step(char*& ptr) {
+    if (*ptr == '<') {
+        if (ptr[1] == '/' && state.inTitle && strncmp(ptr + 2, "title", 5) == 0){
+            // close title tag
+            state.inTitle = false;
+            ptr = SkipPastTag(ptr);
+        }
+        else if (ptr[1] == '/' && state.inAnchor && strncmp(ptr + 2, "a", 1) == 0){
+            // close anchor tag
+            state.inAnchor = false;
+            ptr = SkipPastTag(ptr);
+        }
+        else if (ptr[1] == '/' && state.inHeading && ptr[2] == 'h' && ptr[3] >= '1' && ptr[3] <= '6'){
+            // close heading tag
+            state.inHeading = false;
+            ptr = SkipPastTag(ptr);
+        }
+        else if (ptr[1] == '/' && state.inBold && strncmp(ptr + 2, "b", 1) == 0){
+            // close bold tag
+            state.inBold = false;
+            ptr = SkipPastTag(ptr);
+        }
+        else if (state.inDiscardSection) {
+            // how the discard section is exited
+            const char* tagType = nullptr;
+            int tagLength = 0;
+            char* closestEnd = FindFirstClosingTag(ptr, bufferEnd, tagType, state.tagDiscarding, tagLength);
+            if (!closestEnd) {
+                return false;
             }
-            else if (ptr[1] == '/' && inBold && strncmp(ptr + 2, "b", 1) == 0){
-                // close bold tag
-                inBold = false;
-                ptr = strchr(ptr, '>') + 1;
-                if (!ptr) {
-                    break;
-                }
+            ptr = closestEnd + tagLength;
+            state.inDiscardSection = false;
+        } else {
+            ParseTag(ptr, state.tagDiscarding, state.inTitle, state.inAnchor, state.inDiscardSection, state.inHeading,
+                     state.inBold, state.discardType, state.currentLink);
+        }
+    } else {
+        if (!state.inDiscardSection){
+            ParseText(ptr, state.inTitle, state.inAnchor, state.inHeading, state.inBold, state.currentLink);
+        }
+        else{
+            // in discard section, continue to the next tag
+            ptr = HtmlScan::Find(ptr, bufferEnd, '<');
+        }
+    }
+    return true;
+}
+
+void HtmlParser::Feed(const char* data, size_t length) {
+    if (ended || truncated) {
+        return;
+    }
+    if (length >= bytesLeft) {
+        length = bytesLeft;
+        ended = capped = true;
+    }
+    bytesLeft -= length;
+
+    // the page is read as a C string, so it ends at the first NUL
+    if (const void* nul = memchr(data, '\0', length)) {
+        length = static_cast<const char*>(nul) - data;
+        ended = true;
+    }
+
+    size_t old = pending.size();
+    pending.append(data, length);
+    HtmlScan::ToLower(pending.data() + old, pending.data() + pending.size());
+    Run(false);
+}
+
+void HtmlParser::Finish() {
+    if (!truncated) {
+        Run(true);
+    }
+    truncated |= capped;
+    pending = std::string();
+    JoinTitle();
+}
+
+// Parses pending from resume as far as the input allows: to its end if
+// final, otherwise up to the first step that might read past it.
+void HtmlParser::Run(bool final) {
+    auto begin = std::chrono::steady_clock::now();
+    deadline = begin + (budget - parseTime);
+    moreInput = !final;
+    text = pending.data();
+    bufferEnd = text + pending.size();
+    keptFrom = keptTo = nullptr;
+    char* ptr = pending.data() + resume;
+
+    // only the last few bytes of a discard section that runs on could begin its closing tag; the rest can go
+    auto discardTail = [this](char* ptr) {
+        char* tail = bufferEnd - ptr > 8 ? const_cast<char*>(bufferEnd) - 8 : ptr;
+        return HtmlScan::Find(tail, bufferEnd, '<');
+    };
+
+    while (ptr < bufferEnd && !PastDeadline()) {
+        if (seekingClose) {
+            // carry on the search Step began, rather than step through the tags it would have passed over
+            const char* tagType = nullptr;
+            int tagLength = 0;
+            char* closestEnd = FindFirstClosingTag(ptr, bufferEnd, tagType, state.tagDiscarding, tagLength);
+            if (!closestEnd) {
+                ptr = final ? ptr : discardTail(ptr);
+                break;
             }
-            else if (inDiscardSection) {
-                // how the discard section is exited
-                const char* tagType = nullptr;
-                int tagLength = 0;
-                // std::cout << "handling discard section" << tagType << "\n";
-                char* closestEnd = FindFirstClosingTag(ptr, tagType, tagDiscarding, tagLength);
-                if (closestEnd) {
-                    ptr = closestEnd + tagLength;
-                    // std::cout << "leaving discard section\n";
-                    inDiscardSection = false;
-                } else {
-                    break;
-                }
-            } else {
-                ParseTag(ptr, tagDiscarding, inTitle, inAnchor, inDiscardSection, inHeading, inBold, discardType, currentLink);
+            ptr = closestEnd + tagLength;
+            state.inDiscardSection = false;
+            seekingClose = false;
+            continue;
+        }
+        if (skippingTag) {
+            char* close = Scan<HtmlScan::GreaterThan>(ptr, bufferEnd);
+            skippingTag = close == bufferEnd;
+            ptr = skippingTag ? close : close + 1;
+            continue;
+        }
+
+        bool discarding = state.inDiscardSection && *ptr != '<';
+        if (!final) {
+            Save();
+        }
+        char* next = ptr;
+        if (!Step(next)) {
+            // unless "</title" could still be coming, Step got as far as searching for the closing tag
+            if (final || bufferEnd - ptr >= 7) {
+                seekingClose = true;
+                ptr = final ? ptr : discardTail(ptr);
             }
-        } else {
-            if (!inDiscardSection){
-                ParseText(ptr, inTitle, inAnchor, inHeading, inBold, currentLink);
+            break;
+        }
+
+        if (!final && !discarding && (!next || next >= bufferEnd)) {
+            if (bufferEnd - ptr <= static_cast<ptrdiff_t>(CarryLimit)) {
+                Restore();
+                break;
             }
-            else{
-                // in discard section, continue
-                ++ptr;
+            if (*ptr == '<') {
+                Restore();
+                skippingTag = true;
+                continue;
             }
+            // a run of text too long to hold is broken here
         }
+        if (!next) {
+            break;
+        }
+        ptr = next;
+    }
+
+    if (!final) {
+        // an unclosed tag joins the word right before it (see ParseTag), so keep that word
+        char* keep = ptr;
+        while (keep > text && ptr - keep < static_cast<ptrdiff_t>(CarryLimit) && !IsWhitespace(keep[-1])
+               && keep[-1] != '<') {
+            --keep;
+        }
+        resume = ptr - keep;
+        pending.erase(0, keep - text);
+    }
+    parseTime += std::chrono::steady_clock::now() - begin;
+}
+
+void HtmlParser::Save() {
+    checkpoint.inTitle = state.inTitle;
+    checkpoint.inAnchor = state.inAnchor;
+    checkpoint.inDiscardSection = state.inDiscardSection;
+    checkpoint.inHeading = state.inHeading;
+    checkpoint.inBold = state.inBold;
+    checkpoint.discardType = state.discardType;
+    checkpoint.hadLink = !state.currentLink.empty();
+    checkpoint.words = wordSpans.size();
+    checkpoint.titleWords = titleSpans.size();
+    checkpoint.anchorWords = anchorSpans.size();
+    checkpoint.links = links.size();
+    checkpoint.kept = page.size();
+    checkpoint.hadBase = !base.empty();
+    checkpoint.english = english;
+}
+
+void HtmlParser::Restore() {
+    state.inTitle = checkpoint.inTitle;
+    state.inAnchor = checkpoint.inAnchor;
+    state.inDiscardSection = checkpoint.inDiscardSection;
+    state.inHeading = checkpoint.inHeading;
+    state.inBold = checkpoint.inBold;
+    state.discardType = checkpoint.discardType;
+    if (!checkpoint.hadLink) {
+        state.currentLink.clear();
     }
+    wordSpans.resize(checkpoint.words);
+    wordFlags.resize(checkpoint.words);
+    titleSpans.resize(checkpoint.titleWords);
+    anchorSpans.resize(checkpoint.anchorWords);
+    links.erase(links.begin() + checkpoint.links, links.end());
+    page.resize(checkpoint.kept);
+    if (!checkpoint.hadBase) {
+        base.clear();
+    }
+    english = checkpoint.english;
+    keptFrom = keptTo = nullptr;
+}
 
-    // combine vector of title words into one string
-    if (titleWords.size() > 0) {
+// combine vector of title words into one string
+void HtmlParser::JoinTitle() {
+    if (compact) {
+        for (size_t i = 0; i < titleSpans.size(); ++i) {
+            if (i) title_chunk += ' ';
+            title_chunk += SpanText(titleSpans[i]);
+        }
+    }
+    else if (titleWords.size() > 0) {
         title_chunk = titleWords[0];
         for (size_t i = 1; i < titleWords.size(); ++i) {
             title_chunk += " " + titleWords[i];
         }
     }
-
-    //std::cout << "debug counter " << debugCounter << '\n';
 }
@@ -3,8 +3,10 @@
 
 #pragma once
 
+#include <chrono>
 #include <vector>
 #include <string>
+#include <string_view>
 #include "HtmlTags.h"
 #include <cstdint>
 
@@ -86,6 +88,18 @@ struct WFs {
     WFs(const std::string& w, uint8_t f) : word(w), flags(f) {}
 };
 
+// A word in compact mode, given by its offset and length in the page
+// buffer the parser owns.
+struct Span {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct AnchorSpan {
+    uint32_t link;      // index into links
+    Span span;
+};
+
 
 class HtmlParser {
 public:
@@ -96,9 +110,103 @@ public:
     std::string base;
     std::string pageURL;
     bool english = true;
+    bool truncated = false;     // the parse hit its deadline or byte cap; everything above holds what came before it
+    std::chrono::nanoseconds parseTime{0};     // spent in Feed and Finish, when streaming
+
+    // Compact mode: instead of a std::string per word, words, title words
+    // and anchor text are spans into page, and the word flags are packed
+    // into a parallel byte vector.  title_chunk, links and base are filled
+    // in as usual.  A streaming parse does not keep its input, so there page
+    // holds just the words, copied out as they are found.
+    bool compact = false;
+    std::string page;
+    std::vector<Span> wordSpans;
+    std::vector<uint8_t> wordFlags;
+    std::vector<Span> titleSpans;
+    std::vector<AnchorSpan> anchorSpans;
+
+    size_t WordCount() const {
+        return compact ? wordSpans.size() : words_flags.size();
+    }
+
+    size_t TitleWordCount() const {
+        return compact ? titleSpans.size() : titleWords.size();
+    }
+
+    std::string_view SpanText(Span span) const {
+        return std::string_view(page.data() + span.offset, span.length);
+    }
+
+    using Deadline = std::chrono::steady_clock::time_point;
+    static constexpr Deadline NoDeadline = Deadline::max();
 
 private:
-    // Your code here.
+    const char* text = nullptr;     // start of the buffer spans are relative to
+    const char* bufferEnd = nullptr;    // first NUL in the buffer; no scan goes past it
+
+    // The clock is read once every DeadlineStride steps of the parse loop.
+    static constexpr unsigned DeadlineStride = 256;
+    Deadline deadline = NoDeadline;
+    unsigned stepsUntilClock = DeadlineStride;
+
+    // Where the parse is in the page's structure, between steps.
+    struct State {
+        std::string tagDiscarding;
+        bool inTitle = false, inAnchor = false, inDiscardSection = false, inHeading = false, inBold = false;
+        DesiredAction discardType;
+        std::string currentLink;
+    };
+    State state;
+
+    // Streaming mode.  A step whose tag or text runs into the end of the
+    // input fed so far is undone and retried once more has arrived, so the
+    // result is that of parsing the whole page at once.  Only the unparsed
+    // tail of the input is held, up to CarryLimit bytes; a tag that is still
+    // open after that many is dropped, and a longer run of text is broken.
+    static constexpr size_t CarryLimit = 1 << 16;
+    bool streaming = false;
+    bool ended = false;             // a NUL or the byte cap ended the input; later bytes are ignored
+    bool capped = false;            // the byte cap did
+    bool skippingTag = false;       // dropping the rest of a tag too long to hold
+    bool moreInput = false;         // the page goes on past bufferEnd
+    bool seekingClose = false;      // in a discard section, past the '<' where the search for its closing tag began
+    std::string pending;            // the word before resume, then input not yet parsed
+    size_t resume = 0;
+    size_t bytesLeft = 0;           // input still allowed by the byte cap
+    std::chrono::nanoseconds budget{0};
+
+    // What a step may change, so that it can be undone.  Of the strings, only
+    // whether base and currentLink are empty matters; tagDiscarding is only
+    // set by a step that enters a discard section.
+    struct Checkpoint {
+        bool inTitle, inAnchor, inDiscardSection, inHeading, inBold;
+        DesiredAction discardType;
+        size_t words, titleWords, anchorWords, links, kept;
+        bool hadLink, hadBase, english;
+    };
+    Checkpoint checkpoint;
+    // The input last copied to page, and where it went.
+    const char* keptFrom = nullptr;
+    const char* keptTo = nullptr;
+    uint32_t keptAt = 0;
+
+    bool PastDeadline();
+
+    void Parse(char* buffer, size_t length);
+    bool Step(char*& ptr);
+    void Run(bool final);
+    void Save();
+    void Restore();
+    void JoinTitle();
+    Span Keep(const char* start, size_t length);
+    char* SkipPastTag(char* ptr) const;
+
+    void EmitWord(const char* start, size_t length, uint8_t flags);
+    void EmitTitleWord(const char* start, size_t length);
+    void EmitAnchorWord(const char* start, size_t length);
+    void PopWord();
+    void PopAnchorWord();
+
     void ParseTag(char*& ptr, string& tagDiscarding, bool& inTitle, bool& inAnchor, bool& inDiscardSection, bool& inHeading, bool& inBold, DesiredAction& discardType,
                   string& currentLink);
     void ParseText(char*& ptr, bool inTitle, bool inAnchor, bool inHeading, bool inBold, const string& currentLink);
@@ -109,4 +217,21 @@ public:
     // words in title, and links found on the page.
 
     HtmlParser(char* buffer, size_t length);   // Your code here
+
+    // An empty compact page, for one restored rather than parsed (see PageLog.h).
+    HtmlParser() = default;
+
+    // Compact mode: takes ownership of the page, so the spans stay valid
+    // for as long as the parser does.  A parse still running at deadline
+    // stops there and sets truncated, so one pathological page cannot hold
+    // a parse worker for long.
+    explicit HtmlParser(std::string&& html, Deadline deadline = NoDeadline);
+
+    // Streaming compact mode: the page is given to Feed in pieces as they
+    // arrive, and parsed as far as it can be each time, then Finish parses
+    // the rest.  At most maxBytes of the page are parsed, in at most budget
+    // of time spent inside Feed and Finish; either limit sets truncated.
+    HtmlParser(std::chrono::nanoseconds budget, size_t maxBytes);
+    void Feed(const char* data, size_t length);
+    void Finish();
 };
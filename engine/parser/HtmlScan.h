@@ -0,0 +1,190 @@
+// HtmlScan.h
+//
+// Vectorized character scanning for HtmlParser.  Each scan looks for the
+// first character in [ptr, end) belonging to a set of classes (tag
+// delimiters, quotes, whitespace) and returns end if there is none, so a
+// scan can never run past the tag or page it was given.
+//
+// x86-64 always has SSE2, which checks 16 bytes per step; building with
+// -mavx2 (make SIMD=avx2) checks 32.  Other targets use the scalar loop.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define HTML_SCAN_AVX2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HTML_SCAN_SSE2
+#endif
+
+namespace HtmlScan {
+
+enum Class : unsigned {
+    LessThan = 1,
+    GreaterThan = 2,
+    Quote = 4,
+    Whitespace = 8,         // ' ', '\t', '\n', '\r'
+    NotWhitespace = 16,     // must be used on its own
+};
+
+inline bool IsWhitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+template <unsigned Classes>
+inline bool Matches(char c) {
+    if constexpr (Classes == NotWhitespace)
+        return !IsWhitespace(c);
+    else
+        return ((Classes & LessThan) && c == '<') || ((Classes & GreaterThan) && c == '>')
+               || ((Classes & Quote) && c == '"') || ((Classes & Whitespace) && IsWhitespace(c));
+}
+
+template <unsigned Classes>
+inline const char* ScanScalar(const char* ptr, const char* end) {
+    while (ptr < end && !Matches<Classes>(*ptr))
+        ++ptr;
+    return ptr;
+}
+
+#if defined(HTML_SCAN_AVX2)
+
+template <unsigned Classes>
+inline uint32_t MatchMask(const char* ptr) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+    __m256i m = _mm256_setzero_si256();
+
+    if constexpr ((Classes & LessThan) != 0)
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('<')));
+    if constexpr ((Classes & GreaterThan) != 0)
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('>')));
+    if constexpr ((Classes & Quote) != 0)
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+    if constexpr ((Classes & (Whitespace | NotWhitespace)) != 0) {
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+    }
+
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(m));
+    return Classes == NotWhitespace ? ~mask : mask;
+}
+
+constexpr size_t Width = 32;
+
+#elif defined(HTML_SCAN_SSE2)
+
+template <unsigned Classes>
+inline uint32_t MatchMask(const char* ptr) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+    __m128i m = _mm_setzero_si128();
+
+    if constexpr ((Classes & LessThan) != 0)
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+    if constexpr ((Classes & GreaterThan) != 0)
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+    if constexpr ((Classes & Quote) != 0)
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+    if constexpr ((Classes & (Whitespace | NotWhitespace)) != 0) {
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+    }
+
+    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(m));
+    return Classes == NotWhitespace ? ~mask & 0xFFFF : mask;
+}
+
+constexpr size_t Width = 16;
+
+#endif
+
+// Returns the first character in [ptr, end) in one of the classes, or end.
+template <unsigned Classes>
+inline const char* Scan(const char* ptr, const char* end) {
+#if defined(HTML_SCAN_AVX2) || defined(HTML_SCAN_SSE2)
+    // most runs are short, so look at a few bytes before paying for a vector load
+    for (int i = 0; i < 4; ++i, ++ptr) {
+        if (ptr >= end || Matches<Classes>(*ptr))
+            return ptr;
+    }
+
+    while (end - ptr >= static_cast<ptrdiff_t>(Width)) {
+        uint32_t mask = MatchMask<Classes>(ptr);
+        if (mask)
+            return ptr + __builtin_ctz(mask);
+        ptr += Width;
+    }
+#endif
+    return ScanScalar<Classes>(ptr, end);
+}
+
+template <unsigned Classes>
+inline char* Scan(char* ptr, const char* end) {
+    return const_cast<char*>(Scan<Classes>(static_cast<const char*>(ptr), end));
+}
+
+// Returns the first c in [ptr, end), or end.
+inline const char* Find(const char* ptr, const char* end, char c) {
+#if defined(HTML_SCAN_AVX2)
+    const __m256i needle = _mm256_set1_epi8(c);
+    while (end - ptr >= static_cast<ptrdiff_t>(Width)) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle)));
+        if (mask)
+            return ptr + __builtin_ctz(mask);
+        ptr += Width;
+    }
+#elif defined(HTML_SCAN_SSE2)
+    const __m128i needle = _mm_set1_epi8(c);
+    while (end - ptr >= static_cast<ptrdiff_t>(Width)) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle)));
+        if (mask)
+            return ptr + __builtin_ctz(mask);
+        ptr += Width;
+    }
+#endif
+    while (ptr < end && *ptr != c)
+        ++ptr;
+    return ptr;
+}
+
+inline char* Find(char* ptr, const char* end, char c) {
+    return const_cast<char*>(Find(static_cast<const char*>(ptr), end, c));
+}
+
+// Lowercases the ASCII letters in [ptr, end).
+inline void ToLower(char* ptr, const char* end) {
+#if defined(HTML_SCAN_AVX2)
+    const __m256i a = _mm256_set1_epi8('A' - 1), z = _mm256_set1_epi8('Z' + 1), diff = _mm256_set1_epi8('a' - 'A');
+    while (end - ptr >= static_cast<ptrdiff_t>(Width)) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, a), _mm256_cmpgt_epi8(z, v));
+        v = _mm256_add_epi8(v, _mm256_and_si256(upper, diff));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(ptr), v);
+        ptr += Width;
+    }
+#elif defined(HTML_SCAN_SSE2)
+    const __m128i a = _mm_set1_epi8('A' - 1), z = _mm_set1_epi8('Z' + 1), diff = _mm_set1_epi8('a' - 'A');
+    while (end - ptr >= static_cast<ptrdiff_t>(Width)) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, a), _mm_cmpgt_epi8(z, v));
+        v = _mm_add_epi8(v, _mm_and_si128(upper, diff));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(ptr), v);
+        ptr += Width;
+    }
+#endif
+    for (; ptr < end; ++ptr) {
+        if ('A' <= *ptr && *ptr <= 'Z')
+            *ptr += 'a' - 'A';
+    }
+}
+
+} // namespace HtmlScan
@@ -1,61 +1,163 @@
 #include "HtmlTags.h"
 
-#include <cassert>
-#include <cstring>
-#include <iostream>
+#include <cstdint>
 
-#include <ctype.h>
+// LookupTag uses a perfect hash built at compile time from TagsRecognized
+// (hash and displace): a tag's hash picks one of BucketCount buckets, and
+// each bucket stores a displacement that is xor'ed into the hash to move
+// every tag in that bucket to its own slot of the table.  A lookup hashes the
+// name once, reads one slot, and compares at most one tag.
 
-template <typename T>
-inline T Min(const T& a, const T& b) {
-    return (a < b) ? a : b;
-}
+namespace {
+
+constexpr size_t TableSize = 256;       // power of two, about twice NumberOfTags
+constexpr size_t BucketCount = 64;      // power of two
 
-inline char ToLower(char c) {
+constexpr char ToLower(char c) {
     return 'A' <= c && c <= 'Z' ? c + 'a' - 'A' : c;
 }
 
-inline int CStringComp(const char* s1, const char* s2, size_t N) {
-    int count = 0;
-    while (count < N && *s1 && *s2) {
-        char c1 = ToLower(*s1);
-        char c2 = *s2;
-
-        if (c1 != c2) break;
+constexpr size_t Length(const char* s) {
+    size_t n = 0;
+    while (s[n])
+        ++n;
+    return n;
+}
 
-        ++s1;
-        ++s2;
-        ++count;
+// FNV-1a over the lowercased name, then a final mix so that the bucket (high
+// bits) and slot (low bits) both depend on every character.
+constexpr uint64_t TagHash(const char* name, size_t length, uint64_t seed) {
+    uint64_t h = 0xcbf29ce484222325ull ^ seed;
+    for (size_t i = 0; i < length; ++i) {
+        h ^= static_cast<unsigned char>(ToLower(name[i]));
+        h *= 0x100000001b3ull;
     }
-    return (unsigned char) ToLower(*s1) - (unsigned char) (*s2);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
 }
 
-DesiredAction LookupPossibleTag(const char* name, const char* nameEnd) {
-    size_t tagLength = nameEnd - name;
+constexpr size_t Bucket(uint64_t h) {
+    return h >> 58;
+}
 
-    if (tagLength > LongestTagLength) {
-        return DesiredAction::OrdinaryText;
+constexpr size_t Slot(uint64_t h, uint8_t displacement) {
+    return (h ^ displacement) & (TableSize - 1);
+}
+
+constexpr uint8_t Style(const char* tag, size_t length) {
+    if (length == 1 && tag[0] == 'b')
+        return TagInfo::Bold;
+    if (length == 2 && tag[0] == 'h' && '1' <= tag[1] && tag[1] <= '6')
+        return TagInfo::Heading;
+    return 0;
+}
+
+struct TagSlot {
+    const char* tag = "";
+    uint8_t length = 0;                             // 0 for an empty slot
+    DesiredAction action = DesiredAction::Discard;
+    uint8_t style = 0;
+};
+
+struct TagHashTable {
+    bool built = false;
+    uint64_t seed = 0;
+    uint8_t displacement[BucketCount] = {};
+    TagSlot slots[TableSize] = {};
+};
+
+// Tries to place every tag with the given seed, filling the largest buckets
+// first while the table is emptiest.  Fails if two tags in the same bucket
+// share a slot for every displacement.
+constexpr bool TryBuild(TagHashTable& table, uint64_t seed) {
+    table = TagHashTable{};
+    table.seed = seed;
+
+    uint64_t hashes[NumberOfTags] = {};
+    size_t bucketSize[BucketCount] = {};
+    size_t largest = 0;
+    for (int i = 0; i < NumberOfTags; ++i) {
+        hashes[i] = TagHash(TagsRecognized[i].Tag, Length(TagsRecognized[i].Tag), seed);
+        size_t size = ++bucketSize[Bucket(hashes[i])];
+        largest = size > largest ? size : largest;
     }
 
-    int left = 0;
-    int right = NumberOfTags - 1;
+    for (size_t size = largest; size > 0; --size) {
+        for (size_t bucket = 0; bucket < BucketCount; ++bucket) {
+            if (bucketSize[bucket] != size)
+                continue;
+
+            bool placed = false;
+            for (size_t d = 0; d < 256 && !placed; ++d) {
+                bool used[TableSize] = {};
+                placed = true;
+                for (int i = 0; i < NumberOfTags && placed; ++i) {
+                    if (Bucket(hashes[i]) != bucket)
+                        continue;
+                    size_t slot = Slot(hashes[i], d);
+                    if (table.slots[slot].length || used[slot])
+                        placed = false;
+                    used[slot] = true;
+                }
+                if (placed)
+                    table.displacement[bucket] = d;
+            }
+            if (!placed)
+                return false;
+
+            for (int i = 0; i < NumberOfTags; ++i) {
+                if (Bucket(hashes[i]) != bucket)
+                    continue;
+                const char* tag = TagsRecognized[i].Tag;
+                size_t length = Length(tag);
+                table.slots[Slot(hashes[i], table.displacement[bucket])]
+                    = TagSlot{ tag, static_cast<uint8_t>(length), TagsRecognized[i].Action, Style(tag, length) };
+            }
+        }
+    }
 
-    while (left <= right) {
-        int middle = left + (right - left) / 2;
+    table.built = true;
+    return true;
+}
+
+constexpr TagHashTable BuildTagHashTable() {
+    TagHashTable table;
+    for (uint64_t seed = 0; seed < 64; ++seed) {
+        if (TryBuild(table, seed))
+            break;
+    }
+    return table;
+}
 
-        size_t length = std::min(tagLength, strlen(TagsRecognized[middle].Tag));
+constexpr TagHashTable TagTable = BuildTagHashTable();
 
-        int comp = CStringComp(name, TagsRecognized[middle].Tag, length);
+static_assert(TagTable.built, "no perfect hash found for TagsRecognized; try more seeds or a larger table");
+static_assert(NumberOfTags < TableSize, "TagsRecognized has outgrown the tag hash table");
 
-        if (comp == 0 && tagLength == strlen(TagsRecognized[middle].Tag)) {
-            return TagsRecognized[middle].Action;
-        } else if (comp > 0) {
-            left = middle + 1;
-        } else {
-            right = middle - 1;
-        }
+} // namespace
+
+TagInfo LookupTag(const char* name, size_t length) {
+    if (length > LongestTagLength) {
+        return { DesiredAction::OrdinaryText, 0 };
     }
 
+    uint64_t h = TagHash(name, length, TagTable.seed);
+    const TagSlot& slot = TagTable.slots[Slot(h, TagTable.displacement[Bucket(h)])];
+    if (slot.length != length) {
+        return { DesiredAction::Discard, 0 };
+    }
+    for (size_t i = 0; i < length; ++i) {
+        if (ToLower(name[i]) != slot.tag[i]) {
+            return { DesiredAction::Discard, 0 };
+        }
+    }
+    return { slot.action, slot.style };
+}
 
-    return DesiredAction::Discard;
+DesiredAction LookupPossibleTag(const char* name, const char* nameEnd) {
+    return LookupTag(name, nameEnd - name).action;
 }
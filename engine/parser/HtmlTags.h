@@ -7,28 +7,38 @@
 // https://developer.mozilla.org/en-US/docs/Web/HTML/Element +
 // !DOCTYPE, !-- (comment) and svg.
 
-// Do not make any changes to this file.  You will need to implement
-// the LookupPossibleTag( ) function in HtmlTags.cpp.
-
-// LookupPossibleTag will search table of the HTML tags
-// this parser will recognize and return the associated
-// action if it's found in the table.  If it's not found,
-// return OrdinaryText.
+// LookupTag finds a tag name with a single probe of a perfect hash that
+// HtmlTags.cpp builds from this table at compile time, so adding a tag
+// here is all that is needed to recognize it.
 
 // Most opening and closing tags are simply discarded.  Three of them,
 // <script>, <style>, and <svg> require discarding the the entire section.
 // <!--, <title>, <a>, <base> and <embed> are special-cased.
 
 #include <cstddef>
+#include <cstdint>
+
 enum class DesiredAction { OrdinaryText, Title, Comment, Discard, DiscardSection, Anchor, Base, Embed, HTML };
 
-// name points to beginning of the possible HTML tag name.
-// nameEnd points to one past last character.
-// Comparison is case-insensitive.
-// Use a binary search.
-// If the name is found in the TagsRecognized table, return
-// the corresponding action.
-// If the name is not found, return OrdinaryText.
+// What a tag name means to the parser: its action, plus the style it turns
+// on for the text that follows (<b> is bold, <h1>..<h6> are headings).
+struct TagInfo {
+    static constexpr uint8_t Bold = 1;
+    static constexpr uint8_t Heading = 2;
+
+    DesiredAction action;
+    uint8_t style;
+};
+
+// name points to the beginning of the possible HTML tag name, length is the
+// number of characters in it.  Comparison is case-insensitive.
+// Names longer than LongestTagLength are OrdinaryText; any other name that
+// is not in the TagsRecognized table is Discard.
+
+TagInfo LookupTag(const char* name, size_t length);
+
+// Same lookup, returning only the action.  nameEnd points to one past the
+// last character.
 
 DesiredAction LookupPossibleTag(const char* name, const char* nameEnd = nullptr);
 
@@ -37,13 +47,13 @@ public:
     const char* Tag;
     const DesiredAction Action;
 
-    HtmlTag(const char* tag, const DesiredAction action)
+    constexpr HtmlTag(const char* tag, const DesiredAction action)
         : Tag(tag)
         , Action(action) {}
 };
 
 
-const HtmlTag TagsRecognized[] = {
+constexpr HtmlTag TagsRecognized[] = {
     {        "!--",        DesiredAction::Comment },
     {   "!doctype",        DesiredAction::Discard },
 // { "bsp-jw-player", DesiredAction::DiscardSection},
@@ -201,5 +211,5 @@ const HtmlTag TagsRecognized[] = {
     {        "xmp",        DesiredAction::Discard }
 };
 
-const size_t LongestTagLength = 20;
-const int NumberOfTags = sizeof(TagsRecognized) / sizeof(HtmlTag);
+constexpr size_t LongestTagLength = 20;
+constexpr int NumberOfTags = sizeof(TagsRecognized) / sizeof(HtmlTag);
@@ -0,0 +1,439 @@
+#include "PageLog.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "../lib/constants.h"
+#include "../lib/iostream.h"
+
+// A record is framed as its body's length, the CRC of its type and body,
+// its type, then the body.
+static constexpr size_t FrameHeader = 2 * sizeof(uint32_t) + 1;
+
+// The first byte of a page payload.  A payload in any other format, such as
+// one written by a different build, is refused rather than misread.
+static constexpr uint8_t PageFormat = 1;
+
+template <typename T>
+static void put(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void putString(std::string& out, const std::string& value) {
+    put(out, static_cast<uint32_t>(value.size()));
+    out += value;
+}
+
+template <typename T>
+static void putVector(std::string& out, const std::vector<T>& values) {
+    put(out, static_cast<uint32_t>(values.size()));
+    out.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+// Spans go in as varints: the gap since the previous span's end, zigzagged
+// in case it is negative, then the length.  Most take two bytes, not eight.
+static void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+static void putSpans(std::string& out, const std::vector<Span>& spans) {
+    putVarint(out, spans.size());
+    int64_t end = 0;
+    for (Span span : spans) {
+        int64_t gap = static_cast<int64_t>(span.offset) - end;
+        putVarint(out, static_cast<uint64_t>(gap) << 1 ^ static_cast<uint64_t>(gap >> 63));
+        putVarint(out, span.length);
+        end = static_cast<int64_t>(span.offset) + span.length;
+    }
+}
+
+// Reads what put wrote, failing rather than reading past the end.
+struct Reader {
+    const char* at;
+    const char* end;
+
+    template <typename T>
+    bool get(T& value) {
+        if (static_cast<size_t>(end - at) < sizeof(T))
+            return false;
+        memcpy(&value, at, sizeof(T));
+        at += sizeof(T);
+        return true;
+    }
+
+    bool getString(std::string& value) {
+        uint32_t length;
+        if (!get(length) || static_cast<size_t>(end - at) < length)
+            return false;
+        value.assign(at, length);
+        at += length;
+        return true;
+    }
+
+    bool getVarint(uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && at < end; shift += 7) {
+            uint8_t byte = *at++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    bool getSpans(std::vector<Span>& spans) {
+        uint64_t count, gap, length;
+        if (!getVarint(count) || count > static_cast<size_t>(end - at))
+            return false;
+        spans.resize(count);
+        int64_t spanEnd = 0;
+        for (Span& span : spans) {
+            if (!getVarint(gap) || !getVarint(length))
+                return false;
+            span.offset = spanEnd + static_cast<int64_t>(gap >> 1 ^ -(gap & 1));
+            span.length = length;
+            spanEnd = static_cast<int64_t>(span.offset) + span.length;
+        }
+        return true;
+    }
+
+    template <typename T>
+    bool getVector(std::vector<T>& values) {
+        uint32_t count;
+        if (!get(count) || static_cast<size_t>(end - at) / sizeof(T) < count)
+            return false;
+        values.resize(count);
+        memcpy(values.data(), at, count * sizeof(T));
+        at += count * sizeof(T);
+        return true;
+    }
+};
+
+// Whether every span lies within a buffer of size bytes.
+static bool within(const std::vector<Span>& spans, size_t size) {
+    for (Span span : spans)
+        if (static_cast<uint64_t>(span.offset) + span.length > size)
+            return false;
+    return true;
+}
+
+static void frame(std::string& out, uint8_t type, const std::string& body) {
+    uint32_t crc = crc32(0, &type, 1);
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(body.data()), body.size());
+    put(out, static_cast<uint32_t>(body.size()));
+    put(out, crc);
+    put(out, type);
+    out += body;
+}
+
+PageLog::PageLog(const std::string& prefix)
+    : prefix(prefix) {
+
+    // segments left by the last run, oldest first
+    std::string stem = prefix + ".";
+    if (DIR* dir = opendir(".")) {
+        while (dirent* entry = readdir(dir)) {
+            const char* name = entry->d_name;
+            if (strncmp(name, stem.c_str(), stem.size()) == 0 && name[stem.size()]
+                && strspn(name + stem.size(), "0123456789") == strlen(name + stem.size())) {
+                recovered.push_back(strtoul(name + stem.size(), nullptr, 10));
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(recovered.begin(), recovered.end());
+
+    std::vector<uint64_t> pages;
+    for (uint32_t n : recovered) {
+        unsaved[n] = 0;
+        scan(segmentName(n), [&](RecordType type, const char* body, size_t length) {
+            Reader reader{body, body + length};
+            uint64_t sequence;
+            if (type == Page && reader.get(sequence)) {
+                pages.push_back(sequence);
+            }
+            else if (type == Checkpoint) {
+                while (reader.get(sequence))
+                    saved.insert(sequence);
+            }
+        });
+    }
+    for (uint64_t sequence : pages) {
+        if (!saved.count(sequence) && unsaved.count(sequence >> 32)) {
+            ++unsaved[sequence >> 32];
+        }
+    }
+    size_t toReplay = 0;
+    for (const auto& entry : unsaved)
+        toReplay += entry.second;
+    if (toReplay) {
+        irs::cout << "page log: " << toReplay << " pages were never saved in an index chunk" << irs::endl;
+    }
+
+    openSegment(recovered.empty() ? 0 : recovered.back() + 1);
+    dropSavedSegments();
+}
+
+PageLog::~PageLog() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+std::string PageLog::segmentName(uint32_t n) const {
+    return prefix + "." + std::to_string(n);
+}
+
+void PageLog::openSegment(uint32_t n) {
+    if (fd >= 0) {
+        close(fd);
+    }
+    segment = n;
+    records = 0;
+    bytes = 0;
+    unsaved[n] = 0;
+
+    fd = open(segmentName(n).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) {
+        perror(segmentName(n).c_str());
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Writes whole records and waits for them to reach the disk.
+void PageLog::commit(const std::string& frames) {
+    size_t written = 0;
+    while (written < frames.size()) {
+        ssize_t n = ::write(fd, frames.data() + written, frames.size() - written);
+        if (n < 0) {
+            perror("page log");
+            exit(EXIT_FAILURE);
+        }
+        written += n;
+    }
+    if (fdatasync(fd) != 0) {
+        perror("page log");
+        exit(EXIT_FAILURE);
+    }
+    bytes += frames.size();
+}
+
+void PageLog::append(const std::vector<std::string>& payloads, std::vector<uint64_t>& sequences) {
+    Lock_Guard<Mutex, &Mutex::lock> guard(mutex);
+
+    if (bytes >= PARSER_LOG_SEGMENT_BYTES) {
+        openSegment(segment + 1);
+        dropSavedSegments();
+    }
+
+    // one write and one fdatasync for the whole batch
+    sequences.clear();
+    std::string batch;
+    for (const auto& payload : payloads) {
+        uint64_t sequence = static_cast<uint64_t>(segment) << 32 | records++;
+        sequences.push_back(sequence);
+
+        std::string body;
+        body.reserve(sizeof(sequence) + payload.size());
+        put(body, sequence);
+        body += payload;
+        frame(batch, Page, body);
+    }
+    commit(batch);
+    unsaved[segment] += payloads.size();
+}
+
+void PageLog::checkpoint(const std::vector<uint64_t>& sequences) {
+    std::string body;
+    body.reserve(sequences.size() * sizeof(uint64_t));
+    for (uint64_t sequence : sequences)
+        put(body, sequence);
+
+    std::string record;
+    frame(record, Checkpoint, body);
+
+    Lock_Guard<Mutex, &Mutex::lock> guard(mutex);
+    commit(record);
+
+    for (uint64_t sequence : sequences) {
+        auto it = unsaved.find(sequence >> 32);
+        if (it != unsaved.end() && it->second > 0) {
+            --it->second;
+        }
+    }
+    dropSavedSegments();
+}
+
+// Deletes the oldest segments while every page in them is saved, but never
+// the one being appended to.
+void PageLog::dropSavedSegments() {
+    while (unsaved.size() > 1 && unsaved.begin()->second == 0) {
+        unlink(segmentName(unsaved.begin()->first).c_str());
+        unsaved.erase(unsaved.begin());
+    }
+}
+
+void PageLog::replay(const std::function<void(uint64_t sequence, std::string& payload)>& visit) {
+    for (uint32_t n : recovered) {
+        scan(segmentName(n), [&](RecordType type, const char* body, size_t length) {
+            uint64_t sequence;
+            if (type != Page || length < sizeof(sequence))
+                return;
+            memcpy(&sequence, body, sizeof(sequence));
+            if (!saved.count(sequence)) {
+                std::string payload(body + sizeof(sequence), length - sizeof(sequence));
+                visit(sequence, payload);
+            }
+        });
+    }
+    recovered.clear();
+    saved = std::unordered_set<uint64_t>();
+}
+
+// Calls visit with each intact record in the segment, stopping at the first
+// that is torn or corrupt.
+void PageLog::scan(const std::string& filename,
+                   const std::function<void(RecordType type, const char* body, size_t length)>& visit) {
+    int in = open(filename.c_str(), O_RDONLY);
+    if (in < 0) {
+        return;
+    }
+    std::string contents;
+    char buffer[1 << 16];
+    ssize_t n;
+    while ((n = read(in, buffer, sizeof(buffer))) > 0)
+        contents.append(buffer, n);
+    close(in);
+
+    Reader reader{contents.data(), contents.data() + contents.size()};
+    uint32_t length, crc;
+    uint8_t type;
+    while (reader.get(length) && reader.get(crc) && reader.get(type)
+           && static_cast<size_t>(reader.end - reader.at) >= length) {
+        uint32_t actual = crc32(0, &type, 1);
+        actual = crc32(actual, reinterpret_cast<const Bytef*>(reader.at), length);
+        if (actual != crc) {
+            irs::cerr << filename.c_str() << " is corrupt after " << reader.at - contents.data() - FrameHeader
+                      << " bytes; the rest is ignored" << irs::endl;
+            return;
+        }
+        visit(static_cast<RecordType>(type), reader.at, length);
+        reader.at += length;
+    }
+}
+
+std::string PageLog::encodePage(const HtmlParser& page, int depth) {
+    std::string raw;
+    put(raw, static_cast<int32_t>(depth));
+    put(raw, static_cast<uint8_t>(page.english | page.truncated << 1));
+    putString(raw, page.pageURL);
+    putString(raw, page.title_chunk);
+    putString(raw, page.base);
+    putString(raw, page.page);
+    putSpans(raw, page.wordSpans);
+    putVector(raw, page.wordFlags);
+    putSpans(raw, page.titleSpans);
+    put(raw, static_cast<uint32_t>(page.anchorSpans.size()));
+    for (const auto& anchor : page.anchorSpans)
+        putVarint(raw, anchor.link);
+    std::vector<Span> anchors(page.anchorSpans.size());
+    for (size_t i = 0; i < anchors.size(); ++i)
+        anchors[i] = page.anchorSpans[i].span;
+    putSpans(raw, anchors);
+    put(raw, static_cast<uint32_t>(page.links.size()));
+    for (const auto& link : page.links)
+        putString(raw, link.URL);
+
+    std::string payload;
+    put(payload, PageFormat);
+    put(payload, static_cast<uint32_t>(raw.size()));
+    size_t header = payload.size();
+    uLongf length = compressBound(raw.size());
+    payload.resize(header + length);
+    // one deflate state per parse worker, reset rather than set up for each page
+    static thread_local struct Deflater {
+        z_stream stream{};
+        Deflater() { deflateInit(&stream, PARSER_LOG_DEFLATE_LEVEL); }
+        ~Deflater() { deflateEnd(&stream); }
+    } deflater;
+    z_stream& stream = deflater.stream;
+    deflateReset(&stream);
+    stream.next_in = reinterpret_cast<Bytef*>(&raw[0]);
+    stream.avail_in = raw.size();
+    stream.next_out = reinterpret_cast<Bytef*>(&payload[header]);
+    stream.avail_out = length;
+    deflate(&stream, Z_FINISH);
+    length = stream.total_out;
+    payload.resize(header + length);
+    return payload;
+}
+
+HtmlParser* PageLog::decodePage(const std::string& payload, int& depth) {
+    uint8_t format;
+    uint32_t size;
+    Reader header{payload.data(), payload.data() + payload.size()};
+    // no parse of a page the parser accepts comes near the size cap; a corrupt size must not set the allocation
+    if (!header.get(format) || format != PageFormat || !header.get(size) || size > PARSER_MAX_PAGE_SIZE * 4)
+        return nullptr;
+
+    std::string raw(size, '\0');
+    uLongf length = size;
+    if (uncompress(reinterpret_cast<Bytef*>(&raw[0]), &length, reinterpret_cast<const Bytef*>(header.at),
+                   header.end - header.at)
+          != Z_OK
+        || length != size) {
+        return nullptr;
+    }
+
+    auto page = new HtmlParser();
+    page->compact = true;
+    Reader reader{raw.data(), raw.data() + raw.size()};
+    int32_t storedDepth;
+    uint8_t flags;
+    uint32_t links, anchorCount;
+    bool ok = reader.get(storedDepth) && reader.get(flags) && reader.getString(page->pageURL)
+              && reader.getString(page->title_chunk) && reader.getString(page->base) && reader.getString(page->page)
+              && reader.getSpans(page->wordSpans) && reader.getVector(page->wordFlags)
+              && reader.getSpans(page->titleSpans) && reader.get(anchorCount)
+              && anchorCount <= raw.size();
+    std::vector<Span> anchors;
+    page->anchorSpans.resize(ok ? anchorCount : 0);
+    for (auto& anchor : page->anchorSpans) {
+        uint64_t link = 0;
+        ok = ok && reader.getVarint(link) && link <= UINT32_MAX;
+        anchor.link = link;
+    }
+    ok = ok && reader.getSpans(anchors) && anchors.size() == anchorCount && reader.get(links);
+    for (size_t i = 0; ok && i < anchors.size(); ++i)
+        page->anchorSpans[i].span = anchors[i];
+    for (uint32_t i = 0; ok && i < links; ++i) {
+        std::string url;
+        ok = reader.getString(url);
+        page->links.emplace_back(std::move(url));
+    }
+
+    // the indexer trusts these, so a page that breaks them must not reach it: a flag for every word, every span
+    // within the page and every anchor's link among the links
+    ok = ok && page->wordFlags.size() == page->wordSpans.size() && within(page->wordSpans, page->page.size())
+         && within(page->titleSpans, page->page.size()) && within(anchors, page->page.size());
+    for (size_t i = 0; ok && i < page->anchorSpans.size(); ++i)
+        ok = page->anchorSpans[i].link < page->links.size();
+    if (!ok) {
+        delete page;
+        return nullptr;
+    }
+    depth = storedDepth;
+    page->english = flags & 1;
+    page->truncated = flags & 2;
+    return page;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "HtmlParser.h"
+#include "../lib/mutex.h"
+
+// An append-only log of the pages the parser has accepted, so that a crash
+// loses none of the pages that were parsed but not yet saved in an index
+// chunk.  A page's url goes into the parser's filter, and its crawler gets
+// the credit for it back, only once its record is durable; after that the
+// crawler would never send it again.
+//
+// The log is a series of segment files, <prefix>.<n>.  Each record is
+// framed by its length and a CRC, so a record torn by a crash ends the
+// segment it is in rather than corrupting it.  A page record holds the
+// page's parse, deflated; a checkpoint record lists the pages that an index
+// chunk has durably saved.  Once every page in the oldest segment is
+// checkpointed, that segment is deleted.  Segments are deleted oldest first,
+// so a checkpoint is never lost while a page it covers is still in the log.
+//
+// On startup, the segments left by the last run are closed and a new one is
+// opened for appends.  replay() then returns the pages that no checkpoint
+// covers, without parsing them again.
+class PageLog {
+public:
+    explicit PageLog(const std::string& prefix);
+    ~PageLog();
+
+    // Appends a page record for each payload and makes them all durable with
+    // one fdatasync, which is how a batch of pages is group-committed.  Gives
+    // each page its sequence number in sequences.
+    void append(const std::vector<std::string>& payloads, std::vector<uint64_t>& sequences);
+
+    // Records that the pages with these sequence numbers are saved in an
+    // index chunk, then deletes whatever segments that makes unneeded.
+    void checkpoint(const std::vector<uint64_t>& sequences);
+
+    // Calls visit with each page the last run logged but never checkpointed,
+    // in the order they were logged.  Runs once, while append and checkpoint
+    // may run alongside it.
+    void replay(const std::function<void(uint64_t sequence, std::string& payload)>& visit);
+
+    // Payloads: a compact parse of a page and the depth it was crawled at,
+    // after a format byte.  decodePage returns nullptr for a payload in
+    // another format or whose spans, flags or anchors do not fit the page,
+    // so that nothing the indexer would read out of bounds gets to it.
+    static std::string encodePage(const HtmlParser& page, int depth);
+    static HtmlParser* decodePage(const std::string& payload, int& depth);
+
+private:
+    enum RecordType : uint8_t { Page = 1, Checkpoint = 2 };
+
+    std::string prefix;
+    int fd = -1;                    // the segment being appended to
+    uint32_t segment = 0;
+    uint32_t records = 0;           // page records in it, which number its pages
+    size_t bytes = 0;
+
+    Mutex mutex;
+    std::map<uint32_t, size_t> unsaved;     // pages not yet checkpointed, by segment, oldest first
+
+    // Left by the last run, until replay.
+    std::vector<uint32_t> recovered;
+    std::unordered_set<uint64_t> saved;
+
+    std::string segmentName(uint32_t n) const;
+    void openSegment(uint32_t n);
+    void commit(const std::string& frames);
+    void dropSavedSegments();
+    static void scan(const std::string& filename,
+                     const std::function<void(RecordType type, const char* body, size_t length)>& visit);
+};
@@ -1,43 +1,119 @@
 #include "Parser.h"
 
+#include <algorithm>
 #include <cctype>   // for isspace
+#include <cerrno>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <map>
 #include <fcntl.h>
 #include <pthread.h>
 #include <sched.h>
 #include <string>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <unordered_set>
 
 #include "../lib/file.h"
 #include "../lib/constants.h"
 #include "../lib/iostream.h"
 #include "HtmlParser.h"
+#include "Url.h"
+#include "protocol_parser.h"
+
+Parser::Stats::Stats()
+    : pagesReceived(Metrics::get_instance().counter("parser_pages_received_total",
+                                                    "Pages whose url has been read from a crawler"))
+    , pagesDuplicate(Metrics::get_instance().counter("parser_pages_duplicate_total",
+                                                     "Pages dropped because their url was already parsed"))
+    , pagesParsed(Metrics::get_instance().counter("parser_pages_parsed_total", "Pages parsed"))
+    , pagesTruncated(Metrics::get_instance().counter("parser_pages_truncated_total",
+                                                     "Pages cut short by the parse deadline"))
+    , pagesIndexed(Metrics::get_instance().counter("parser_pages_indexed_total", "Pages inserted into an index chunk"))
+    , pagesSaved(Metrics::get_instance().counter("parser_pages_saved_total", "Pages in index chunks written to disk"))
+    , pagesLogged(Metrics::get_instance().counter("parser_pages_logged_total",
+                                                  "Pages made durable in the page log"))
+    , pagesReplayed(Metrics::get_instance().counter("parser_pages_replayed_total",
+                                                    "Pages a previous run logged but never saved, indexed on startup"))
+    , linksQueued(Metrics::get_instance().counter("parser_links_queued_total", "Distinct links queued for crawlers"))
+    , linkBytesSent(Metrics::get_instance().counter("parser_link_bytes_sent_total", "Bytes of links sent to crawlers"))
+    , linkBatchesWaited(Metrics::get_instance().counter("parser_link_batches_waited_total",
+                                                        "Link batches held until their crawler's full queue had room"))
+    , linkBatchesDropped(Metrics::get_instance().counter("parser_link_batches_dropped_total",
+                                                         "Link batches dropped because their crawler was down or its "
+                                                         "queue stayed full"))
+    , chunksSaved(Metrics::get_instance().counter("parser_chunks_saved_total", "Index chunks written to disk"))
+    , chunkBytesSaved(Metrics::get_instance().counter("parser_chunk_bytes_saved_total",
+                                                      "Bytes of index chunks written to disk"))
+    , connectionsAccepted(Metrics::get_instance().counter("parser_connections_accepted_total",
+                                                          "Crawler connections accepted"))
+    , chunksFull(Metrics::get_instance().counter("parser_chunks_cut_total{reason=\"documents\"}",
+                                                 "Index chunks cut, by the limit they reached"))
+    , chunksLarge(Metrics::get_instance().counter("parser_chunks_cut_total{reason=\"bytes\"}",
+                                                  "Index chunks cut, by the limit they reached"))
+    , chunksOld(Metrics::get_instance().counter("parser_chunks_cut_total{reason=\"age\"}",
+                                                "Index chunks cut, by the limit they reached"))
+    , receiveLatency(Metrics::get_instance().histogram("parser_receive_seconds",
+                                                       "Time from a page's first byte to its last", 1e-9))
+    , parseLatency(Metrics::get_instance().histogram("parser_parse_seconds", "Time to parse a page", 1e-9))
+    , logCommitLatency(Metrics::get_instance().histogram("parser_log_commit_seconds",
+                                                         "Time to write and sync a batch of pages to the page log", 1e-9))
+    , indexInsertLatency(Metrics::get_instance().histogram("parser_index_insert_seconds",
+                                                           "Time to insert a parsed page into the index", 1e-9))
+    , chunkSaveLatency(Metrics::get_instance().histogram("parser_chunk_save_seconds",
+                                                         "Time to write an index chunk to disk", 1e-9))
+    , chunkDocuments(Metrics::get_instance().histogram("parser_chunk_documents", "Pages in each index chunk"))
+    , chunkMemory(Metrics::get_instance().histogram("parser_chunk_memory_bytes",
+                                                    "Memory held by each index chunk when it was cut"))
+    , chunkBytes(Metrics::get_instance().histogram("parser_chunk_bytes", "Size of each index chunk on disk")) {
+}
+
+Metric_Counter& Parser::busyCounter(const std::string& thread) {
+    return Metrics::get_instance().counter("parser_thread_busy_seconds_total{thread=\"" + thread + "\"}",
+                                           "Time each thread spent working rather than waiting", 1e-9);
+}
 
 // Constructor: Set up the listening socket.
-Parser::Parser()
-    : port(PARSER_PORT)
-    , index_chunk_count(0)
-    , filter(BLOOM_FRONTIER_SIZE, FRONTIER_FP_RATE)
-    , filter_lock()
-    , parsedPagesLock()
-    , parsedPages()
+Parser::Parser(bool record)
+    : index_chunk_count(0)
+    , port(PARSER_PORT)
+    , record(record)
+    , filter(PARSER_FILTER_FILE, BLOOM_FRONTIER_SIZE, FRONTIER_FP_RATE)
+    , log(PARSER_LOG_FILE)
     , crawlers() {
 
-    if (!access(PARSER_FILTER_FILE, F_OK)) {
-        filter = Bloomfilter(PARSER_FILTER_FILE);
+    // the filter lives in PARSER_FILTER_FILE, mapped; one written by an older parser cannot be, so keep it aside
+    // rather than overwrite it
+    if (!filter.loaded()) {
+        std::string old = std::string(PARSER_FILTER_FILE) + ".old";
+        rename(PARSER_FILTER_FILE, old.c_str());
+        irs::cerr << PARSER_FILTER_FILE << " is not a blocked filter, moved it to " << old.c_str()
+                  << " and starting empty" << irs::endl;
+
+        filter = Blocked_Bloomfilter(PARSER_FILTER_FILE, BLOOM_FRONTIER_SIZE, FRONTIER_FP_RATE);
+        if (!filter.loaded()) {
+            perror(PARSER_FILTER_FILE);
+            exit(EXIT_FAILURE);
+        }
     }
 
     if (!access(PARSER_PEERS_FILE, F_OK)) {
         readPeers();
     } else {
-        crawlers.resize(1);
-        crawlers[0].ip = "127.0.0.1";
+        crawlers.push_back(std::make_unique<Crawler>());
+        crawlers[0]->ip = "127.0.0.1";
+    }
+    for (const auto& crawler: crawlers) {
+        peers.push_back({HashKey(crawler->ip), crawler->weight});
     }
 
     // Get starting index number
@@ -52,7 +128,14 @@ Parser::Parser()
         index_chunk_count++;
     }
 
-    listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    // each crawler connection is a descriptor, so allow as many as the hard limit does
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    listenSocket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
     if (listenSocket < 0) {
         perror("socket");
         exit(EXIT_FAILURE);
@@ -73,40 +156,45 @@ Parser::Parser()
         perror("bind");
         exit(EXIT_FAILURE);
     }
-    if (listen(listenSocket, NUM_PARSER_TALK_THREADS) < 0) {
+    if (listen(listenSocket, PARSER_LISTEN_BACKLOG) < 0) {
         perror("listen");
         exit(EXIT_FAILURE);
     }
 
-    pthread_t listenerTid;
-    if (pthread_create(&listenerTid, nullptr, Parser::listener, this) != 0) {
-        perror("pthread_create");
-        exit(EXIT_FAILURE);
-    }
-    pthread_detach(listenerTid);
+    int reactors = NUM_PARSER_REACTORS > 0 ? NUM_PARSER_REACTORS : std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    for (int i = 0; i < reactors; ++i) {
+        auto reactor = new Reactor{this, epoll_create1(0), {}, &busyCounter("reactor-" + std::to_string(i)),
+                                   eventfd(0, EFD_NONBLOCK), {}, {}};
+        if (reactor->epoll < 0 || reactor->wake < 0) {
+            perror("epoll_create1");
+            exit(EXIT_FAILURE);
+        }
 
-    for (int i = 0; i < NUM_PARSER_TALK_THREADS; ++i) {
-        pthread_t talking_thread;
-        if (pthread_create(&talking_thread, nullptr, Parser::talk, this) != 0) {
-            perror("pthread_create");
+        // every reactor watches the listening socket; EPOLLEXCLUSIVE wakes only one of them per connection
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLEXCLUSIVE;
+        event.data.fd = listenSocket;
+        epoll_event wake{};
+        wake.events = EPOLLIN;
+        wake.data.fd = reactor->wake;
+        if (epoll_ctl(reactor->epoll, EPOLL_CTL_ADD, listenSocket, &event) < 0
+            || epoll_ctl(reactor->epoll, EPOLL_CTL_ADD, reactor->wake, &wake) < 0) {
+            perror("epoll_ctl");
             exit(EXIT_FAILURE);
         }
-        pthread_detach(talking_thread);
-    }
 
-    for (int i = 0; i < NUM_PARSE_THREADS; ++i) {
-        pthread_t parser_thread;
-        if (pthread_create(&parser_thread, nullptr, Parser::parserThread, this) != 0) {
+        pthread_t reactor_thread;
+        if (pthread_create(&reactor_thread, nullptr, Parser::reactorThread, reactor) != 0) {
             perror("pthread_create");
             exit(EXIT_FAILURE);
         }
-        save_threads.push_back(parser_thread);
+        pthread_detach(reactor_thread);
     }
 
-    // Even number of threads per crawler
-    int num_send_threads = (NUM_SEND_THREADS / crawlers.size()) * crawlers.size();
+    // A couple of threads per crawler; each send carries every batch queued for it
+    int num_send_threads = NUM_SEND_THREADS_PER_CRAWLER * crawlers.size();
     for (int i = 0; i < num_send_threads; ++i) {
-        auto args = new SendArgs{this, i % crawlers.size()};
+        auto args = new SendArgs{this, i % crawlers.size(), &busyCounter("send-" + std::to_string(i))};
         pthread_t send_thread;
         if (pthread_create(&send_thread, nullptr, Parser::SendLinkThread, args) != 0) {
             perror("pthread_create");
@@ -124,6 +212,13 @@ Parser::Parser()
         pthread_detach(index_write);
     }
 
+    pthread_t log_thread;
+    if (pthread_create(&log_thread, nullptr, Parser::LogThread, this) != 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(log_thread);
+
     for (int i = 0; i < NUM_INDEX_SAVE_THREADS; ++i) {
         pthread_t index_save;
         if (pthread_create(&index_save, nullptr, Parser::IndexSaveThread, this) != 0) {
@@ -132,43 +227,475 @@ Parser::Parser()
         }
         pthread_detach(index_save);
     }
+
+    Metrics& metrics = Metrics::get_instance();
+    for (size_t i = 0; i < parsePool.size(); ++i) {
+        metrics.counter_function("parser_thread_busy_seconds_total{thread=\"parse-" + std::to_string(i) + "\"}",
+                                 "Time each thread spent working rather than waiting",
+                                 [this, i] { return parsePool.busy_ns(i) * 1e-9; });
+    }
+    metrics.counter_function("parser_parse_steals_total", "Parse tasks taken from another worker's queue",
+                             [this] { return parsePool.steals(); });
+    metrics.gauge("parser_queue_depth{queue=\"parse\"}", "Items waiting in each queue between stages",
+                  [this] { return pagesWaitingToParse(); });
+    metrics.gauge("parser_queue_depth{queue=\"log\"}", "Items waiting in each queue between stages",
+                  [this] { return toLog.size(); });
+    metrics.gauge("parser_queue_depth{queue=\"index\"}", "Items waiting in each queue between stages",
+                  [this] { return parsedPages.size(); });
+    metrics.gauge("parser_queue_depth{queue=\"save\"}", "Items waiting in each queue between stages",
+                  [this] { return toSave.size(); });
+    for (const auto& crawler: crawlers) {
+        Crawler* c = crawler.get();
+        metrics.gauge("parser_queue_depth{queue=\"links\",crawler=\"" + c->ip + "\"}",
+                      "Items waiting in each queue between stages", [c] { return c->links.size(); });
+    }
+    metrics.gauge("parser_open_connections", "Crawler connections open",
+                  [this] { return openConnections.load(std::memory_order_relaxed); });
+    metrics.gauge("parser_peak_resident_bytes", "Most memory the parser has held at once", [] {
+        struct rusage usage;
+        return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss * 1024.0 : 0;
+    });
+    if (!start_metrics_server(PARSER_METRICS_PORT)) {
+        perror("metrics server");
+    }
+
+    replayLog();
 }
 
 Parser::~Parser() {
     close(listenSocket);
 }
 
-// The listener thread: continuously accepts new connections.
-void* Parser::listener(void* arg) {
-    Parser* self = static_cast<Parser*>(arg);
-    struct sockaddr_in clientAddr;
-    socklen_t addrLen = sizeof(clientAddr);
+// The reactor thread: accepts connections and reads pages from every
+// connection that has data, without ever blocking on a single crawler.
+void* Parser::reactorThread(void* arg) {
+    auto reactor = static_cast<Reactor*>(arg);
+    auto parser = reactor->parser;
+    auto& connections = reactor->connections;
+
+    epoll_event events[PARSER_REACTOR_EVENTS];
+    time_t lastSweep = time(nullptr);
 
     while (true) {
-        int clientSocket = accept(self->listenSocket, (struct sockaddr*) &clientAddr, &addrLen);
-        if (clientSocket < 0) {
-            continue;   // Accept failed; try again.
+        int ready = epoll_wait(reactor->epoll, events, PARSER_REACTOR_EVENTS, 1000);
+        if (ready < 0 && errno != EINTR) {
+            perror("epoll_wait");
         }
+        Metric_Timer busy(nullptr, reactor->busy);
 
-        self->talkLock.lock();
-        self->talkingSockets.push_back(clientSocket);
-        self->talkCV.signal();
-        self->talkLock.unlock();
+        for (int i = 0; i < ready; ++i) {
+            int sock = events[i].data.fd;
+            if (sock == parser->listenSocket) {
+                parser->acceptConnections(*reactor);
+                continue;
+            }
+            if (sock == reactor->wake) {
+                parser->creditLogged(*reactor);
+                continue;
+            }
+
+            auto it = connections.find(sock);
+            if (it != connections.end() && !parser->serviceConnection(sock, it->second)) {
+                close(sock);
+                connections.erase(it);
+                parser->openConnections--;
+            }
+        }
+
+        // drop connections whose crawler went away without closing them
+        time_t now = time(nullptr);
+        if (now - lastSweep >= PARSER_IDLE_TIMEOUT / 4) {
+            for (auto it = connections.begin(); it != connections.end();) {
+                if (now - it->second.lastActive >= PARSER_IDLE_TIMEOUT) {
+                    close(it->first);
+                    it = connections.erase(it);
+                    parser->openConnections--;
+                } else {
+                    ++it;
+                }
+            }
+            lastSweep = now;
+        }
     }
     return nullptr;
 }
 
+void Parser::acceptConnections(Reactor& reactor) {
+    while (true) {
+        int sock = accept4(listenSocket, nullptr, nullptr, SOCK_NONBLOCK);
+        if (sock < 0) {
+            if (errno == EMFILE || errno == ENFILE) {
+                // out of descriptors; leave the rest in the backlog until connections close
+                perror("accept4");
+                usleep(1000);
+            }
+            return;
+        }
+
+        ++stats.connectionsAccepted;
+        openConnections++;
+
+        Connection& connection = reactor.connections[sock];
+        connection = Connection{};
+        connection.acks = std::make_shared<Acks>(&reactor, sock);
+        connection.next = reinterpret_cast<char*>(connection.header);
+        connection.remaining = sizeof(connection.header);
+        connection.lastActive = time(nullptr);
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.fd = sock;
+        if (epoll_ctl(reactor.epoll, EPOLL_CTL_ADD, sock, &event) < 0) {
+            perror("epoll_ctl");
+            close(sock);
+            reactor.connections.erase(sock);
+            openConnections--;
+        }
+    }
+}
+
+// Reads what the crawler has sent, then grants it a credit for every page
+// it sent that was skipped and writes whatever the socket will take.  Returns
+// false once the connection should be closed.
+bool Parser::serviceConnection(int sock, Connection& connection) {
+    if (!readConnection(sock, connection)) {
+        return false;
+    }
+
+    if (connection.creditsOwed) {
+        ParserProtocol::put_u32(connection.output, connection.creditsOwed);
+        connection.creditsOwed = 0;
+    }
+    return writeConnection(sock, connection);
+}
+
+// Writes as much pending output as the socket takes; the rest waits for the
+// next EPOLLOUT edge.  Returns false if the connection broke.
+bool Parser::writeConnection(int sock, Connection& connection) {
+    while (!connection.output.empty()) {
+        ssize_t sent = send(sock, connection.output.data(), connection.output.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+
+        if (sent > 0) {
+            connection.output.erase(0, sent);
+        } else if (sent < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+    return true;
+}
+
+// Grants each connection of this reactor a credit for every page of it that
+// the log thread has logged since last time.
+void Parser::creditLogged(Reactor& reactor) {
+    uint64_t signals;
+    while (read(reactor.wake, &signals, sizeof(signals)) < 0 && errno == EINTR)
+        ;
+
+    std::vector<std::shared_ptr<Acks>> acked;
+    {
+        Lock_Guard<Mutex, &Mutex::lock> guard(reactor.mutex);
+        acked.swap(reactor.acked);
+    }
+    for (const auto& acks : acked) {
+        uint32_t logged = acks->logged.exchange(0);
+
+        // the connection may have closed, and its socket been reused, while its pages were in flight
+        auto it = reactor.connections.find(acks->sock);
+        if (it == reactor.connections.end() || it->second.acks != acks) {
+            continue;
+        }
+        Connection& connection = it->second;
+        ParserProtocol::put_u32(connection.output, connection.creditsOwed + logged);
+        connection.creditsOwed = 0;
+        if (!writeConnection(acks->sock, connection)) {
+            close(acks->sock);
+            reactor.connections.erase(it);
+            openConnections--;
+        }
+    }
+}
+
+// Called by the log thread once these pages are durable: queues an ack for
+// each, and wakes each reactor whose queue was empty.
+void Parser::acknowledge(const std::vector<std::shared_ptr<Acks>>& acks) {
+    for (const auto& page : acks) {
+        if (!page || page->logged++) {
+            // a legacy connection, or the reactor has yet to take this connection's earlier acks
+            continue;
+        }
+        Reactor& reactor = *page->reactor;
+        bool wake;
+        {
+            Lock_Guard<Mutex, &Mutex::lock> guard(reactor.mutex);
+            wake = reactor.acked.empty();
+            reactor.acked.push_back(page);
+        }
+        if (wake) {
+            uint64_t one = 1;
+            while (write(reactor.wake, &one, sizeof(one)) < 0 && errno == EINTR)
+                ;
+        }
+    }
+}
+
+// Reads everything the socket has buffered into the connection's current
+// field, parsing page bodies a chunk at a time as they arrive.  Returns false
+// once the connection should be closed: the page is complete, the crawler
+// hung up or the frame was rejected.
+bool Parser::readConnection(int sock, Connection& connection) {
+    static thread_local char chunk[PARSER_RECV_CHUNK];
+
+    while (true) {
+        bool body = connection.stage == Connection::Stage::Body || connection.stage == Connection::Stage::FrameBody;
+        char* into = body ? chunk : connection.next;
+        ssize_t received = recv(sock, into, body ? std::min(connection.remaining, sizeof(chunk)) : connection.remaining, 0);
+
+        if (received > 0) {
+            if (connection.pageStart == 0) {
+                connection.pageStart = Metric_Timer::now_ns();
+            }
+            if (!body) {
+                connection.next += received;
+            } else if (!readBody(connection, chunk, received)) {
+                return false;
+            }
+            connection.remaining -= received;
+            connection.lastActive = time(nullptr);
+            if (connection.remaining == 0 && !finishField(connection)) {
+                return false;
+            }
+        } else if (received < 0 && errno == EINTR) {
+            continue;
+        } else {
+            // edge triggered: EAGAIN means we have drained the socket and will hear about the next bytes
+            return received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+}
+
+// Parses the next piece of a page body.  Returns false if it is a corrupt
+// compressed body.
+bool Parser::readBody(Connection& connection, const char* data, size_t size) {
+    if (!connection.page) {
+        return true;
+    }
+    auto feed = [&](const char* body, size_t length) {
+        connection.page->Feed(body, length);
+        if (record) {
+            connection.dump.append(body, length);
+        }
+    };
+    if (connection.frame.flags & ParserProtocol::FLAG_COMPRESSED) {
+        return connection.inflater->feed(data, size, connection.frame.body_length, feed);
+    }
+    feed(data, size);
+    return true;
+}
+
+// Sets the connection up to parse a body of remaining bytes as it arrives.
+void Parser::startPage(Connection& connection, uint32_t remaining, uint32_t depth, uint32_t bodyLength) {
+    connection.page = std::make_unique<HtmlParser>(std::chrono::milliseconds(PARSER_PARSE_BUDGET_MS),
+                                                   PARSER_PARSE_MAX_BYTES);
+    connection.remaining = remaining;
+    if (record) {
+        connection.dump.clear();
+        ParserProtocol::put_dump_header(connection.dump, connection.url, depth, bodyLength);
+    }
+}
+
+// Appends a dump record to this thread's page dump file, starting a new file
+// every PARSER_DUMP_FILE_BYTES.
+static void dumpPage(const std::string& record) {
+    static const time_t started = time(nullptr);
+    static std::atomic<int> threads{0};
+    static thread_local int thread = threads++;
+    static thread_local int file = 0;
+    static thread_local int fd = -1;
+    static thread_local size_t written = 0;
+
+    if (fd < 0 || written >= PARSER_DUMP_FILE_BYTES) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        std::string name = std::string(PARSER_DUMP_FILE) + "." + std::to_string(started) + "."
+                           + std::to_string(thread) + "." + std::to_string(file++);
+        fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        written = 0;
+        if (fd < 0) {
+            perror(name.c_str());
+            return;
+        }
+    }
+    for (size_t at = 0; at < record.size();) {
+        ssize_t n = write(fd, record.data() + at, record.size() - at);
+        if (n < 0) {
+            perror(PARSER_DUMP_FILE);
+            return;
+        }
+        at += n;
+    }
+    written += record.size();
+}
+
+// Hands a completed page to the parse workers to finish.  Its crawler gets
+// the credit back through acks once the page is in the page log.
+void Parser::handOn(Connection& connection, int depth, std::shared_ptr<Acks> acks) {
+    stats.receiveLatency.record(Metric_Timer::now_ns() - connection.pageStart);
+    connection.pageStart = 0;
+
+    HtmlParser* page = connection.page.release();
+    page->pageURL = std::move(connection.url);
+    connection.url = std::string();
+    if (record) {
+        dumpPage(connection.dump);
+        connection.dump = std::string();
+    }
+
+    // blocks while the parse workers are behind; this reactor stops reading from crawlers until they catch up
+    parsePool.submit([this, page, depth, acks = std::move(acks)] { finishPage(page, depth, acks); });
+}
+
+// Moves the connection on to its next field.  Returns false once the
+// connection should be closed.
+bool Parser::finishField(Connection& connection) {
+    switch (connection.stage) {
+    case Connection::Stage::Header: {
+        if (ntohl(connection.header[0]) == ParserProtocol::MAGIC) {
+            // a streaming crawler: answer the hello, then read frames until it hangs up
+            const char* hello = reinterpret_cast<const char*>(connection.header);
+            uint16_t version = ParserProtocol::get_u16(hello + 4);
+            uint16_t flags = ParserProtocol::get_u16(hello + 6) & ParserProtocol::FLAG_COMPRESSION;
+            if (version == 0) {
+                return false;
+            }
+
+            connection.compression = flags & ParserProtocol::FLAG_COMPRESSION;
+            connection.output += ParserProtocol::encode_welcome(std::min(version, ParserProtocol::VERSION), flags,
+                                                                PARSER_STREAM_CREDITS);
+            connection.pageStart = 0;
+            connection.next = reinterpret_cast<char*>(&connection.bodySize);
+            connection.remaining = sizeof(connection.bodySize);
+            connection.stage = Connection::Stage::FrameLength;
+            return true;
+        }
+
+        uint32_t url_size = ntohl(connection.header[0]);
+        if (url_size == 0 || url_size > PARSER_MAX_URL_SIZE) {
+            return false;
+        }
+        connection.url.resize(url_size);
+        connection.next = connection.url.data();
+        connection.remaining = url_size;
+        connection.stage = Connection::Stage::Url;
+        return true;
+    }
+
+    case Connection::Stage::Url: {
+        // skip the body of a page we have already logged
+        ++stats.pagesReceived;
+        if (filter.contains(connection.url)) {
+            ++stats.pagesDuplicate;
+            return false;
+        }
+
+        connection.next = reinterpret_cast<char*>(&connection.bodySize);
+        connection.remaining = sizeof(connection.bodySize);
+        connection.stage = Connection::Stage::BodySize;
+        return true;
+    }
+
+    case Connection::Stage::BodySize: {
+        uint32_t body_size = ntohl(connection.bodySize);
+        if (body_size == 0 || body_size > PARSER_MAX_PAGE_SIZE) {
+            return false;
+        }
+        connection.frame.flags = 0;
+        startPage(connection, body_size, ntohl(connection.header[1]), body_size);
+        connection.stage = Connection::Stage::Body;
+        return true;
+    }
+
+    case Connection::Stage::Body:
+        handOn(connection, ntohl(connection.header[1]), nullptr);
+
+        // Close the connection; no need to send a response.
+        return false;
+
+    case Connection::Stage::FrameLength: {
+        uint32_t frame_size = ntohl(connection.bodySize);
+        if (frame_size < ParserProtocol::FRAME_HEADER_SIZE || frame_size > ParserProtocol::MAX_FRAME_SIZE) {
+            return false;
+        }
+        connection.next = connection.frameHeader;
+        connection.remaining = ParserProtocol::FRAME_HEADER_SIZE;
+        connection.stage = Connection::Stage::FrameHeader;
+        return true;
+    }
+
+    case Connection::Stage::FrameHeader: {
+        auto& frame = connection.frame;
+        if (!ParserProtocol::parse_page_header(connection.frameHeader, ntohl(connection.bodySize), frame)
+            || ((frame.flags & ParserProtocol::FLAG_COMPRESSED) && !connection.compression)) {
+            return false;
+        }
+        connection.url.resize(frame.url_length);
+        connection.next = connection.url.data();
+        connection.remaining = frame.url_length;
+        connection.stage = Connection::Stage::FrameUrl;
+        return true;
+    }
+
+    case Connection::Stage::FrameUrl: {
+        // skip the body of a page we have already logged, reading it without parsing it
+        ++stats.pagesReceived;
+        if (filter.contains(connection.url)) {
+            ++stats.pagesDuplicate;
+            connection.page.reset();
+            connection.remaining = connection.frame.payload_length;
+        } else {
+            startPage(connection, connection.frame.payload_length, connection.frame.depth,
+                      connection.frame.body_length);
+            if (connection.frame.flags & ParserProtocol::FLAG_COMPRESSED) {
+                if (!connection.inflater) {
+                    connection.inflater = std::make_unique<ParserProtocol::Inflater>();
+                }
+                connection.inflater->reset();
+            }
+        }
+        connection.stage = Connection::Stage::FrameBody;
+        return true;
+    }
+
+    case Connection::Stage::FrameBody:
+        if (connection.page) {
+            if ((connection.frame.flags & ParserProtocol::FLAG_COMPRESSED)
+                && !connection.inflater->finished(connection.frame.body_length)) {
+                return false;
+            }
+            // its credit comes back once it is in the page log; until then the crawler must keep it
+            handOn(connection, connection.frame.depth, connection.acks);
+        } else {
+            ++connection.creditsOwed;
+        }
+        connection.pageStart = 0;
+
+        connection.next = reinterpret_cast<char*>(&connection.bodySize);
+        connection.remaining = sizeof(connection.bodySize);
+        connection.stage = Connection::Stage::FrameLength;
+        return true;
+    }
+    return false;
+}
+
 void* Parser::async_index_save(void* arg) {
     auto parser = static_cast<Parser*>(arg);
+    Metric_Counter& busy = busyCounter("save-" + std::to_string(parser->saveThreads++));
 
     while(true) {
-        parser->toSaveLock.lock();
-        while(parser->toSave.empty()) {
-            parser->toSaveCV.wait(parser->toSaveLock);
-        }
-        auto index_save = parser->toSave.back();
-        parser->toSave.pop_back();
-        parser->toSaveLock.unlock();
+        auto index_save = parser->toSave.pop();
+        Metric_Timer timer(&parser->stats.chunkSaveLatency, &busy);
 
         auto index = index_save->index;
 
@@ -184,17 +711,21 @@ void* Parser::async_index_save(void* arg) {
         parser->save();
         IndexFile file(name.c_str(), index);
         delete index;
+        parser->stats.chunkBytesSaved += file.Size();
+        parser->stats.chunkBytes.record(file.Size());
         file.close_file();
 
+        // the chunk is on disk, so its pages need not be replayed after a crash
+        parser->log.checkpoint(index_save->logged);
+
         time_t end = time(nullptr);
 
         irs::cout << doc_count << " pages written to " << name << " after " << end - mid << " seconds" <<  irs::endl;
         delete index_save;
 
         // Update stats
-        parser->toSaveLock.lock();
-        parser->total_saved += doc_count;
-        parser->toSaveLock.unlock();
+        parser->stats.pagesSaved += doc_count;
+        ++parser->stats.chunksSaved;
     }
 
     return nullptr;
@@ -202,10 +733,16 @@ void* Parser::async_index_save(void* arg) {
 
 void* Parser::IndexSaveThread(void* arg) {
     auto parser = static_cast<Parser*>(arg);
+    Metric_Counter& busy = busyCounter("index-" + std::to_string(parser->indexThreads++));
 
     // Index forever
     while(true) {
+        // the chunk's age counts from its first page, so an idle parser holds no open chunk
+        auto logged = parser->parsedPages.pop();
         time_t begin = time(nullptr);
+        timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += INDEX_CHUNK_MAX_AGE;
 
         auto index = new Index{};
 
@@ -214,173 +751,171 @@ void* Parser::IndexSaveThread(void* arg) {
         index_args->time = begin;
         index_args->parser = parser;
 
-        // While we have not met threshold
-        while (index->DocumentsInIndex < MIN_PAGES_PER_CHUNK) {
-            parser->parsedPagesLock.lock();
-            while (parser->parsedPages.empty()) {
-                parser->parsedPagesCV.wait(parser->parsedPagesLock);
+        // Cut the chunk at whichever limit comes first: pages, memory or age
+        Metric_Counter* reason = &parser->stats.chunksOld;
+        do {
+            {
+                Metric_Timer timer(&parser->stats.indexInsertLatency, &busy);
+                index->Insert(logged.page);
+                delete logged.page;
             }
-            auto html = parser->parsedPages.back();
-            parser->parsedPages.pop_back();
-            parser->parsedPagesLock.unlock();
-
-            index->Insert(html);
-            delete html;
+            index_args->logged.push_back(logged.sequence);
 
             // Update stats
-            parser->parsedPagesLock.lock();
-            parser->total_indexed++;
-            parser->parsedPagesLock.unlock();
-        }
+            ++parser->stats.pagesIndexed;
+
+            if (index->DocumentsInIndex >= MIN_PAGES_PER_CHUNK) {
+                reason = &parser->stats.chunksFull;
+                break;
+            }
+            if (index->MemoryBytes >= INDEX_CHUNK_MAX_BYTES) {
+                reason = &parser->stats.chunksLarge;
+                break;
+            }
+        } while (parser->parsedPages.pop_until(logged, deadline));
 
-        parser->parsedPagesLock.lock();
+        if (index->DocumentsInIndex == 0) {
+            // every page was rejected by the index; there is nothing to save
+            parser->log.checkpoint(index_args->logged);
+            delete index;
+            delete index_args;
+            continue;
+        }
+        ++*reason;
+        parser->stats.chunkDocuments.record(index->DocumentsInIndex);
+        parser->stats.chunkMemory.record(index->MemoryBytes);
         index_args->chunk_count = parser->index_chunk_count++;
-        parser->parsedPagesLock.unlock();
 
-        parser->toSaveLock.lock();
-        parser->toSave.push_back(index_args);
-        parser->toSaveCV.signal();
-        parser->toSaveLock.unlock();
+        // blocks while every save thread is busy, so at most a few chunks wait in memory
+        parser->toSave.push(index_args);
     }
     return nullptr;
 }
 
 void Parser::save() {
-    filter_lock.lock();
-    filter.save(PARSER_FILTER_FILE);
-    filter_lock.unlock();
+    // writes back only the blocks touched since the last save; the reactors keep inserting meanwhile
+    filter.sync();
 }
 
-// The talk thread: reads the HTTP header and body, then spawns the parser thread.
-void* Parser::talk(void* _args) {
-    auto parser = static_cast<Parser*>(_args);
-    auto& filter = parser->filter;
-    auto& filter_lock = parser->filter_lock;
-    auto& talkLock = parser->talkLock;
-    auto& talkCV = parser->talkCV;
-    auto& talkingSockets = parser->talkingSockets;
-
-    while (true) {
-        talkLock.lock();
-        while (talkingSockets.empty()) {
-            talkCV.wait(talkLock);
+static bool sendAll(int sock, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(sock, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
         }
-        int sock = talkingSockets.back();
-        talkingSockets.pop_back();
-        talkLock.unlock();
-
-        std::string url;
-        uint32_t url_size;
-        if (recv(sock, &url_size, sizeof(url_size), MSG_WAITALL) <= 0) {
-            close(sock);
-            continue;
-        }
-        url_size = ntohl(url_size);
+        sent += n;
+    }
+    return true;
+}
+// A parse task: parses the rest of a page the reactor has been parsing as it
+// arrived, sends its links to the crawlers and hands it to the indexer.
+void Parser::finishPage(HtmlParser* page, int depth, std::shared_ptr<Acks> acks) {
+    page->Finish();
+    stats.parseLatency.record(page->parseTime.count());
+    if (page->truncated) {
+        ++stats.pagesTruncated;
+    }
 
-        uint32_t url_depth;
-        if (recv(sock, &url_depth, sizeof(url_depth), MSG_WAITALL) <= 0) {
-            close(sock);
-            continue;
-        }
-        url_depth = ntohl(url_depth);
+    sendLinksList(*page, depth + 1);
 
-        url.resize(url_size);
-        if (recv(sock, url.data(), url_size, MSG_WAITALL) <= 0) {
-            close(sock);
-            continue;
-        }
+    toLog.push(PageRecord{page, PageLog::encodePage(*page, depth), std::move(acks)});
+    ++stats.pagesParsed;
+}
 
-        filter_lock.lock();
-        if (filter.contains(url)) {
-            filter_lock.unlock();
-            close(sock);
-            continue;
+// Writes parsed pages to the page log, as many at a time as have queued up
+// while the last batch was being synced.  Once they are durable, their urls
+// go into the filter, their crawlers get their credits back and they go on to
+// the indexer.  A page whose url was logged while it was being parsed, sent
+// twice by the crawlers, is dropped here rather than indexed twice.
+void* Parser::LogThread(void* arg) {
+    auto parser = static_cast<Parser*>(arg);
+    Metric_Counter& busy = busyCounter("log");
+
+    std::vector<PageRecord> batch;
+    std::vector<std::string> payloads;
+    std::vector<uint64_t> sequences;
+    std::vector<HtmlParser*> pages;
+    std::vector<std::shared_ptr<Acks>> acks;
+    std::unordered_set<std::string_view> urls;
+    while (true) {
+        batch.push_back(parser->toLog.pop());
+        PageRecord record;
+        while (batch.size() < PARSER_LOG_BATCH && parser->toLog.try_pop(record)) {
+            batch.push_back(std::move(record));
         }
-        filter.insert(url);
-        filter_lock.unlock();
 
-        std::string body;
-        uint32_t body_size;
-        if (recv(sock, &body_size, sizeof(body_size), MSG_WAITALL) <= 0) {
-            close(sock);
-            continue;
+        {
+            Metric_Timer timer(&parser->stats.logCommitLatency, &busy);
+            // the reactors only check the filter and this thread inserts, so nothing slips in between the two
+            for (auto& logged : batch) {
+                if (parser->filter.contains(logged.page->pageURL) || !urls.insert(logged.page->pageURL).second) {
+                    ++parser->stats.pagesDuplicate;
+                    delete logged.page;
+                } else {
+                    payloads.push_back(std::move(logged.payload));
+                    pages.push_back(logged.page);
+                }
+                acks.push_back(std::move(logged.acks));
+            }
+            if (!pages.empty()) {
+                parser->log.append(payloads, sequences);
+            }
+            for (HtmlParser* page : pages) {
+                parser->filter.insert(page->pageURL);
+            }
+            urls.clear();
         }
-        body_size = ntohl(body_size);
-        body.resize(body_size);
+        parser->stats.pagesLogged += pages.size();
+        parser->acknowledge(acks);
 
-        if (recv(sock, body.data(), body_size, MSG_WAITALL) <= 0) {
-            close(sock);
-            continue;
+        for (size_t i = 0; i < pages.size(); ++i) {
+            parser->parsedPages.push(LoggedPage{pages[i], sequences[i]});
         }
-
-        // Close the connection; no need to send a response.
-        close(sock);
-
-        // Spawn a new thread to process the HTML with your parser.
-        ParseArgs* pargs = new ParseArgs;
-        pargs->url = std::move(url);
-        pargs->html = std::move(body);
-        pargs->depth = url_depth;
-
-        parser->toParseLock.lock();
-        parser->toParse.push_back(pargs);
-        parser->toParseCV.signal();
-        parser->toParseLock.unlock();
+        batch.clear();
+        payloads.clear();
+        pages.clear();
+        acks.clear();
     }
-
     return nullptr;
 }
 
-template<typename T>
-void cleanup(void* p) {
-    delete static_cast<T*>(p);
-};
-//
-// The parser thread: creates an instance of HtmlParser.
-void* Parser::parserThread(void* arg) {
-    auto parser = static_cast<Parser*>(arg);
-    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, nullptr);
-    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, nullptr);
-
-    while (true) {
-        parser->toParseLock.lock();
-        while (parser->toParse.empty()) {
-            parser->toParseCV.wait(parser->toParseLock);
+// Indexes the pages the last run logged but never saved in a chunk.  The
+// links they held were lost along with the crawlers' queues, so they are
+// sent again; a crawler drops any it has already seen.
+void Parser::replayLog() {
+    size_t lost = 0;
+    log.replay([&](uint64_t sequence, std::string& payload) {
+        int depth;
+        HtmlParser* page = PageLog::decodePage(payload, depth);
+        if (!page) {
+            ++lost;
+            return;
         }
-
-        auto pargs = parser->toParse.back();
-        pthread_cleanup_push(cleanup<ParseArgs>, pargs);
-        parser->toParse.pop_back();
-        parser->toParseLock.unlock();
-
-        HtmlParser* html_parser = new HtmlParser(pargs->html.data(), pargs->html.size());
-        pthread_cleanup_push(cleanup<HtmlParser>, html_parser);
-        html_parser->pageURL = pargs->url;
-
-        parser->sendLinksList(*html_parser, pargs->depth + 1, FRONTIER_PORT);
-
-        parser->parsedPagesLock.lock();
-        parser->parsedPages.push_back(html_parser);
-        pthread_cleanup_pop(0);
-        html_parser = nullptr;
-        parser->total_parsed++;
-        parser->parsedPagesCV.signal();
-        parser->parsedPagesLock.unlock();
-
-        delete pargs;
-        pthread_cleanup_pop(0);
-        pargs = nullptr;
+        // the crash may have come between logging the page and putting its url in the filter
+        filter.insert(page->pageURL);
+        sendLinksList(*page, depth + 1);
+        parsedPages.push(LoggedPage{page, sequence});
+        ++stats.pagesReplayed;
+    });
+
+    if (stats.pagesReplayed.value() || lost) {
+        irs::cout << "replayed " << stats.pagesReplayed.value() << " pages from the page log";
+        if (lost) {
+            irs::cout << ", " << lost << " unreadable";
+        }
+        irs::cout << irs::endl;
     }
-    return nullptr;
 }
 
 void* Parser::SendLinkThread(void* arg) {
     auto args = static_cast<SendArgs*>(arg);
     auto parser = args->parser;
     auto index = args->crawler_index;
+    auto busy = args->busy;
     delete args;
 
-    auto& crawler = parser->crawlers[index];
+    auto& crawler = *parser->crawlers[index];
 
     // Set up the destination address (localhost).
     sockaddr_in destAddr;
@@ -418,73 +953,112 @@ void* Parser::SendLinkThread(void* arg) {
         }
 
         sleep_time = 1;
+        ++crawler.senders;
 
-        // While connected, send links
+        // While connected, send links.  Each send takes every batch already queued, up to PARSER_LINK_SEND_BYTES,
+        // so a busy parser makes few large writes instead of three small ones per link
+        std::string buffer;
+        if (crawler.batched) {
+            buffer = ParserProtocol::encode_link_hello();
+        }
         while(true) {
-            crawler.lock.lock();
-            while (crawler.links.empty()) {
-                crawler.cv.wait(crawler.lock);
-            }
-            auto data = crawler.links.back();
-            crawler.links.pop_back();
-            crawler.lock.unlock();
-
-            auto url = data->url;
-            auto depth = data->depth;
-            delete data;
-
-            // Prepare the payload length.
-            uint32_t len = htonl(static_cast<uint32_t>(url.size()));
-            if (send(sock, &len, sizeof(len), MSG_NOSIGNAL) <= 0) {
-                perror("send length");
-                break;
-            }
-
-            // Prepare the payload length.
-            uint32_t url_depth = htonl(static_cast<uint32_t>(depth));
-            if (send(sock, &url_depth, sizeof(url_depth), MSG_NOSIGNAL) <= 0) {
-                perror("send depth");
-                break;
+            auto data = crawler.links.pop();
+            Metric_Timer timer(nullptr, busy);
+            std::map<int, std::vector<std::string>> byDepth;
+            size_t bytes = 0;
+            do {
+                auto& urls = byDepth[data->depth];
+                for (auto& url: data->urls) {
+                    bytes += url.size() + 2 * sizeof(uint32_t);
+                    urls.push_back(std::move(url));
+                }
+                delete data;
+            } while (bytes < PARSER_LINK_SEND_BYTES && crawler.links.try_pop(data));
+
+            for (auto& [depth, urls]: byDepth) {
+                if (crawler.batched) {
+                    // pages at the same depth often share links, and sorted urls front code well
+                    std::sort(urls.begin(), urls.end());
+                    urls.erase(std::unique(urls.begin(), urls.end()), urls.end());
+                    ParserProtocol::encode_links(buffer, depth, urls);
+                } else {
+                    for (const auto& url: urls) {
+                        ParserProtocol::put_u32(buffer, url.size());
+                        ParserProtocol::put_u32(buffer, depth);
+                        buffer += url;
+                    }
+                }
             }
 
-            // Send the payload.
-            ssize_t sent = send(sock, url.c_str(), url.size(), MSG_NOSIGNAL);
-            if (sent <= 0) {
-                perror("send payload");
+            if (!sendAll(sock, buffer)) {
+                perror("send links");
                 break;
             }
+            parser->stats.linkBytesSent += buffer.size();
+            buffer.clear();
         }
 
         // Sending failed, close socket
+        --crawler.senders;
         close(sock);
     }
 
     return nullptr;
 };
 
-// Function to send a list of links in one message.
-void Parser::sendLinksList(const HtmlParser& parser, int depth, int port) {
+// Resolves a page's links, drops duplicates and queues them for the crawlers
+// as one batch per crawler.
+void Parser::sendLinksList(const HtmlParser& parser, int depth) {
+    // a <base href> may itself be relative to the page
+    std::string base = parser.base.empty() ? std::string() : ResolveUrl(parser.pageURL, parser.base);
+    if (base.empty()) {
+        base = parser.pageURL;
+    }
+    std::string self = NormalizeUrl(parser.pageURL);
+
+    std::vector<std::string> urls;
+    urls.reserve(parser.links.size());
     for (const auto& link: parser.links) {
-        std::string url;
-        if (link.URL.compare(0, 4, "http") != 0) {
-            if (parser.base.empty()) {
-                // Not an http url so skip it
-                continue;
-            } else {
-                url = parser.base + link.URL;
-            }
-        } else {
-            url = link.URL;
+        std::string url = ResolveUrl(base, link.URL);
+        if (!url.empty() && url != self) {
+            urls.push_back(std::move(url));
         }
-
-        // Randomly assign url
-        auto crawler_index = rand() % crawlers.size();
-        auto& crawler = crawlers[crawler_index];
-        crawler.lock.lock();
-        crawler.links.push_back(new SendUrl{url, depth});
-        crawler.cv.signal();
-        crawler.lock.unlock();
     }
+    std::sort(urls.begin(), urls.end());
+    urls.erase(std::unique(urls.begin(), urls.end()), urls.end());
+
+    // Every url of a host goes to the crawler that owns the host, so that one crawler's filter sees all of them and
+    // its requests to the host can be paced.  Sorted urls come grouped by host, so most need no new pick; sorted
+    // input also keeps every batch sorted
+    std::vector<SendBatch*> batches(crawlers.size(), nullptr);
+    std::string host;
+    size_t owner = 0;
+    for (auto& url: urls) {
+        if (host.empty() || UrlHost(url) != host) {
+            host = UrlHost(url);
+            owner = RendezvousPick(host, peers);
+        }
+        auto& batch = batches[owner];
+        if (!batch) {
+            batch = new SendBatch{depth, {}};
+        }
+        batch->urls.push_back(std::move(url));
+    }
+    stats.linksQueued += urls.size();
+
+    // A full queue holds this parse worker a little while for its crawler to catch up, and then, or at once if the
+    // crawler is down, the batch is dropped.  Sending it to another crawler instead would split the host between two
+    // filters; waiting on indefinitely would let one dead crawler stop every page from being parsed
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += PARSER_LINK_WAIT_MS * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    QueuedBatches queued = QueueToOwners(
+        batches, [this](size_t i) -> auto& { return crawlers[i]->links; },
+        [this](size_t i) { return crawlers[i]->senders.load(std::memory_order_relaxed) > 0; }, deadline);
+    stats.linkBatchesWaited += queued.waited;
+    stats.linkBatchesDropped += queued.dropped;
 }
 
 void Parser::readPeers() {
@@ -497,8 +1071,8 @@ void Parser::readPeers() {
     auto size = file_size(fd);
     if (!size) {
         close(fd);
-        crawlers.resize(1);
-        crawlers[0].ip = "127.0.0.1";
+        crawlers.push_back(std::make_unique<Crawler>());
+        crawlers[0]->ip = "127.0.0.1";
         return;
     }
 
@@ -516,46 +1090,53 @@ void Parser::readPeers() {
         }
     }
 
-    crawlers.resize(ips.size());
-    for (int i = 0; i < ips.size(); ++i) {
-        crawlers[i].ip = ips[i];
+    // each line is an ip, optionally followed by a weight (1 by default) and "batched"
+    for (char* line: ips) {
+        char* save = nullptr;
+        char* ip = strtok_r(line, " \t", &save);
+        if (!ip) {
+            continue;
+        }
+        crawlers.push_back(std::make_unique<Crawler>());
+        crawlers.back()->ip = ip;
+        for (char* option = strtok_r(nullptr, " \t", &save); option; option = strtok_r(nullptr, " \t", &save)) {
+            if (!strcmp(option, "batched")) {
+                crawlers.back()->batched = true;
+            } else if (atof(option) > 0) {
+                crawlers.back()->weight = atof(option);
+            }
+        }
+    }
+    if (crawlers.empty()) {
+        crawlers.push_back(std::make_unique<Crawler>());
+        crawlers[0]->ip = "127.0.0.1";
     }
 
     munmap(map, size);
 }
 
-void Parser::resetParserThreadsIfNeeded() {
-    toParseLock.lock();
-    if (toParse.size() > MIN_PAGES_PER_CHUNK) {
-        for (int i = 0; i < NUM_PARSE_THREADS; ++i) {
-            pthread_cancel(save_threads[i]);
-            pthread_join(save_threads[i], nullptr);
-            pthread_t parser_thread;
-            if (pthread_create(&parser_thread, nullptr, Parser::parserThread, this) != 0) {
-                perror("pthread_create");
-                exit(EXIT_FAILURE);
-            }
-            save_threads[i] = parser_thread;
-        }
-        irs::cout << "Parser threads were frozen. Restarting.\n" << irs::endl;
+int main(int argc, char** argv) {
+    bool record = PARSER_DUMP_PAGES || (argc > 1 && strcmp(argv[1], "record") == 0);
+    if (argc > 1 && !record) {
+        irs::cerr << "usage: " << argv[0] << " [record]" << irs::endl;
+        return 1;
     }
-    toParseLock.unlock();
-}
 
-int main() {
     time_t begin = time(nullptr);
-    Parser parser {};
+    Parser parser {record};
     while (true) {
         sleep(PARSER_SAVE_TIME);
         irs::cout << "\nParser is alive for " << time(nullptr) - begin << " seconds";
-        irs::cout << "\nParser toParse size: " << parser.toParse.size();
+        irs::cout << "\nPages waiting to parse: " << parser.pagesWaitingToParse();
         irs::cout << "\nParser parsedPages size: " << parser.parsedPages.size();
         irs::cout << "\nParser toSave size: " << parser.toSave.size();
-        irs::cout << "\nTotal parsed: " << parser.total_parsed;
-        irs::cout << "\nTotal indexed: " << parser.total_indexed;
-        irs::cout << "\nTotal saved: " << parser.total_saved << irs::endl;
-
-        parser.resetParserThreadsIfNeeded();
+        irs::cout << "\nTotal parsed: " << parser.stats.pagesParsed.value() << " ("
+                  << parser.stats.pagesTruncated.value() << " cut off at the deadline)";
+        irs::cout << "\nTotal replayed from the page log: " << parser.stats.pagesReplayed.value();
+        irs::cout << "\nTotal indexed: " << parser.stats.pagesIndexed.value();
+        irs::cout << "\nTotal saved: " << parser.stats.pagesSaved.value();
+        irs::cout << "\nStem cache hit rate: " << static_cast<uint64_t>(Stem_Cache::get_instance().hit_rate() * 100)
+                  << "% (" << Stem_Cache::get_instance().get_misses() << " misses)" << irs::endl;
     }
 
     return 0;
@@ -2,112 +2,236 @@
 #define PARSER_H
 
 #include "HtmlParser.h"
+#include "PageLog.h"
+#include "Rendezvous.h"
+#include "protocol_parser.h"
+#include <atomic>
 #include <cstddef>
+#include <memory>
+#include <unordered_map>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <string>
+#include <vector>
 #include <pthread.h>
 
 #include "../lib/BloomFilter.h"
+#include "../lib/constants.h"
+#include "../lib/metrics.h"
 #include "../lib/mutex.h"
-#include "../lib/cv.h"
+#include "../lib/mpmc_queue.h"
+#include "../lib/work_stealing_pool.h"
 #include "../indexer/Indexer.hpp"
 
 
 class Parser;
 
-struct ParseArgs {
-    std::string url;
-    std::string html;
-    int depth;
-};
-
 struct IndexSave {
     int chunk_count;
     Index* index;
     Parser* parser;
     time_t time;
+    std::vector<uint64_t> logged;   // its pages' sequence numbers in the page log
+};
+
+// A parsed page, once it is in the page log.
+struct LoggedPage {
+    HtmlParser* page = nullptr;
+    uint64_t sequence = 0;
 };
 
-// The Parser class continuously listens for HTML data from a crawler.
-// For each connection, it spawns a thread (talk) to read and validate the HTTP
-// header, then it reads the HTML body and spawns another thread that creates an
-// instance of the HTML parser class.
+// The Parser class continuously listens for HTML data from crawlers.
+// Reactor threads, one per core, each run an edge-triggered epoll loop over
+// non-blocking crawler connections, so a slow crawler never holds a thread.
+// A page is parsed as its bytes arrive, by a streaming instance of the HTML
+// parser class, so a connection holds the bytes of one read and the parse so
+// far rather than the whole page.  The parse has a time budget and a byte
+// cap, so that a pathological page is cut short rather than left to hold its
+// reactor.  Completed pages become tasks for a work-stealing pool with a
+// worker per core, which finishes the parse and passes the page on.  A
+// parsed page is written to the page log before it is indexed, and only
+// then does its url go into the filter and its crawler get the credit back,
+// so a crash loses no page that the filter says was parsed or that a
+// crawler has let go of (see PageLog.h).
+//
+// The stages hand work to each other through bounded FIFO queues.  When a
+// stage falls behind, its queue fills and the stage before it blocks, all the
+// way back to the reactors, which then stop reading from crawler sockets.
 class Parser {
 public:
 
-    // Constructor: Initializes the listening socket on the given port.
-    Parser();
+    // Constructor: Initializes the listening socket on the given port.  A
+    // recording parser also writes every page it receives to page dump files
+    // (see protocol_parser.h), which parser_test/load_generator can replay.
+    explicit Parser(bool record = PARSER_DUMP_PAGES);
     ~Parser();
 
     void save();
-    void resetParserThreadsIfNeeded();
 
-    int index_chunk_count;
-    std::vector<ParseArgs*> toParse;
-    std::vector<HtmlParser*> parsedPages;
-    std::vector<IndexSave*> toSave;
-    size_t total_parsed = 0;
-    size_t total_indexed = 0;
-    size_t total_saved = 0;
+    size_t pagesWaitingToParse() const {
+        return parsePool.pending_tasks();
+    }
+
+    std::atomic<int> index_chunk_count;
+    Bounded_MPMC_Queue<LoggedPage> parsedPages{PARSER_PARSED_QUEUE_SIZE};
+    Bounded_MPMC_Queue<IndexSave*> toSave{PARSER_SAVE_QUEUE_SIZE};
+
+    // Served on PARSER_METRICS_PORT in the Prometheus text format, along with
+    // queue depths and per-thread busy time.
+    struct Stats {
+        Metric_Counter& pagesReceived;
+        Metric_Counter& pagesDuplicate;
+        Metric_Counter& pagesParsed;
+        Metric_Counter& pagesTruncated;
+        Metric_Counter& pagesIndexed;
+        Metric_Counter& pagesSaved;
+        Metric_Counter& pagesLogged;
+        Metric_Counter& pagesReplayed;
+        Metric_Counter& linksQueued;
+        Metric_Counter& linkBytesSent;
+        Metric_Counter& linkBatchesWaited;    // batches whose crawler's queue was full; never sent elsewhere
+        Metric_Counter& linkBatchesDropped;   // ... and stayed full, or whose crawler was down
+        Metric_Counter& chunksSaved;
+        Metric_Counter& chunkBytesSaved;
+        Metric_Counter& connectionsAccepted;
+        Metric_Counter& chunksFull;           // chunks cut for reaching MIN_PAGES_PER_CHUNK
+        Metric_Counter& chunksLarge;          // ... INDEX_CHUNK_MAX_BYTES
+        Metric_Counter& chunksOld;            // ... INDEX_CHUNK_MAX_AGE
+        Metric_Histogram& receiveLatency;     // first byte of a page to its last, in ns
+        Metric_Histogram& parseLatency;
+        Metric_Histogram& logCommitLatency;
+        Metric_Histogram& indexInsertLatency;
+        Metric_Histogram& chunkSaveLatency;
+        Metric_Histogram& chunkDocuments;
+        Metric_Histogram& chunkMemory;        // the chunk's footprint in memory when it was cut
+        Metric_Histogram& chunkBytes;         // its size on disk
+
+        Stats();
+    } stats;
 
 private:
 
     int listenSocket;
     struct sockaddr_in listenAddress;
     int port; // listening port
-    std::vector<pthread_t> save_threads;
+    bool record;
 
-    Bloomfilter filter;
-    Mutex filter_lock;
+    Blocked_Bloomfilter filter;     // urls of pages in the page log; lock-free
 
-    Mutex talkLock;
-    CV talkCV;
-    std::vector<int> talkingSockets;
+    struct Reactor;
 
-    Mutex parsedPagesLock;
-    CV parsedPagesCV;
+    // The pages of one streaming connection that have reached the page log
+    // and are owed back to its crawler as credits.  Shared with the pages in
+    // flight, which may outlive the connection.
+    struct Acks {
+        Reactor* reactor;
+        int sock;
+        std::atomic<uint32_t> logged{0};
 
-    Mutex toParseLock;
-    CV toParseCV;
+        Acks(Reactor* reactor, int sock) : reactor(reactor), sock(sock) {}
+    };
 
-    Mutex toSaveLock;
-    CV toSaveCV;
+    // Parsed pages on their way into the page log, already deflated.
+    struct PageRecord {
+        HtmlParser* page = nullptr;
+        std::string payload;
+        std::shared_ptr<Acks> acks;     // none for a legacy connection
+    };
+    Bounded_MPMC_Queue<PageRecord> toLog{PARSER_LOG_QUEUE_SIZE};
+    PageLog log;
 
-    struct SendUrl {
-        std::string url;
+    // The distinct links of one page bound for one crawler, sorted.
+    struct SendBatch {
         int depth;
+        std::vector<std::string> urls;
     };
 
     struct Crawler {
         std::string ip;
-        std::vector<SendUrl*> links;
-        Mutex lock;
-        CV cv;
+        bool batched = false;   // takes front-coded link batches rather than one triple per link
+        double weight = 1;      // share of hosts relative to the other crawlers
+        Bounded_MPMC_Queue<SendBatch*> links{PARSER_LINK_QUEUE_SIZE};
+        std::atomic<int> senders{0};    // send threads connected to it; with none, nothing drains links
     };
-    std::vector<Crawler> crawlers;
+    std::vector<std::unique_ptr<Crawler>> crawlers;
+    std::vector<RendezvousPeer> peers;     // the crawlers' rendezvous seeds and weights, in the same order
 
     struct SendArgs {
         Parser* parser;
         size_t crawler_index;
+        Metric_Counter* busy;
     };
 
-    // Structures for passing thread arguments.
-    struct TalkArgs {
-        int socket;
+    // Names threads that register a busy-time counter as they start.
+    std::atomic<int> indexThreads{0};
+    std::atomic<int> saveThreads{0};
+    static Metric_Counter& busyCounter(const std::string& thread);
+
+    // A crawler connection being read by a reactor.  A legacy connection
+    // carries one page; a streaming connection opens with a hello and then
+    // carries page frames until the crawler hangs up (see protocol_parser.h).
+    struct Connection {
+        enum class Stage { Header, Url, BodySize, Body, FrameLength, FrameHeader, FrameUrl, FrameBody };
+
+        Stage stage = Stage::Header;
+        uint32_t header[2];         // url size and depth, or the streaming hello
+        uint32_t bodySize;          // also the frame length when streaming
+        char frameHeader[ParserProtocol::FRAME_HEADER_SIZE];
+        ParserProtocol::PageHeader frame;
+        std::string url;
+        std::unique_ptr<HtmlParser> page;   // the body parsed so far; none while a duplicate's body is skipped
+        std::unique_ptr<ParserProtocol::Inflater> inflater;
+        std::string dump;           // the page as a dump record, when recording
+        char* next;                 // where the next byte of the current field goes
+        size_t remaining;           // bytes still missing from the current field
+        time_t lastActive;
+        uint64_t pageStart = 0;     // when the current page's first byte arrived, in ns; 0 before it has
+
+        bool compression = false;   // streaming crawler may send deflated bodies
+        uint32_t creditsOwed = 0;   // pages logged or skipped since the last credit message
+        std::shared_ptr<Acks> acks;
+        std::string output;         // welcome and credits not yet written to the socket
+    };
+
+    // The connections owned by one reactor thread, keyed by socket.  The log
+    // thread queues the acks of newly logged pages and signals wake, since
+    // only the reactor may write to its connections.
+    struct Reactor {
         Parser* parser;
+        int epoll;
+        std::unordered_map<int, Connection> connections;
+        Metric_Counter* busy;
+        int wake;                   // an eventfd
+        Mutex mutex;
+        std::vector<std::shared_ptr<Acks>> acked;
     };
+    std::atomic<int64_t> openConnections{0};
 
     // Thread functions.
-    static void* listener(void* arg);
-    static void* talk(void* _args);
-    static void* parserThread(void* arg);
+    static void* reactorThread(void* arg);
     static void* IndexSaveThread(void* arg);
+    static void* LogThread(void* arg);
     static void* SendLinkThread(void* arg);
     static void* async_index_save(void* arg);
 
-    void sendLinksList(const HtmlParser& parser, int depth, int port);
+    void acceptConnections(Reactor& reactor);
+    bool serviceConnection(int sock, Connection& connection);
+    bool readConnection(int sock, Connection& connection);
+    bool finishField(Connection& connection);
+    bool readBody(Connection& connection, const char* data, size_t size);
+    void startPage(Connection& connection, uint32_t remaining, uint32_t depth, uint32_t bodyLength);
+    void handOn(Connection& connection, int depth, std::shared_ptr<Acks> acks);
+    bool writeConnection(int sock, Connection& connection);
+    void creditLogged(Reactor& reactor);
+    void acknowledge(const std::vector<std::shared_ptr<Acks>>& acks);
+    void finishPage(HtmlParser* page, int depth, std::shared_ptr<Acks> acks);
+    void sendLinksList(const HtmlParser& parser, int depth);
     void readPeers();
+    void replayLog();
+
+    // Declared last so that it is destroyed first: on the way out it runs the
+    // tasks still queued, which use everything above.
+    Work_Stealing_Pool parsePool{NUM_PARSE_WORKERS, PARSER_PARSE_QUEUE_SIZE};
 
     // Disallow copying.
     Parser(const Parser&) = delete;
@@ -0,0 +1,96 @@
+// Rendezvous.h
+//
+// Weighted rendezvous (highest random weight) hashing, used to pick the
+// crawler that owns a host.  Every peer scores the key and the highest score
+// wins, so removing a peer moves only the keys it owned and adding one takes
+// only the keys it now wins, each in proportion to its weight.
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string_view>
+#include <vector>
+
+struct RendezvousPeer {
+    uint64_t seed;      // hash of the peer's address
+    double weight;      // share of keys relative to the other peers
+};
+
+inline uint64_t Mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// FNV-1a, finished with Mix64 so that similar keys spread over all 64 bits.
+inline uint64_t HashKey(std::string_view key) {
+    uint64_t h = 14695981039346656037ULL;
+    for (char c : key) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ULL;
+    }
+    return Mix64(h);
+}
+
+// Returns the index of the peer with the highest score for key, or 0 if
+// there are no peers.  A peer's score is -weight / ln(u), with u uniform in
+// (0, 1) from the key and peer hashes; the chance a peer wins is its weight
+// over the total weight.
+inline size_t RendezvousPick(std::string_view key, const std::vector<RendezvousPeer>& peers) {
+    uint64_t keyHash = HashKey(key);
+    size_t best = 0;
+    double bestScore = -1;
+    for (size_t i = 0; i < peers.size(); ++i) {
+        uint64_t h = Mix64(keyHash ^ peers[i].seed);
+        double u = (static_cast<double>(h >> 11) + 0.5) * 0x1.0p-53;
+        double score = -peers[i].weight / std::log(u);
+        if (score > bestScore) {
+            best = i;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+// What QueueToOwners did with the batches that found their queue full.
+struct QueuedBatches {
+    size_t waited = 0;      // queued once the peer made room
+    size_t dropped = 0;     // deleted: the peer was down, or made no room by the deadline
+};
+
+// Hands each peer's batch to that peer's queue and to no other, so that every
+// url of a host reaches the peer that owns it.  Batches whose queue has room
+// go first.  A full queue is then waited on until deadline if canWait(i) says
+// peer i is draining it, and its batch is dropped otherwise, so that a peer
+// that is down never holds up the caller.  queueOf(i) returns peer i's queue,
+// which needs try_push(Batch*&) and push_until(Batch*&, deadline).  Clears
+// batches.
+template <typename Batch, typename QueueOf, typename CanWait>
+QueuedBatches QueueToOwners(std::vector<Batch*>& batches, QueueOf queueOf, CanWait canWait,
+                            const timespec& deadline) {
+    QueuedBatches queued;
+    for (size_t i = 0; i < batches.size(); ++i) {
+        if (batches[i] && queueOf(i).try_push(batches[i])) {
+            batches[i] = nullptr;
+        }
+    }
+    for (size_t i = 0; i < batches.size(); ++i) {
+        if (!batches[i]) {
+            continue;
+        }
+        if (canWait(i) && queueOf(i).push_until(batches[i], deadline)) {
+            ++queued.waited;
+        } else {
+            delete batches[i];
+            ++queued.dropped;
+        }
+        batches[i] = nullptr;
+    }
+    return queued;
+}
@@ -0,0 +1,241 @@
+#include "Url.h"
+
+#include <cstddef>
+
+namespace {
+
+// The components of a URL reference, as split by the regular expression in
+// RFC 3986 appendix B.  The fragment is dropped.
+struct UrlParts {
+    std::string_view scheme;
+    std::string_view authority;
+    std::string_view path;
+    std::string_view query;
+    bool hasScheme = false;
+    bool hasAuthority = false;
+    bool hasQuery = false;
+};
+
+inline bool IsAlpha(char c) {
+    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z');
+}
+
+inline bool IsDigit(char c) {
+    return '0' <= c && c <= '9';
+}
+
+inline char ToLower(char c) {
+    return 'A' <= c && c <= 'Z' ? c + 'a' - 'A' : c;
+}
+
+UrlParts SplitUrl(std::string_view url) {
+    UrlParts parts;
+
+    size_t fragment = url.find('#');
+    if (fragment != std::string_view::npos) {
+        url = url.substr(0, fragment);
+    }
+
+    // scheme: ALPHA *( ALPHA / DIGIT / "+" / "-" / "." ) ":"
+    if (!url.empty() && IsAlpha(url[0])) {
+        size_t i = 1;
+        while (i < url.size() && (IsAlpha(url[i]) || IsDigit(url[i]) || url[i] == '+' || url[i] == '-' || url[i] == '.')) {
+            ++i;
+        }
+        if (i < url.size() && url[i] == ':') {
+            parts.scheme = url.substr(0, i);
+            parts.hasScheme = true;
+            url.remove_prefix(i + 1);
+        }
+    }
+
+    if (url.substr(0, 2) == "//") {
+        url.remove_prefix(2);
+        size_t end = url.find_first_of("/?");
+        parts.authority = url.substr(0, end);
+        parts.hasAuthority = true;
+        url.remove_prefix(parts.authority.size());
+    }
+
+    size_t query = url.find('?');
+    parts.path = url.substr(0, query);
+    if (query != std::string_view::npos) {
+        parts.query = url.substr(query + 1);
+        parts.hasQuery = true;
+    }
+    return parts;
+}
+
+// RFC 3986 section 5.2.4.
+std::string RemoveDotSegments(std::string_view path) {
+    std::string output;
+    output.reserve(path.size());
+
+    while (!path.empty()) {
+        if (path.substr(0, 3) == "../") {
+            path.remove_prefix(3);
+        } else if (path.substr(0, 2) == "./") {
+            path.remove_prefix(2);
+        } else if (path.substr(0, 3) == "/./") {
+            path.remove_prefix(2);
+        } else if (path == "/.") {
+            path = "/";
+        } else if (path.substr(0, 4) == "/../" || path == "/..") {
+            path = path.size() == 3 ? "/" : path.substr(3);
+            size_t last = output.rfind('/');
+            output.erase(last == std::string::npos ? 0 : last);
+        } else if (path == "." || path == "..") {
+            path = {};
+        } else {
+            size_t end = path.find('/', path[0] == '/' ? 1 : 0);
+            output.append(path.substr(0, end));
+            path.remove_prefix(end == std::string_view::npos ? path.size() : end);
+        }
+    }
+    return output;
+}
+
+// Strips the characters browsers ignore in an href: surrounding spaces and
+// any tab or newline.
+std::string CleanReference(std::string_view ref) {
+    while (!ref.empty() && ref.front() <= ' ') {
+        ref.remove_prefix(1);
+    }
+    while (!ref.empty() && ref.back() <= ' ') {
+        ref.remove_suffix(1);
+    }
+
+    std::string cleaned;
+    cleaned.reserve(ref.size());
+    for (char c : ref) {
+        if (c != '\t' && c != '\n' && c != '\r') {
+            cleaned.push_back(c);
+        }
+    }
+    return cleaned;
+}
+
+// Assembles scheme://authority/path?query with the scheme and host
+// lowercased and the default port dropped.  Returns an empty string unless
+// the scheme is http or https and there is a host.
+std::string Recompose(std::string_view scheme, std::string_view authority, std::string_view path,
+                      bool hasQuery, std::string_view query) {
+    std::string url;
+    for (char c : scheme) {
+        url.push_back(ToLower(c));
+    }
+    if (url != "http" && url != "https") {
+        return {};
+    }
+    bool https = url.size() == 5;
+
+    // userinfo@host:port; only the host is case-insensitive
+    size_t at = authority.rfind('@');
+    std::string_view userinfo = at == std::string_view::npos ? std::string_view{} : authority.substr(0, at + 1);
+    std::string_view hostport = at == std::string_view::npos ? authority : authority.substr(at + 1);
+
+    size_t colon = hostport.rfind(':');
+    if (colon != std::string_view::npos && hostport.find(']', colon) != std::string_view::npos) {
+        colon = std::string_view::npos;     // the colon is inside an IPv6 literal
+    }
+    std::string_view host = hostport.substr(0, colon);
+    std::string_view port = colon == std::string_view::npos ? std::string_view{} : hostport.substr(colon + 1);
+    if (host.empty()) {
+        return {};
+    }
+
+    url += "://";
+    url.append(userinfo);
+    for (char c : host) {
+        url.push_back(ToLower(c));
+    }
+    if (!port.empty() && !(https ? port == "443" : port == "80")) {
+        url.push_back(':');
+        url.append(port);
+    }
+
+    if (path.empty()) {
+        url.push_back('/');
+    } else {
+        url.append(path);
+    }
+    if (hasQuery) {
+        url.push_back('?');
+        url.append(query);
+    }
+    return url;
+}
+
+} // namespace
+
+std::string NormalizeUrl(std::string_view url) {
+    std::string cleaned = CleanReference(url);
+    UrlParts parts = SplitUrl(cleaned);
+    if (!parts.hasScheme || !parts.hasAuthority) {
+        return {};
+    }
+    return Recompose(parts.scheme, parts.authority, RemoveDotSegments(parts.path), parts.hasQuery, parts.query);
+}
+
+// RFC 3986 section 5.2.2, with the base already known to be absolute.
+std::string ResolveUrl(std::string_view base, std::string_view ref) {
+    std::string cleaned = CleanReference(ref);
+    if (cleaned.empty() || cleaned[0] == '#') {
+        return {};
+    }
+
+    UrlParts r = SplitUrl(cleaned);
+    if (r.hasScheme) {
+        // an absolute reference needs no base; scheme-relative "http:path" is treated as absolute too
+        if (!r.hasAuthority) {
+            return {};
+        }
+        return Recompose(r.scheme, r.authority, RemoveDotSegments(r.path), r.hasQuery, r.query);
+    }
+
+    UrlParts b = SplitUrl(base);
+    if (!b.hasScheme || !b.hasAuthority) {
+        return {};
+    }
+
+    if (r.hasAuthority) {
+        return Recompose(b.scheme, r.authority, RemoveDotSegments(r.path), r.hasQuery, r.query);
+    }
+
+    if (r.path.empty()) {
+        return Recompose(b.scheme, b.authority, RemoveDotSegments(b.path), r.hasQuery || b.hasQuery,
+                         r.hasQuery ? r.query : b.query);
+    }
+
+    if (r.path[0] == '/') {
+        return Recompose(b.scheme, b.authority, RemoveDotSegments(r.path), r.hasQuery, r.query);
+    }
+
+    // merge: the base path up to and including its last '/', then the reference
+    std::string merged;
+    if (b.path.empty()) {
+        merged = "/";
+    } else {
+        size_t slash = b.path.rfind('/');
+        merged = slash == std::string_view::npos ? "" : std::string(b.path.substr(0, slash + 1));
+    }
+    merged.append(r.path);
+    return Recompose(b.scheme, b.authority, RemoveDotSegments(merged), r.hasQuery, r.query);
+}
+
+std::string_view UrlHost(std::string_view url) {
+    size_t begin = url.find("://");
+    begin = begin == std::string_view::npos ? 0 : begin + 3;
+    size_t end = url.find('/', begin);
+    std::string_view authority = url.substr(begin, end == std::string_view::npos ? end : end - begin);
+
+    size_t at = authority.rfind('@');
+    if (at != std::string_view::npos) {
+        authority.remove_prefix(at + 1);
+    }
+    size_t colon = authority.rfind(':');
+    if (colon != std::string_view::npos && authority.find(']', colon) == std::string_view::npos) {
+        authority = authority.substr(0, colon);
+    }
+    return authority;
+}
@@ -0,0 +1,25 @@
+// Url.h
+//
+// Resolves the links found on a page into absolute, normalized http(s)
+// URLs, following RFC 3986 section 5.2, so that the same page reached through
+// different spellings of a link is sent to the crawlers only once.
+
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// Resolves ref against base, which must itself be an absolute http(s) URL.
+// The result has a lowercase scheme and host, no default port, no fragment,
+// no "." or ".." segments and a non-empty path.  Returns an empty string if
+// ref is empty, is a fragment of the same page, or does not resolve to an
+// http(s) URL (mailto:, javascript:, ...).
+std::string ResolveUrl(std::string_view base, std::string_view ref);
+
+// Normalizes an absolute http(s) URL as ResolveUrl does, or returns an empty
+// string if url is not one.
+std::string NormalizeUrl(std::string_view url);
+
+// Returns the host of a URL returned by ResolveUrl or NormalizeUrl, without
+// userinfo or port.
+std::string_view UrlHost(std::string_view url);
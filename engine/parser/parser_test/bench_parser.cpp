@@ -0,0 +1,104 @@
+#include "../HtmlParser.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Parser throughput on a page corpus.
+//
+// usage: ./bench_parser [seconds] [html file]...
+//
+// With no files, a fixed-seed synthetic corpus is generated that mimics
+// crawled pages: a head with meta/link/script/style, nested markup with
+// long attribute lists, anchors, headings, bold text, comments and an
+// svg block.
+
+static const char* WORDS[] = {
+    "search", "engine", "crawler", "index", "page", "the", "of", "and", "information", "results", "university",
+    "michigan", "department", "computer", "science", "students", "research", "news", "running", "national",
+    "generously", "hopefulness", "data", "systems", "network", "performance", "parser", "document", "query",
+};
+
+static std::string Words(size_t n) {
+    std::string s;
+    for (size_t i = 0; i < n; ++i) {
+        s += WORDS[rand() % (sizeof(WORDS) / sizeof(WORDS[0]))];
+        s += (rand() % 8) ? " " : "\n    ";
+    }
+    return s;
+}
+
+static std::string SyntheticPage() {
+    std::string p = "<!DOCTYPE html>\n<html lang=\"en\">\n<head>\n<meta charset=\"utf-8\">\n";
+    p += "<title>" + Words(6) + "</title>\n";
+    for (int i = 0; i < 8; ++i)
+        p += "<link rel=\"stylesheet\" href=\"/static/css/style" + std::to_string(i) + ".css?v=123456\" media=\"all\">\n";
+    p += "<script type=\"text/javascript\">var data = {a: 1, b: '<div>'}; for (var i = 0; i < 10; i++) { f(i); }"
+         "</script>\n<style>body { margin: 0; } .nav > li { display: inline; }</style>\n</head>\n<body>\n";
+
+    for (int section = 0; section < 20; ++section) {
+        p += "<div class=\"container section-" + std::to_string(section) + "\" id=\"s" + std::to_string(section)
+             + "\" data-track=\"impression\" style=\"padding: 4px 8px; color: #333;\">\n";
+        p += "<h2 class=\"heading\">" + Words(4) + "</h2>\n";
+        for (int para = 0; para < 3; ++para) {
+            p += "<p class=\"text\">" + Words(25) + " <b>" + Words(2) + "</b> " + Words(15);
+            p += " <a class=\"link\" target=\"_blank\" rel=\"noopener\" href=\"https://www.example.com/path/to/page"
+                 + std::to_string(rand()) + ".html?ref=home&amp;id=" + std::to_string(rand()) + "\">" + Words(3)
+                 + "</a> " + Words(10) + "</p>\n";
+        }
+        p += "<!-- section " + std::to_string(section) + " end, " + Words(5) + " -->\n";
+        p += "<ul>";
+        for (int li = 0; li < 5; ++li)
+            p += "<li><a href=\"/nav/" + std::to_string(li) + "\">" + Words(2) + "</a></li>";
+        p += "</ul>\n</div>\n";
+    }
+
+    p += "<svg width=\"24\" height=\"24\" viewBox=\"0 0 24 24\"><path d=\"M12 2L2 7l10 5 10-5-10-5z\"/></svg>\n";
+    p += "<embed src=\"/media/video.swf\">\n</body>\n</html>\n";
+    return p;
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 5;
+    std::vector<std::string> corpus;
+
+    for (int i = 2; i < argc; ++i) {
+        std::ifstream in(argv[i]);
+        std::stringstream contents;
+        contents << in.rdbuf();
+        corpus.push_back(contents.str());
+    }
+
+    if (corpus.empty()) {
+        srand(1);
+        for (int i = 0; i < 200; ++i)
+            corpus.push_back(SyntheticPage());
+    }
+
+    size_t bytes = 0;
+    for (const auto& page : corpus)
+        bytes += page.size();
+
+    size_t pages = 0, parsed_bytes = 0, words = 0;
+    auto begin = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed{};
+
+    while (elapsed.count() < seconds) {
+        for (const auto& page : corpus) {
+            HtmlParser parser{std::string(page)};
+            words += parser.WordCount() + parser.TitleWordCount() + parser.links.size();
+        }
+        pages += corpus.size();
+        parsed_bytes += bytes;
+        elapsed = std::chrono::steady_clock::now() - begin;
+    }
+
+    std::cout << corpus.size() << " pages, " << bytes / corpus.size() << " bytes/page average\n";
+    std::cout << pages / elapsed.count() << " pages/s, " << parsed_bytes / elapsed.count() / 1e6 << " MB/s ("
+              << words / pages << " words+links/page)\n";
+    return 0;
+}
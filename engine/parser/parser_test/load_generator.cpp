@@ -0,0 +1,469 @@
+#include "../protocol_parser.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Stands in for the crawlers: sends synthetic or recorded pages to a running
+// parser and reports the ingest rate, then the end-to-end rate, stage
+// latencies and peak memory from the parser's metrics.
+//
+// usage: ./load_generator [--replay dump file]... [--rate pages/s]
+//                         [connections] [pages per connection] [stream|legacy] [compress 0|1] [ip] [port]
+//
+// --replay sends the pages in page dump files, such as those a parser
+// started with "./html_parser record" writes, round robin across the
+// connections; 0 pages per connection then means an equal share of them.
+// Their urls get a fragment unique to the run, so that the parser's filter
+// takes them as new pages however often they are replayed.  --rate holds
+// the pages sent to that many a second across all connections; without it
+// they go as fast as the parser takes them.
+//
+// The end-to-end rate counts until the parser has indexed every page sent.
+// Its latency summaries cover everything since it started, so start a fresh
+// parser for each build compared.
+//
+// stream mode keeps one connection per thread open, sends pages as batches
+// of frames while it holds credits and, at the end, waits until the parser
+// has granted back every credit, i.e. written every page to its page
+// log.  legacy mode opens a connection per page, as crawlers used to.
+//
+// It also plays the crawler's frontier, accepting and discarding the links
+// the parser sends back on FRONTIER_PORT, so the parser never blocks on them,
+// and counting them and the bytes they took.
+
+using namespace ParserProtocol;
+
+struct Options {
+    int connections = 16;
+    int pages = 1000;
+    bool stream = true;
+    bool compress = false;
+    std::string ip = "127.0.0.1";
+    int port = PARSER_PORT;
+    double rate = 0;
+};
+
+struct RecordedPage {
+    std::string url;
+    uint32_t depth;
+    std::string body;
+};
+std::vector<RecordedPage> recorded;
+
+Options options;
+std::atomic<uint64_t> pagesSent{0};
+std::atomic<uint64_t> bytesSent{0};
+std::atomic<uint64_t> bodyBytes{0};
+std::atomic<uint64_t> creditWaits{0};
+std::atomic<uint64_t> pagesUnsendable{0};     // too long a url or an empty body for a frame
+std::atomic<uint64_t> linksReceived{0};
+std::atomic<uint64_t> linkBytes{0};
+std::atomic<int> failures{0};
+uint64_t runId;
+std::chrono::steady_clock::time_point begin;
+std::atomic<uint64_t> paced{0};
+
+static const char* WORDS[] = {
+    "search", "engine", "crawler", "index", "page", "the", "of", "and", "information", "results", "university",
+    "michigan", "department", "computer", "science", "students", "research", "news", "running", "national",
+};
+
+std::string SyntheticPage(unsigned& seed) {
+    std::string page = "<html lang=\"en\"><head><title>";
+    for (int i = 0; i < 6; ++i)
+        page += std::string(WORDS[rand_r(&seed) % 20]) + " ";
+    page += "</title></head><body>";
+    for (int para = 0; para < 40; ++para) {
+        page += "<p>";
+        for (int i = 0; i < 30; ++i)
+            page += std::string(WORDS[rand_r(&seed) % 20]) + " ";
+        page += "<a href=\"https://www.example.com/" + std::to_string(rand_r(&seed)) + "\">link</a></p>\n";
+    }
+    return page + "</body></html>";
+}
+
+// The i-th page a connection sends.
+void NextPage(uintptr_t connection, int i, unsigned& seed, std::string& url, uint32_t& depth, std::string& body) {
+    if (recorded.empty()) {
+        url = "http://load.test/" + std::to_string(runId) + "/" + std::to_string(connection) + "/" + std::to_string(i);
+        depth = 1;
+        body = SyntheticPage(seed);
+        return;
+    }
+    const RecordedPage& page = recorded[(static_cast<size_t>(i) * options.connections + connection - 1) % recorded.size()];
+    url = page.url + "#" + std::to_string(runId) + "-" + std::to_string(connection) + "-" + std::to_string(i);
+    depth = page.depth;
+    body = page.body;
+}
+
+// Holds the senders to options.rate pages a second between them, if set.
+void Pace() {
+    if (options.rate > 0)
+        std::this_thread::sleep_until(begin + std::chrono::duration<double>(paced++ / options.rate));
+}
+
+bool LoadDump(const char* filename) {
+    std::ifstream in(filename, std::ios::binary);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    std::string dump = contents.str();
+
+    std::string_view rest(dump);
+    while (!rest.empty()) {
+        std::string_view url, body;
+        uint32_t depth;
+        size_t size = parse_dump_record(rest, url, depth, body);
+        if (!size)
+            break;
+        recorded.push_back({std::string(url), depth, std::string(body)});
+        rest.remove_prefix(size);
+    }
+    if (!in || !rest.empty())
+        std::cerr << filename << ": unreadable or ends in a partial record\n";
+    return in && rest.size() < dump.size();
+}
+
+int Connect() {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options.port);
+    inet_pton(AF_INET, options.ip.c_str(), &address.sin_addr);
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        perror("connect");
+        if (sock >= 0)
+            close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+bool SendAll(int sock, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(sock, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    bytesSent += data.size();
+    return true;
+}
+
+// Reads credit messages; blocks for at least one if wait is set.
+bool ReadCredits(int sock, uint32_t& credits, bool wait) {
+    char buffer[CREDIT_SIZE * 64];
+    static thread_local size_t have = 0;
+    static thread_local char partial[CREDIT_SIZE];
+
+    while (true) {
+        ssize_t n = recv(sock, buffer, sizeof(buffer), wait ? 0 : MSG_DONTWAIT);
+        if (n <= 0)
+            return !wait && n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+
+        for (ssize_t i = 0; i < n; ++i) {
+            partial[have++] = buffer[i];
+            if (have == CREDIT_SIZE) {
+                credits += get_u32(partial);
+                have = 0;
+            }
+        }
+        wait = false;
+    }
+}
+
+void* StreamConnection(void* arg) {
+    unsigned seed = static_cast<unsigned>(reinterpret_cast<uintptr_t>(arg));
+    int sock = Connect();
+    if (sock < 0) {
+        ++failures;
+        return nullptr;
+    }
+
+    std::string welcome(WELCOME_SIZE, '\0');
+    if (!SendAll(sock, encode_hello(options.compress ? FLAG_COMPRESSION : 0))
+        || recv(sock, welcome.data(), WELCOME_SIZE, MSG_WAITALL) != static_cast<ssize_t>(WELCOME_SIZE)
+        || get_u32(welcome.data()) != MAGIC) {
+        ++failures;
+        close(sock);
+        return nullptr;
+    }
+
+    bool compress = options.compress && (get_u16(welcome.data() + 6) & FLAG_COMPRESSION);
+    uint32_t window = get_u32(welcome.data() + 8);
+    uint32_t credits = window;
+
+    std::string batch;
+    for (int sent = 0; sent < options.pages;) {
+        if (credits == 0)
+            ++creditWaits;
+        if (!ReadCredits(sock, credits, credits == 0)) {
+            ++failures;
+            break;
+        }
+
+        // send as many pages as we hold credits for in one write, or one at a time when paced.  A page that
+        // cannot be framed is skipped and keeps its credit, which would otherwise never come back
+        batch.clear();
+        int count = 0, framed = 0;
+        for (; credits > 0 && sent + count < options.pages && (framed == 0 || options.rate <= 0); ++count) {
+            std::string url, body;
+            uint32_t depth;
+            NextPage(reinterpret_cast<uintptr_t>(arg), sent + count, seed, url, depth, body);
+            if (!encode_page(batch, url, depth, body, compress)) {
+                ++pagesUnsendable;
+                continue;
+            }
+            bodyBytes += body.size();
+            Pace();
+            --credits;
+            ++framed;
+        }
+        if (!SendAll(sock, batch)) {
+            ++failures;
+            break;
+        }
+        sent += count;
+        pagesSent += framed;
+    }
+
+    // every credit comes back once the parser has taken every page
+    while (credits < window && ReadCredits(sock, credits, true))
+        ;
+
+    close(sock);
+    return nullptr;
+}
+
+void* LegacyConnection(void* arg) {
+    unsigned seed = static_cast<unsigned>(reinterpret_cast<uintptr_t>(arg));
+
+    for (int i = 0; i < options.pages; ++i) {
+        Pace();
+        int sock = Connect();
+        if (sock < 0) {
+            ++failures;
+            return nullptr;
+        }
+
+        std::string url, body;
+        uint32_t depth;
+        NextPage(reinterpret_cast<uintptr_t>(arg), i, seed, url, depth, body);
+        std::string frame;
+        put_dump_header(frame, url, depth, body.size());
+        frame += body;
+
+        bodyBytes += body.size();
+        if (SendAll(sock, frame))
+            ++pagesSent;
+        else
+            ++failures;
+        close(sock);
+    }
+    return nullptr;
+}
+
+bool RecvAll(int sock, std::string& data, size_t size) {
+    data.resize(size);
+    if (size && recv(sock, data.data(), size, MSG_WAITALL) != static_cast<ssize_t>(size))
+        return false;
+    linkBytes += size;
+    return true;
+}
+
+// Reads links in either format the parser sends, counting them.
+void* DrainLinks(void* arg) {
+    int sock = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+    std::string header, data;
+    if (RecvAll(sock, header, sizeof(uint32_t))) {
+        if (get_u32(header.data()) == LINK_MAGIC) {
+            std::vector<std::string> urls;
+            uint32_t depth;
+            RecvAll(sock, data, LINK_HELLO_SIZE - sizeof(uint32_t));
+            while (RecvAll(sock, header, sizeof(uint32_t)) && RecvAll(sock, data, get_u32(header.data()))) {
+                urls.clear();
+                if (!decode_links(data, depth, urls)) {
+                    ++failures;
+                    break;
+                }
+                linksReceived += urls.size();
+            }
+        } else {
+            // legacy triples: u32 url length | u32 depth | url
+            do {
+                if (!RecvAll(sock, data, sizeof(uint32_t)) || !RecvAll(sock, data, get_u32(header.data())))
+                    break;
+                ++linksReceived;
+            } while (RecvAll(sock, header, sizeof(uint32_t)));
+        }
+    }
+    close(sock);
+    return nullptr;
+}
+
+void* FrontierSink(void*) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    const int enable = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(FRONTIER_PORT);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listener, 128) < 0) {
+        perror("frontier sink");
+        return nullptr;
+    }
+
+    while (true) {
+        int sock = accept(listener, nullptr, nullptr);
+        if (sock < 0)
+            continue;
+        pthread_t drain;
+        pthread_create(&drain, nullptr, DrainLinks, reinterpret_cast<void*>(static_cast<intptr_t>(sock)));
+        pthread_detach(drain);
+    }
+}
+
+// The parser's metrics page, or "" if it cannot be had.
+std::string Scrape() {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(PARSER_METRICS_PORT);
+    inet_pton(AF_INET, options.ip.c_str(), &address.sin_addr);
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        if (sock >= 0)
+            close(sock);
+        return "";
+    }
+    std::string request = "GET /metrics HTTP/1.0\r\n\r\n";
+    send(sock, request.data(), request.size(), MSG_NOSIGNAL);
+
+    std::string response;
+    char buffer[1 << 14];
+    ssize_t n;
+    while ((n = recv(sock, buffer, sizeof(buffer), 0)) > 0)
+        response.append(buffer, n);
+    close(sock);
+    return response;
+}
+
+// The value of the series called name, or 0 if there is none.
+double Metric(const std::string& metrics, const std::string& name) {
+    size_t at = metrics.find("\n" + name + " ");
+    return at == std::string::npos ? 0 : atof(metrics.c_str() + at + name.size() + 2);
+}
+
+void PrintLatency(const std::string& metrics, const char* stage, const std::string& name) {
+    std::cout << "  " << stage;
+    for (const char* quantile : {"0.5", "0.99", "0.999", "1"})
+        std::cout << '\t' << Metric(metrics, name + "{quantile=\"" + quantile + "\"}") * 1e3;
+    std::cout << "\n";
+}
+
+int main(int argc, char** argv) {
+    std::vector<char*> positional;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            if (!LoadDump(argv[++i]))
+                return 1;
+        } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            options.rate = atof(argv[++i]);
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+    size_t args = positional.size();
+    if (args > 0) options.connections = atoi(positional[0]);
+    if (args > 1) options.pages = atoi(positional[1]);
+    if (args > 2) options.stream = strcmp(positional[2], "legacy") != 0;
+    if (args > 3) options.compress = atoi(positional[3]);
+    if (args > 4) options.ip = positional[4];
+    if (args > 5) options.port = atoi(positional[5]);
+    if (!recorded.empty() && options.pages == 0)
+        options.pages = (recorded.size() + options.connections - 1) / options.connections;
+
+    runId = std::chrono::system_clock::now().time_since_epoch().count();
+
+    pthread_t sink;
+    pthread_create(&sink, nullptr, FrontierSink, nullptr);
+    pthread_detach(sink);
+
+    std::string before = Scrape();
+    begin = std::chrono::steady_clock::now();
+
+    std::vector<pthread_t> threads(options.connections);
+    for (int i = 0; i < options.connections; ++i)
+        pthread_create(&threads[i], nullptr, options.stream ? StreamConnection : LegacyConnection,
+                       reinterpret_cast<void*>(static_cast<uintptr_t>(i + 1)));
+    for (auto thread : threads)
+        pthread_join(thread, nullptr);
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+    // end to end: until every page sent, less those dropped as duplicates, is indexed
+    std::string after;
+    double indexed = 0;
+    std::chrono::duration<double> endToEnd{0};
+    if (!before.empty()) {
+        double expected = 0;
+        auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+        do {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            after = Scrape();
+            indexed = Metric(after, "parser_pages_indexed_total") - Metric(before, "parser_pages_indexed_total");
+            expected = pagesSent - (Metric(after, "parser_pages_duplicate_total")
+                                    - Metric(before, "parser_pages_duplicate_total"));
+        } while (!after.empty() && indexed < expected && std::chrono::steady_clock::now() < giveUp);
+        endToEnd = std::chrono::steady_clock::now() - begin;
+    }
+
+    // links trail the pages; give the parser a moment to send the last of them
+    sleep(2);
+
+    std::cout << (options.stream ? "stream" : "legacy") << (options.compress ? " compressed" : "") << ": "
+              << pagesSent << " pages over " << options.connections << " connections in " << elapsed.count()
+              << " s\n";
+    std::cout << pagesSent / elapsed.count() << " pages/s, " << bodyBytes / elapsed.count() / 1e6
+              << " MB/s of html, " << bytesSent / elapsed.count() / 1e6 << " MB/s on the wire";
+    if (options.stream)
+        std::cout << ", waited for credits " << creditWaits << " times";
+    if (pagesUnsendable)
+        std::cout << ", skipped " << pagesUnsendable << " pages that cannot be framed";
+    std::cout << "\n" << linksReceived << " links received in " << linkBytes << " bytes\n";
+
+    if (after.empty()) {
+        std::cout << "no metrics from the parser on port " << PARSER_METRICS_PORT << "\n";
+    } else {
+        std::cout << "end to end: " << indexed << " pages indexed in " << endToEnd.count() << " s, "
+                  << indexed / endToEnd.count() << " pages/s\n";
+        std::cout << "stage latency (ms)\tp50\tp99\tp99.9\tmax\n";
+        PrintLatency(after, "receive\t", "parser_receive_seconds");
+        PrintLatency(after, "parse\t", "parser_parse_seconds");
+        PrintLatency(after, "log commit", "parser_log_commit_seconds");
+        PrintLatency(after, "index insert", "parser_index_insert_seconds");
+        PrintLatency(after, "chunk save", "parser_chunk_save_seconds");
+        std::cout << "parser peak rss: " << Metric(after, "parser_peak_resident_bytes") / 1e6 << " MB\n";
+    }
+    std::cout << failures << " failures" << std::endl;
+    return failures ? 1 : 0;
+}
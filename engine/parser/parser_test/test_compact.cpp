@@ -0,0 +1,164 @@
+#include "../HtmlParser.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Checks that a compact parse (spans into the page) yields exactly the
+// words, flags, title, links and anchor text of a regular parse, that so does
+// a streaming parse fed the page in pieces of any size, and that a parse
+// stops at its deadline and a streaming parse at its byte cap.
+//
+// usage: ./test_compact [html file]...
+
+const char* SNIPPETS[] = {
+    "<html lang=\"en\"><head><title>This is a Test Title</title></head>"
+    "<body><h2>This is a heading</h2><p>This is a <b>bold</b> word.</p>"
+    "<a href=\"http://example.com\">Example Link</a></body></html>",
+
+    // unrecognized tags become words; unclosed ones merge with the word before
+    "<p>less <notatagatallreallylongname x=1> than a<bogus still open <i>here</i></p>",
+    "<title>broken <title-thing-that-is-long title</title><a href=\"/x\">one two<zzzzzzzzzzzzzzzzzzzzzzzzz three</a>",
+
+    // discard sections, comments, base and embed
+    "<base href=\"http://base.com/\"><script>var x = '<b>';</script>text<!-- <b>hidden</b> -->after"
+    "<style>p { }</style><embed src=\"movie.swf\"><svg><text>no</text></svg>done",
+
+    "<html lang=\"fr\"><body>\tword\r\nother\v\fwords <a href=\"\">empty</a></body></html>",
+    "",
+};
+
+struct Result {
+    std::vector<std::string> words;
+    std::vector<uint8_t> flags;
+    std::vector<std::string> titleWords;
+    std::string title_chunk;
+    std::vector<std::string> links;
+    std::vector<std::vector<std::string>> anchors;
+    std::string base;
+    bool english;
+};
+
+Result Legacy(std::string html) {
+    HtmlParser parser(html.data(), html.size());
+    Result r;
+
+    for (const auto& wf : parser.words_flags) {
+        r.words.push_back(wf.word);
+        r.flags.push_back(wf.flags);
+    }
+    r.titleWords = parser.titleWords;
+    r.title_chunk = parser.title_chunk;
+    for (const auto& link : parser.links) {
+        r.links.push_back(link.URL);
+        r.anchors.push_back(link.anchorText);
+    }
+    r.base = parser.base;
+    r.english = parser.english;
+    return r;
+}
+
+Result Spans(const HtmlParser& parser) {
+    Result r;
+
+    assert(parser.wordSpans.size() == parser.wordFlags.size());
+    for (size_t i = 0; i < parser.wordSpans.size(); ++i) {
+        r.words.emplace_back(parser.SpanText(parser.wordSpans[i]));
+        r.flags.push_back(parser.wordFlags[i]);
+    }
+    for (auto span : parser.titleSpans)
+        r.titleWords.emplace_back(parser.SpanText(span));
+    r.title_chunk = parser.title_chunk;
+
+    r.anchors.resize(parser.links.size());
+    for (const auto& link : parser.links) {
+        r.links.push_back(link.URL);
+        assert(link.anchorText.empty());
+    }
+    for (const auto& anchor : parser.anchorSpans)
+        r.anchors[anchor.link].emplace_back(parser.SpanText(anchor.span));
+
+    r.base = parser.base;
+    r.english = parser.english;
+    return r;
+}
+
+Result Compact(std::string html) {
+    HtmlParser parser(std::move(html));
+    return Spans(parser);
+}
+
+// Feeds the page in pieces of piece bytes, or of random sizes if piece is 0.
+Result Streamed(const std::string& html, size_t piece) {
+    HtmlParser parser(std::chrono::hours(1), html.size() + 1);
+    unsigned seed = html.size();
+    for (size_t at = 0; at < html.size();) {
+        size_t length = std::min(html.size() - at, piece ? piece : 1 + rand_r(&seed) % 4096);
+        parser.Feed(html.data() + at, length);
+        at += length;
+    }
+    parser.Finish();
+    return Spans(parser);
+}
+
+size_t failures = 0;
+
+void Check(const std::string& name, const std::string& html) {
+    Result legacy = Legacy(html);
+
+    auto compare = [&](const Result& other, const std::string& how) {
+        bool same = legacy.words == other.words && legacy.flags == other.flags
+                    && legacy.titleWords == other.titleWords && legacy.title_chunk == other.title_chunk
+                    && legacy.links == other.links && legacy.anchors == other.anchors
+                    && legacy.base == other.base && legacy.english == other.english;
+        if (!same) {
+            ++failures;
+            std::cerr << how << " parse differs for " << name << '\n';
+        }
+    };
+
+    compare(Compact(html), "compact");
+    for (size_t piece : {1, 3, 64, 0})
+        compare(Streamed(html, piece), "streamed (" + std::to_string(piece) + " byte pieces)");
+}
+
+int main(int argc, char** argv) {
+    for (size_t i = 0; i < sizeof(SNIPPETS) / sizeof(SNIPPETS[0]); ++i)
+        Check("snippet " + std::to_string(i), SNIPPETS[i]);
+
+    for (int i = 1; i < argc; ++i) {
+        std::ifstream in(argv[i]);
+        std::stringstream contents;
+        contents << in.rdbuf();
+        Check(argv[i], contents.str());
+    }
+
+    // a parse past its deadline stops early and says so; one without a deadline never does
+    std::string big;
+    for (int i = 0; i < 100000; ++i)
+        big += "<p>word <b>bold</b></p>";
+    HtmlParser expired(std::string(big), std::chrono::steady_clock::now());
+    HtmlParser unlimited{std::string(big)};
+    if (!expired.truncated || expired.WordCount() >= unlimited.WordCount() || unlimited.truncated) {
+        ++failures;
+        std::cerr << "deadline not honored\n";
+    }
+
+    // a streaming parse takes no more than its byte cap
+    HtmlParser capped(std::chrono::hours(1), big.size() / 2);
+    for (size_t at = 0; at < big.size(); at += 1000)
+        capped.Feed(big.data() + at, std::min<size_t>(1000, big.size() - at));
+    capped.Finish();
+    if (!capped.truncated || capped.WordCount() >= unlimited.WordCount() || capped.WordCount() == 0) {
+        ++failures;
+        std::cerr << "byte cap not honored\n";
+    }
+
+    std::cout << failures << " mismatches" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,149 @@
+#include "../protocol_parser.h"
+
+#include <arpa/inet.h>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Checks that a page the parser has credited back survives the parser being
+// killed: streams pages to a parser, kills it while pages are still queued
+// in it, then starts it again and checks that it replays at least every page
+// it credited from the page log.
+//
+// usage: ./test_durability ../html_parser   (run in an empty directory; the parsers' output goes to parser.<n>.out)
+
+using namespace ParserProtocol;
+
+const int PAGES = 4000;
+const uint32_t KILL_AFTER = 1000;    // credited pages
+
+pid_t Start(const char* parser, int run) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        std::string out = "parser." + std::to_string(run) + ".out";
+        int fd = open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        execl(parser, parser, static_cast<char*>(nullptr));
+        perror(parser);
+        _exit(127);
+    }
+    return pid;
+}
+
+void Kill(pid_t pid) {
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+}
+
+// Connects to 127.0.0.1:port, waiting up to ten seconds for it to listen.
+int Connect(int port) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int tries = 0; tries < 100; ++tries) {
+        int sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(sock, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0)
+            return sock;
+        close(sock);
+        usleep(100000);
+    }
+    return -1;
+}
+
+bool SendAll(int sock, const std::string& data) {
+    for (size_t sent = 0; sent < data.size();) {
+        ssize_t n = send(sock, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+// Streams pages until the parser has credited KILL_AFTER of them back, then
+// sends as many more as it holds credits for, so the parser is killed with
+// pages queued.  Returns how many it credited, or 0 if it failed.
+uint32_t Stream(int sock, int& sent) {
+    std::string welcome(WELCOME_SIZE, '\0');
+    if (!SendAll(sock, encode_hello(0))
+        || recv(sock, welcome.data(), WELCOME_SIZE, MSG_WAITALL) != static_cast<ssize_t>(WELCOME_SIZE)
+        || get_u32(welcome.data()) != MAGIC)
+        return 0;
+
+    uint32_t credits = get_u32(welcome.data() + 8);
+    uint32_t credited = 0;
+    while (true) {
+        std::string batch;
+        for (; credits > 0 && sent < PAGES; --credits, ++sent) {
+            std::string body = "<html><head><title>page " + std::to_string(sent)
+                               + "</title></head><body><p>durable words</p></body></html>";
+            encode_page(batch, "http://durable.test/" + std::to_string(sent), 0, body, false);
+        }
+        char credit[CREDIT_SIZE];
+        if (!SendAll(sock, batch))
+            return 0;
+        if (credited >= KILL_AFTER)
+            return credited;
+        if (recv(sock, credit, CREDIT_SIZE, MSG_WAITALL) != CREDIT_SIZE)
+            return 0;
+        credits += get_u32(credit);
+        credited += get_u32(credit);
+    }
+}
+
+// Reads a metric from the parser, or -1 if it is not served yet.
+double Metric(const std::string& name) {
+    int sock = Connect(PARSER_METRICS_PORT);
+    if (sock < 0 || !SendAll(sock, "GET /metrics HTTP/1.0\r\n\r\n"))
+        return -1;
+    std::string response;
+    char buffer[1 << 16];
+    ssize_t n;
+    while ((n = recv(sock, buffer, sizeof(buffer), 0)) > 0)
+        response.append(buffer, n);
+    close(sock);
+
+    size_t at = response.find("\n" + name + " ");
+    return at == std::string::npos ? -1 : atof(response.c_str() + at + name.size() + 2);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " path/to/html_parser" << std::endl;
+        return 2;
+    }
+
+    pid_t parser = Start(argv[1], 0);
+    int sock = Connect(PARSER_PORT);
+    int sent = 0;
+    uint32_t credited = sock < 0 ? 0 : Stream(sock, sent);
+    // pages still queued in the parser, or on their way to it, die with it
+    Kill(parser);
+    close(sock);
+    if (!credited) {
+        std::cerr << "could not stream pages to the parser" << std::endl;
+        return 1;
+    }
+
+    parser = Start(argv[1], 1);
+    double replayed = -1;
+    for (int tries = 0; tries < 100 && replayed < credited; ++tries) {
+        usleep(100000);
+        replayed = Metric("parser_pages_replayed_total");
+    }
+    Kill(parser);
+
+    std::cout << sent << " pages sent, " << credited << " credited, " << replayed << " replayed" << std::endl;
+    bool ok = replayed >= credited && replayed <= sent;
+    std::cout << (ok ? "passed" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
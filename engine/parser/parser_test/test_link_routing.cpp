@@ -0,0 +1,135 @@
+#include "../../lib/mpmc_queue.h"
+#include "../Rendezvous.h"
+#include "../Url.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Checks that QueueToOwners hands each batch only to its owner's queue: with
+// one crawler's queue full, the other crawlers get their batches at once and
+// none of the full crawler's hosts turn up anywhere else.  The full crawler's
+// batch waits for room while its sender drains the queue, is dropped at the
+// deadline if the sender never does, and is dropped at once if the crawler is
+// down.
+//
+// usage: ./test_link_routing
+
+struct Batch {
+    std::vector<std::string> urls;
+};
+
+using Queue = Bounded_MPMC_Queue<Batch*>;
+
+size_t failures = 0;
+
+void Expect(bool ok, const std::string& what) {
+    if (!ok) {
+        ++failures;
+        std::cerr << what << '\n';
+    }
+}
+
+timespec After(std::chrono::milliseconds wait) {
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    auto ns = deadline.tv_nsec + std::chrono::nanoseconds(wait).count();
+    deadline.tv_sec += ns / 1000000000;
+    deadline.tv_nsec = ns % 1000000000;
+    return deadline;
+}
+
+// Routes a batch per crawler with crawler full's queue full, and checks what
+// the other crawlers got.  drain says whether, and after how long, the full
+// crawler's sender takes a batch; up says whether the crawler is connected.
+void Route(const std::vector<RendezvousPeer>& peers, bool up, std::chrono::milliseconds drain,
+           std::chrono::milliseconds wait, size_t expectWaited, size_t expectDropped, const std::string& name) {
+    std::vector<Queue*> queues;
+    for (size_t i = 0; i < peers.size(); ++i) {
+        queues.push_back(new Queue(2));
+    }
+
+    const size_t full = 1;
+    Batch filler;
+    for (Batch* b = &filler; queues[full]->try_push(b);) {
+    }
+
+    std::vector<Batch*> batches(peers.size(), nullptr);
+    for (int i = 0; i < 1000; ++i) {
+        std::string url = "http://host" + std::to_string(i) + ".example.com/page";
+        size_t owner = RendezvousPick(UrlHost(url), peers);
+        if (!batches[owner]) {
+            batches[owner] = new Batch;
+        }
+        batches[owner]->urls.push_back(url);
+    }
+
+    std::atomic<bool> done{false};
+    QueuedBatches queued;
+    auto start = std::chrono::steady_clock::now();
+    std::thread producer([&] {
+        queued = QueueToOwners(
+            batches, [&](size_t i) -> Queue& { return *queues[i]; }, [&](size_t i) { return i != full || up; },
+            After(wait));
+        done = true;
+    });
+
+    // the full crawler's sender, if it drains at all
+    if (drain.count()) {
+        std::this_thread::sleep_for(drain);
+        Expect(!done, name + ": the full crawler's batch did not wait");
+        Batch* taken = nullptr;
+        queues[full]->try_pop(taken);
+    }
+    producer.join();
+    auto took = std::chrono::steady_clock::now() - start;
+
+    Expect(queued.waited == expectWaited, name + ": " + std::to_string(queued.waited) + " batches waited");
+    Expect(queued.dropped == expectDropped, name + ": " + std::to_string(queued.dropped) + " batches dropped");
+    if (!up) {
+        Expect(took < wait / 2, name + ": waited on a crawler that is down");
+    } else if (!drain.count()) {
+        Expect(took >= wait, name + ": gave up before the deadline");
+    }
+    Expect(batches == std::vector<Batch*>(peers.size(), nullptr), name + ": batches not cleared");
+
+    // the crawlers with room get their own batch, and only that
+    for (size_t i = 0; i < queues.size(); ++i) {
+        Batch* batch = nullptr;
+        std::vector<Batch*> got;
+        while (queues[i]->try_pop(batch)) {
+            if (batch != &filler) {
+                got.push_back(batch);
+            }
+        }
+        bool expectBatch = i != full || expectWaited;
+        Expect(got.size() == (expectBatch ? 1u : 0u),
+               name + ": crawler " + std::to_string(i) + " got " + std::to_string(got.size()) + " batches");
+        for (Batch* b : got) {
+            for (const auto& url : b->urls) {
+                Expect(RendezvousPick(UrlHost(url), peers) == i,
+                       name + ": " + url + " went to crawler " + std::to_string(i) + ", which does not own it");
+            }
+            delete b;
+        }
+        delete queues[i];
+    }
+}
+
+int main() {
+    std::vector<RendezvousPeer> peers;
+    for (int i = 0; i < 4; ++i) {
+        peers.push_back({HashKey("10.0.0." + std::to_string(i)), 1.0});
+    }
+
+    using std::chrono::milliseconds;
+    Route(peers, true, milliseconds(200), milliseconds(5000), 1, 0, "draining crawler");
+    Route(peers, true, milliseconds(0), milliseconds(300), 0, 1, "stalled crawler");
+    Route(peers, false, milliseconds(0), milliseconds(5000), 0, 1, "crawler down");
+
+    std::cout << (failures ? "FAILED" : "passed") << '\n';
+    return failures ? 1 : 0;
+}
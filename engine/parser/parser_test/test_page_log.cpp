@@ -0,0 +1,141 @@
+#include "../PageLog.h"
+
+#include <cstdio>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Checks that a page comes back from the page log as it went in, that one in
+// another format or breaking the parse's invariants is refused, that a
+// reopened log replays exactly the pages no checkpoint covers, that a torn
+// last record is ignored, and that segments go once all their pages are saved.
+//
+// usage: ./test_page_log   (run in an empty directory; it leaves test_log.* behind)
+
+const char* PAGE =
+    "<html lang=\"en\"><head><title>A logged page</title><base href=\"http://base.com/\"></head>"
+    "<body><h1>heading words</h1><p>some <b>bold</b> text and <a href=\"/x\">anchor text</a></p>"
+    "<a href=\"http://other.com/\">other</a></body></html>";
+
+size_t failures = 0;
+
+void Expect(bool ok, const std::string& what) {
+    if (!ok) {
+        ++failures;
+        std::cerr << what << '\n';
+    }
+}
+
+std::vector<std::string> Words(const HtmlParser& page, const std::vector<Span>& spans) {
+    std::vector<std::string> words;
+    for (auto span : spans)
+        words.emplace_back(page.SpanText(span));
+    return words;
+}
+
+bool Same(const HtmlParser& a, const HtmlParser& b) {
+    if (a.links.size() != b.links.size() || a.anchorSpans.size() != b.anchorSpans.size())
+        return false;
+    for (size_t i = 0; i < a.links.size(); ++i)
+        if (a.links[i].URL != b.links[i].URL)
+            return false;
+    for (size_t i = 0; i < a.anchorSpans.size(); ++i)
+        if (a.anchorSpans[i].link != b.anchorSpans[i].link
+            || a.SpanText(a.anchorSpans[i].span) != b.SpanText(b.anchorSpans[i].span))
+            return false;
+    return b.compact && Words(a, a.wordSpans) == Words(b, b.wordSpans) && a.wordFlags == b.wordFlags
+           && Words(a, a.titleSpans) == Words(b, b.titleSpans) && a.title_chunk == b.title_chunk
+           && a.base == b.base && a.pageURL == b.pageURL && a.english == b.english && a.truncated == b.truncated;
+}
+
+std::vector<uint64_t> Replayed(PageLog& log) {
+    std::vector<uint64_t> sequences;
+    log.replay([&](uint64_t sequence, std::string& payload) {
+        int depth;
+        HtmlParser* page = PageLog::decodePage(payload, depth);
+        Expect(page && depth == 3, "replayed page does not decode");
+        delete page;
+        sequences.push_back(sequence);
+    });
+    return sequences;
+}
+
+bool Exists(const std::string& name) {
+    return access(name.c_str(), F_OK) == 0;
+}
+
+int main() {
+    for (int i = 0; i < 100; ++i)
+        unlink(("test_log." + std::to_string(i)).c_str());
+
+    HtmlParser page(std::chrono::hours(1), 1 << 20);
+    std::string html = PAGE;
+    page.Feed(html.data(), html.size());
+    page.Finish();
+    page.pageURL = "http://base.com/page";
+
+    int depth = 0;
+    HtmlParser* decoded = PageLog::decodePage(PageLog::encodePage(page, 3), depth);
+    Expect(decoded && depth == 3 && Same(page, *decoded), "decoded page differs");
+    delete decoded;
+    Expect(!PageLog::decodePage("garbage", depth), "garbage decodes");
+
+    std::string otherFormat = PageLog::encodePage(page, 3);
+    ++otherFormat[0];
+    Expect(!PageLog::decodePage(otherFormat, depth), "a page in another format decodes");
+
+    Expect(!page.wordSpans.empty() && !page.titleSpans.empty() && !page.anchorSpans.empty(),
+           "the test page has no spans to break");
+    // the encoder writes whatever it is given; the decoder must not pass on what the indexer would misread
+    auto broken = [&](const char* what, auto breakIt) {
+        HtmlParser bad = page;
+        breakIt(bad);
+        HtmlParser* decoded = PageLog::decodePage(PageLog::encodePage(bad, 3), depth);
+        Expect(!decoded, std::string("a page with ") + what + " decodes");
+        delete decoded;
+    };
+    broken("a word missing its flags", [](HtmlParser& p) { p.wordFlags.pop_back(); });
+    broken("a word past the page", [](HtmlParser& p) { p.wordSpans.back().offset = p.page.size(); });
+    broken("a word running off the page", [](HtmlParser& p) { p.wordSpans.back().length = p.page.size() + 1; });
+    broken("a title word past the page", [](HtmlParser& p) { p.titleSpans.back().offset = p.page.size(); });
+    broken("anchor text past the page", [](HtmlParser& p) { p.anchorSpans.back().span.offset = p.page.size(); });
+    broken("an anchor to a missing link", [](HtmlParser& p) { p.anchorSpans.back().link = p.links.size(); });
+
+    std::vector<std::string> payloads(5, PageLog::encodePage(page, 3));
+    std::vector<uint64_t> first, second;
+    {
+        PageLog log("test_log");
+        Expect(Replayed(log).empty(), "a new log replays pages");
+        log.append(payloads, first);
+        log.append(payloads, second);
+        log.checkpoint({first[0], first[2], second[4]});
+    }
+
+    // a crash partway through a record leaves a torn tail
+    {
+        int fd = open("test_log.0", O_WRONLY | O_APPEND);
+        Expect(write(fd, "\x40\0\0\0torn", 8) == 8, "cannot tear the log");
+        close(fd);
+    }
+
+    std::vector<uint64_t> expected = {first[1], first[3], first[4], second[0], second[1], second[2], second[3]};
+    {
+        PageLog log("test_log");
+        Expect(Replayed(log) == expected, "reopened log replays the wrong pages");
+        Expect(Exists("test_log.0") && Exists("test_log.1"), "segments missing");
+
+        // once every replayed page is saved, the old segment goes; the open one stays
+        log.checkpoint(expected);
+        Expect(!Exists("test_log.0") && Exists("test_log.1"), "saved segment not dropped");
+    }
+    {
+        PageLog log("test_log");
+        Expect(Replayed(log).empty(), "saved pages replayed");
+        Expect(!Exists("test_log.1") && Exists("test_log.2"), "empty segment not dropped on reopen");
+    }
+
+    std::cout << failures << " failures" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,79 @@
+#include "../Rendezvous.h"
+#include "../Url.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Checks that RendezvousPick splits hosts between peers in proportion to
+// their weights and that adding or removing a peer moves only the hosts it
+// gains or loses.
+//
+// usage: ./test_rendezvous
+
+const size_t HOSTS = 100000;
+
+std::vector<size_t> Assign(const std::vector<RendezvousPeer>& peers) {
+    std::vector<size_t> owners;
+    for (size_t i = 0; i < HOSTS; ++i) {
+        owners.push_back(RendezvousPick("host" + std::to_string(i) + ".example.com", peers));
+    }
+    return owners;
+}
+
+int main() {
+    size_t failures = 0;
+
+    std::vector<RendezvousPeer> peers;
+    for (int i = 0; i < 4; ++i) {
+        peers.push_back({HashKey("10.0.0." + std::to_string(i)), i == 3 ? 2.0 : 1.0});
+    }
+
+    // weights 1:1:1:2
+    std::vector<size_t> before = Assign(peers);
+    std::vector<size_t> counts(peers.size());
+    for (size_t owner : before) {
+        ++counts[owner];
+    }
+    for (size_t i = 0; i < peers.size(); ++i) {
+        double expected = HOSTS * peers[i].weight / 5.0;
+        std::cout << "peer " << i << " weight " << peers[i].weight << ": " << counts[i] << " hosts\n";
+        if (counts[i] < expected * 0.95 || counts[i] > expected * 1.05) {
+            ++failures;
+            std::cerr << "peer " << i << " expected about " << expected << " hosts\n";
+        }
+    }
+
+    // adding a peer moves hosts only to it, about HOSTS / 6 of them
+    peers.push_back({HashKey("10.0.0.4"), 1.0});
+    std::vector<size_t> added = Assign(peers);
+    size_t moved = 0;
+    for (size_t i = 0; i < HOSTS; ++i) {
+        if (added[i] != before[i]) {
+            ++moved;
+            failures += added[i] != 4;
+        }
+    }
+    std::cout << "adding a peer moved " << moved << " hosts\n";
+    if (moved < HOSTS / 6 * 0.95 || moved > HOSTS / 6 * 1.05) {
+        ++failures;
+    }
+
+    // removing peer 0 moves only its hosts
+    peers.erase(peers.begin());
+    std::vector<size_t> removed = Assign(peers);
+    for (size_t i = 0; i < HOSTS; ++i) {
+        if (added[i] != 0 && removed[i] + 1 != added[i]) {
+            ++failures;
+        }
+    }
+
+    if (UrlHost("http://user@Example.com:8080/x") != "Example.com" || UrlHost("https://[::1]:443/") != "[::1]"
+        || UrlHost("http://a.com") != "a.com") {
+        ++failures;
+        std::cerr << "UrlHost failed\n";
+    }
+
+    std::cout << failures << " failures" << std::endl;
+    return failures ? 1 : 0;
+}
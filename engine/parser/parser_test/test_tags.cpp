@@ -0,0 +1,73 @@
+#include "../HtmlTags.h"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// Checks LookupTag against a linear scan of TagsRecognized: every tag in
+// any case, every proper prefix and one-character extension of every tag,
+// and the style bits.
+//
+// usage: ./test_tags
+
+size_t failures = 0;
+
+DesiredAction Expected(const std::string& name) {
+    if (name.size() > LongestTagLength)
+        return DesiredAction::OrdinaryText;
+
+    for (const auto& tag : TagsRecognized) {
+        if (strlen(tag.Tag) != name.size())
+            continue;
+        bool same = true;
+        for (size_t i = 0; i < name.size() && same; ++i)
+            same = tolower(static_cast<unsigned char>(name[i])) == tag.Tag[i];
+        if (same)
+            return tag.Action;
+    }
+    return DesiredAction::Discard;
+}
+
+void Check(const std::string& name) {
+    // look the name up from a buffer with trailing text, as the parser does
+    std::string buffer = name + " href=\"x\">";
+    TagInfo info = LookupTag(buffer.data(), name.size());
+
+    if (info.action != Expected(name) || LookupPossibleTag(buffer.data(), buffer.data() + name.size()) != info.action) {
+        ++failures;
+        std::cerr << "wrong action for \"" << name << "\"\n";
+    }
+}
+
+int main() {
+    for (const auto& tag : TagsRecognized) {
+        std::string name = tag.Tag;
+        std::string upper = name;
+        for (auto& c : upper)
+            c = toupper(static_cast<unsigned char>(c));
+
+        Check(name);
+        Check(upper);
+        for (size_t length = 0; length < name.size(); ++length)
+            Check(name.substr(0, length));
+        for (char c : std::string("abz19-!/"))
+            Check(name + c);
+    }
+
+    Check("");
+    Check("notatagatallreallylongname");
+    Check("abbreviationsssssssss");
+    Check("abbreviationssssssss");
+
+    assert(LookupTag("b", 1).style == TagInfo::Bold);
+    assert(LookupTag("B", 1).style == TagInfo::Bold);
+    assert(LookupTag("h3", 2).style == TagInfo::Heading);
+    assert(LookupTag("h7", 2).style == 0);
+    assert(LookupTag("strong", 6).style == 0);
+    assert(LookupTag("head", 4).style == 0);
+    assert(LookupTag("br", 2).style == 0);
+
+    std::cout << failures << " mismatches" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,102 @@
+#include "../Url.h"
+#include "../protocol_parser.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Checks ResolveUrl against the examples in RFC 3986 section 5.4 and the
+// normalizations the parser relies on for link dedup, and that a front-coded
+// link batch decodes to the urls it was encoded from.
+//
+// usage: ./test_url
+
+size_t failures = 0;
+
+void Check(const std::string& base, const std::string& ref, const std::string& expected) {
+    std::string resolved = ResolveUrl(base, ref);
+    if (resolved != expected) {
+        ++failures;
+        std::cerr << "ResolveUrl(\"" << base << "\", \"" << ref << "\") = \"" << resolved << "\", expected \""
+                  << expected << "\"\n";
+    }
+}
+
+int main() {
+    // RFC 3986 5.4.1 and 5.4.2, with an http base
+    const std::string base = "http://a/b/c/d;p?q";
+    Check(base, "g:h", "");
+    Check(base, "g", "http://a/b/c/g");
+    Check(base, "./g", "http://a/b/c/g");
+    Check(base, "g/", "http://a/b/c/g/");
+    Check(base, "/g", "http://a/g");
+    Check(base, "//g", "http://g/");
+    Check(base, "?y", "http://a/b/c/d;p?y");
+    Check(base, "g?y", "http://a/b/c/g?y");
+    Check(base, "#s", "");
+    Check(base, "g#s", "http://a/b/c/g");
+    Check(base, "g?y#s", "http://a/b/c/g?y");
+    Check(base, ";x", "http://a/b/c/;x");
+    Check(base, "g;x", "http://a/b/c/g;x");
+    Check(base, "", "");
+    Check(base, ".", "http://a/b/c/");
+    Check(base, "./", "http://a/b/c/");
+    Check(base, "..", "http://a/b/");
+    Check(base, "../", "http://a/b/");
+    Check(base, "../g", "http://a/b/g");
+    Check(base, "../..", "http://a/");
+    Check(base, "../../", "http://a/");
+    Check(base, "../../g", "http://a/g");
+    Check(base, "../../../g", "http://a/g");
+    Check(base, "../../../../g", "http://a/g");
+    Check(base, "/./g", "http://a/g");
+    Check(base, "/../g", "http://a/g");
+    Check(base, "g.", "http://a/b/c/g.");
+    Check(base, ".g", "http://a/b/c/.g");
+    Check(base, "g..", "http://a/b/c/g..");
+    Check(base, "..g", "http://a/b/c/..g");
+    Check(base, "./../g", "http://a/b/g");
+    Check(base, "./g/.", "http://a/b/c/g/");
+    Check(base, "g/./h", "http://a/b/c/g/h");
+    Check(base, "g/../h", "http://a/b/c/h");
+    Check(base, "g;x=1/./y", "http://a/b/c/g;x=1/y");
+    Check(base, "g;x=1/../y", "http://a/b/c/y");
+    Check(base, "g?y/./x", "http://a/b/c/g?y/./x");
+    Check(base, "g#s/../x", "http://a/b/c/g");
+
+    // normalization
+    Check(base, "HTTP://Example.COM:80/a/./b/../c#top", "http://example.com/a/c");
+    Check(base, "https://example.com:443", "https://example.com/");
+    Check(base, "https://example.com:8443/x", "https://example.com:8443/x");
+    Check(base, "http://User@Example.com/", "http://User@example.com/");
+    Check(base, "http://[::1]:8080/x", "http://[::1]:8080/x");
+    Check(base, "  /spaced\n/path\t ", "http://a/spaced/path");
+    Check(base, "mailto:someone@example.com", "");
+    Check(base, "javascript:void(0)", "");
+    Check(base, "ftp://example.com/file", "");
+    Check(base, "http:relative", "");
+    Check("https://www.umich.edu", "about", "https://www.umich.edu/about");
+    Check("https://www.umich.edu/dir/", "?q=1", "https://www.umich.edu/dir/?q=1");
+    Check("not a url", "relative", "");
+
+    if (NormalizeUrl("HTTP://A.com/./x/../y?q#f") != "http://a.com/y?q" || !NormalizeUrl("/relative").empty()) {
+        ++failures;
+        std::cerr << "NormalizeUrl failed\n";
+    }
+
+    std::vector<std::string> urls = {"http://a.com/", "http://a.com/x", "http://a.com/x/y", "http://b.com/",
+                                     std::string(300, 'z')};
+    std::string batch;
+    ParserProtocol::encode_links(batch, 7, urls);
+    std::vector<std::string> decoded;
+    uint32_t depth;
+    if (ParserProtocol::get_u32(batch.data()) != batch.size() - 4
+        || !ParserProtocol::decode_links(std::string_view(batch).substr(4), depth, decoded) || depth != 7
+        || decoded != urls) {
+        ++failures;
+        std::cerr << "link batch roundtrip failed\n";
+    }
+
+    std::cout << failures << " failures" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,371 @@
+#ifndef PROTOCOL_PARSER_H
+#define PROTOCOL_PARSER_H
+
+#include <arpa/inet.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "../lib/constants.h"
+
+namespace ParserProtocol {
+
+/*
+    Page stream, crawler -> parser on PARSER_PORT. All integers are in network byte order.
+
+    A connection that does not open with a hello is a legacy connection carrying one page:
+        u32 url length | u32 depth | url | u32 body length | body
+
+    A streaming connection carries any number of pages:
+        crawler: hello      u32 MAGIC | u16 version | u16 flags
+        parser:  welcome    u32 MAGIC | u16 version | u16 flags | u32 credits
+        crawler: page       u32 frame length | u8 type | u8 flags | u16 url length | u32 depth | u32 body length
+                            | url | body
+        parser:  credit     u32 pages
+
+    The welcome answers with the highest version both sides speak and the subset of the requested flags the parser
+    accepts. The frame length counts the bytes after it. The body length is the uncompressed size; the body takes the
+    rest of the frame, deflated if the frame has FLAG_COMPRESSED.
+
+    Flow control: the crawler may send a page only while it holds a credit. The welcome grants the first credits and
+    each credit message grants more, once earlier pages are durable in the parser's page log or were skipped as already
+    parsed, so a parser that falls behind stops granting credits and the crawler stops sending. A credit is also the
+    parser's acknowledgement: until its pages are credited back, the crawler keeps them, to send again if the
+    connection breaks.
+*/
+
+/* "PGST"; as a legacy url length it would be far over PARSER_MAX_URL_SIZE, so the two can never be confused */
+const uint32_t MAGIC = 0x50475354;
+const uint16_t VERSION = 1;
+
+/* hello/welcome flags */
+const uint16_t FLAG_COMPRESSION = 1;
+
+/* frame types */
+const uint8_t FRAME_PAGE = 1;
+
+/* frame flags */
+const uint8_t FLAG_COMPRESSED = 1;
+
+const size_t HELLO_SIZE = 8;
+const size_t WELCOME_SIZE = 12;
+const size_t FRAME_HEADER_SIZE = 12;    // after the frame length
+const size_t CREDIT_SIZE = 4;
+const size_t MAX_FRAME_SIZE = FRAME_HEADER_SIZE + PARSER_MAX_URL_SIZE + PARSER_MAX_PAGE_SIZE;
+
+inline void put_u16(std::string& out, uint16_t value) {
+    value = htons(value);
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+inline void put_u32(std::string& out, uint32_t value) {
+    value = htonl(value);
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+inline uint16_t get_u16(const char* in) {
+    uint16_t value;
+    memcpy(&value, in, sizeof(value));
+    return ntohs(value);
+}
+
+inline uint32_t get_u32(const char* in) {
+    uint32_t value;
+    memcpy(&value, in, sizeof(value));
+    return ntohl(value);
+}
+
+inline std::string encode_hello(uint16_t flags) {
+    std::string out;
+    put_u32(out, MAGIC);
+    put_u16(out, VERSION);
+    put_u16(out, flags);
+    return out;
+}
+
+inline std::string encode_welcome(uint16_t version, uint16_t flags, uint32_t credits) {
+    std::string out;
+    put_u32(out, MAGIC);
+    put_u16(out, version);
+    put_u16(out, flags);
+    put_u32(out, credits);
+    return out;
+}
+
+/**
+ * @brief appends a page frame to out, deflating the body if compress is set and it makes the body smaller
+ * @return false if the url or body is too long to send
+ */
+inline bool encode_page(std::string& out, std::string_view url, uint32_t depth, std::string_view body,
+                        bool compress) {
+    if (url.empty() || url.size() > UINT16_MAX || url.size() > PARSER_MAX_URL_SIZE || body.empty()
+        || body.size() > PARSER_MAX_PAGE_SIZE)
+        return false;
+
+    std::string deflated;
+    if (compress) {
+        uLongf deflated_size = compressBound(body.size());
+        deflated.resize(deflated_size);
+        if (compress2(reinterpret_cast<Bytef*>(deflated.data()), &deflated_size,
+                      reinterpret_cast<const Bytef*>(body.data()), body.size(), Z_BEST_SPEED) == Z_OK
+            && deflated_size < body.size())
+            deflated.resize(deflated_size);
+        else
+            compress = false;
+    }
+
+    std::string_view payload = compress ? std::string_view{deflated} : body;
+
+    put_u32(out, FRAME_HEADER_SIZE + url.size() + payload.size());
+    out.push_back(static_cast<char>(FRAME_PAGE));
+    out.push_back(static_cast<char>(compress ? FLAG_COMPRESSED : 0));
+    put_u16(out, url.size());
+    put_u32(out, depth);
+    put_u32(out, body.size());
+    out.append(url);
+    out.append(payload);
+    return true;
+}
+
+/*
+    Page dump files hold pages back to back, each as a legacy connection would have sent it:
+        u32 url length | u32 depth | url | u32 body length | body
+    The parser writes them if PARSER_DUMP_PAGES is set, and indexer/bulk_indexer builds index chunks from them.
+*/
+
+/* appends the part of a dump record before its body, which follows it */
+inline void put_dump_header(std::string& out, std::string_view url, uint32_t depth, uint32_t body_length) {
+    put_u32(out, url.size());
+    put_u32(out, depth);
+    out.append(url);
+    put_u32(out, body_length);
+}
+
+/**
+ * @brief splits the dump record at the start of in
+ * @return the record's size, or 0 if it is cut short or malformed
+ */
+inline size_t parse_dump_record(std::string_view in, std::string_view& url, uint32_t& depth, std::string_view& body) {
+    if (in.size() < 2 * sizeof(uint32_t))
+        return 0;
+    uint32_t url_length = get_u32(in.data());
+    depth = get_u32(in.data() + 4);
+    if (url_length == 0 || url_length > PARSER_MAX_URL_SIZE || in.size() - 8 < url_length + sizeof(uint32_t))
+        return 0;
+    url = in.substr(8, url_length);
+
+    uint32_t body_length = get_u32(in.data() + 8 + url_length);
+    size_t header = 12 + url_length;
+    if (body_length > PARSER_MAX_PAGE_SIZE || in.size() - header < body_length)
+        return 0;
+    body = in.substr(header, body_length);
+    return header + body_length;
+}
+
+/* the fixed part of a page frame, which comes before its url and body */
+struct PageHeader {
+    uint8_t flags;
+    uint16_t url_length;
+    uint32_t depth;
+    uint32_t body_length;       // uncompressed
+    uint32_t payload_length;    // the body as sent, deflated if flags has FLAG_COMPRESSED
+};
+
+/**
+ * @brief parses the FRAME_HEADER_SIZE bytes after the frame length, so that the url and body can be read as they arrive
+ * @return false if the frame is malformed
+ */
+inline bool parse_page_header(const char* header, uint32_t frame_length, PageHeader& page) {
+    if (frame_length < FRAME_HEADER_SIZE || static_cast<uint8_t>(header[0]) != FRAME_PAGE)
+        return false;
+
+    page.flags = header[1];
+    page.url_length = get_u16(header + 2);
+    page.depth = get_u32(header + 4);
+    page.body_length = get_u32(header + 8);
+
+    if (page.url_length == 0 || FRAME_HEADER_SIZE + page.url_length >= frame_length || page.body_length == 0
+        || page.body_length > PARSER_MAX_PAGE_SIZE)
+        return false;
+
+    page.payload_length = frame_length - FRAME_HEADER_SIZE - page.url_length;
+    return (page.flags & FLAG_COMPRESSED) || page.payload_length == page.body_length;
+}
+
+/* inflates a compressed body a piece at a time, as its payload arrives */
+class Inflater {
+    z_stream stream{};
+    bool ended = false;
+    size_t inflated = 0;
+
+public:
+    Inflater() {
+        inflateInit(&stream);
+    }
+
+    ~Inflater() {
+        inflateEnd(&stream);
+    }
+
+    Inflater(const Inflater&) = delete;
+    Inflater& operator=(const Inflater&) = delete;
+
+    /* starts on the next body */
+    void reset() {
+        inflateReset(&stream);
+        ended = false;
+        inflated = 0;
+    }
+
+    /**
+     * @brief inflates the next piece of the payload, handing each piece of the body to out(const char*, size_t)
+     * @return false if the payload is corrupt or inflates to more than limit bytes
+     */
+    template <typename Out>
+    bool feed(const char* in, size_t size, size_t limit, Out&& out) {
+        char buffer[1 << 14];
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+        stream.avail_in = size;
+        while (stream.avail_in && !ended) {
+            stream.next_out = reinterpret_cast<Bytef*>(buffer);
+            stream.avail_out = sizeof(buffer);
+            int status = ::inflate(&stream, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR)
+                return false;
+
+            size_t produced = sizeof(buffer) - stream.avail_out;
+            inflated += produced;
+            if (inflated > limit)
+                return false;
+            if (produced)
+                out(buffer, produced);
+            else if (status == Z_BUF_ERROR)
+                return false;
+            ended = status == Z_STREAM_END;
+        }
+        return !stream.avail_in;
+    }
+
+    /* whether the body ended after exactly length bytes */
+    bool finished(size_t length) const {
+        return ended && inflated == length;
+    }
+};
+
+/*
+    Link stream, parser -> crawler on FRONTIER_PORT. All integers are in network byte order.
+
+    By default the parser sends one triple per link, as it always has:
+        u32 url length | u32 depth | url
+
+    A crawler listed as "batched" in PARSER_PEERS_FILE is sent a hello and then batches of links:
+        parser: hello       u32 LINK_MAGIC | u16 version | u16 flags
+        parser: batch       u32 batch length | u32 depth | u32 count | count x (varint shared | varint suffix length
+                            | suffix)
+
+    The urls of a batch are sorted and distinct, and each is front coded against the one before it: shared is the
+    length of the prefix it has in common with the previous url, and suffix is the rest. The batch length counts the
+    bytes after it. Varints are LEB128, 7 bits per byte, least significant first.
+*/
+
+/* "PLNK" */
+const uint32_t LINK_MAGIC = 0x504c4e4b;
+const uint16_t LINK_VERSION = 1;
+
+const size_t LINK_HELLO_SIZE = 8;
+const size_t LINK_HEADER_SIZE = 8;      // after the batch length
+
+inline void put_varint(std::string& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+/**
+ * @brief reads a varint at in, advancing it
+ * @return false if the varint runs past end or overflows 32 bits
+ */
+inline bool get_varint(const char*& in, const char* end, uint32_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 35 && in < end; shift += 7) {
+        uint8_t byte = *in++;
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+inline std::string encode_link_hello() {
+    std::string out;
+    put_u32(out, LINK_MAGIC);
+    put_u16(out, LINK_VERSION);
+    put_u16(out, 0);
+    return out;
+}
+
+/**
+ * @brief appends a batch of links to out; urls must be sorted and distinct
+ */
+template<typename Urls>
+void encode_links(std::string& out, uint32_t depth, const Urls& urls) {
+    size_t start = out.size();
+    put_u32(out, 0);
+    put_u32(out, depth);
+    put_u32(out, urls.size());
+
+    std::string_view previous;
+    for (const auto& url: urls) {
+        std::string_view current = url;
+        size_t shared = 0;
+        size_t limit = std::min(previous.size(), current.size());
+        while (shared < limit && previous[shared] == current[shared])
+            ++shared;
+
+        put_varint(out, shared);
+        put_varint(out, current.size() - shared);
+        out.append(current.substr(shared));
+        previous = current;
+    }
+
+    uint32_t length = htonl(out.size() - start - sizeof(uint32_t));
+    memcpy(out.data() + start, &length, sizeof(length));
+}
+
+/**
+ * @brief decodes the batch after its length into urls
+ * @return false if the batch is malformed
+ */
+template<typename Urls>
+bool decode_links(std::string_view batch, uint32_t& depth, Urls& urls) {
+    if (batch.size() < LINK_HEADER_SIZE)
+        return false;
+
+    depth = get_u32(batch.data());
+    uint32_t count = get_u32(batch.data() + 4);
+    const char* in = batch.data() + LINK_HEADER_SIZE;
+    const char* end = batch.data() + batch.size();
+
+    std::string url;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t shared, suffix;
+        if (!get_varint(in, end, shared) || !get_varint(in, end, suffix) || shared > url.size()
+            || suffix > static_cast<size_t>(end - in))
+            return false;
+        url.resize(shared);
+        url.append(in, suffix);
+        in += suffix;
+        urls.push_back(url);
+    }
+    return in == end;
+}
+
+}; /* namespace ParserProtocol */
+
+#endif /* PROTOCOL_PARSER_H */
@@ -1,10 +1,15 @@
 #include "Ranker.hpp"
 
+#include <algorithm>
+#include <limits>
+
 namespace Ranker {
 
-Ranker::Ranker(IndexBlob* index, size_t maxResults)
+Ranker::Ranker(IndexBlob* index, size_t maxResults, int numThreads, std::atomic<double>* scoreToBeat)
     : index(index)
-    , maxResults(maxResults) {}
+    , maxResults(maxResults)
+    , numThreads(numThreads)
+    , scoreToBeat(scoreToBeat) {}
 
 Ranker::~Ranker() {}
 
@@ -398,6 +403,29 @@ double Ranker::CalculateDynamicScore(const DynamicFeatures& features, bool isTit
     return baseScore;
 }
 
+// The most CalculateDynamicScore can give a page's title or its body, as
+// TITLE_WEIGHT and BODY_WEIGHT combine them.  A span score averages its
+// spans' weights, so it is at most the largest weight; position only scores
+// spans among the first TOP_POSITION_THRESHOLD locations of the chunk.
+double Ranker::MaxDynamicScore(Location start, Location end) {
+    double spanScore = std::max({ EXACT_PHRASE_WEIGHT, ORDERED_SPAN_WEIGHT, CLOSE_SPAN_WEIGHT, SHORTEST_SPAN_WEIGHT,
+                                  SHORT_SPAN_WEIGHT });
+    double topPositionSpans = 0;
+    if (start <= TOP_POSITION_THRESHOLD) {
+        topPositionSpans = std::min<double>(end, TOP_POSITION_THRESHOLD) - start + 1;
+    }
+    double freqScore = std::max({ ALL_FREQUENT_WEIGHT, MOST_FREQUENT_WEIGHT, SOME_FREQUENT_WEIGHT });
+
+    double baseScore = (spanScore * 0.5) + (topPositionSpans * TOP_POSITION_WEIGHT * 0.3) + (freqScore * 0.2);
+    return TITLE_WEIGHT * baseScore * URL_TERM_MATCH_BOOST + BODY_WEIGHT * baseScore;
+}
+
+void Ranker::RaiseScoreToBeat(std::atomic<double>& scoreToBeat, double score) {
+    double current = scoreToBeat.load(std::memory_order_relaxed);
+    while (current < score && !scoreToBeat.compare_exchange_weak(current, score, std::memory_order_relaxed)) {
+    }
+}
+
 void Ranker::InsertResult(std::vector<RankingResult>& results, RankingResult& newResult) {
     if (results.size() < maxResults) {
         results.push_back(newResult);
@@ -492,6 +520,12 @@ void* Ranker::WorkerThread(void* arg) {
             continue;
         }
 
+        // skip the dynamic features of a page that could not place even with the best of them
+        double maxScore = DYNAMIC_SCORE_WEIGHT * MaxDynamicScore(start, end) + STATIC_SCORE_WEIGHT * staticScore;
+        if (maxScore <= args->scoreToBeat->load(std::memory_order_relaxed)) {
+            continue;
+        }
+
         dummyRanker.SeekToDocStart(termsCopy, start);
 
         auto title_features = dummyRanker.ExtractDynamicFeatures(start, end, title_words, attributes->url);
@@ -514,7 +548,7 @@ void* Ranker::WorkerThread(void* arg) {
                 continue;
             }
         }
-        double finalScore = dynamicScore * 0.75 + staticScore * 0.25;
+        double finalScore = dynamicScore * DYNAMIC_SCORE_WEIGHT + staticScore * STATIC_SCORE_WEIGHT;
 
         RankingResult result;
         result.url = attributes->url;
@@ -530,6 +564,9 @@ void* Ranker::WorkerThread(void* arg) {
         pthread_mutex_lock(args->resultsMutex);
 
         dummyRanker.InsertResult(*args->results, result);
+        if (args->results->size() == args->maxResults) {
+            RaiseScoreToBeat(*args->scoreToBeat, args->results->back().score);
+        }
         args->processedDocs++;
         if (args->processedDocs >= MAX_DOCS) {
             // std::cout << "PROCESSED ENOUGH DOCS\n";
@@ -553,8 +590,7 @@ std::vector<RankingResult> Ranker::RankResults(ISR_Tree* tree) {
     ISR* root = tree->get_root();
     if (!root) return results;
 
-    constexpr int NUM_THREADS = 14;
-    pthread_t threads[NUM_THREADS];
+    std::vector<pthread_t> threads(numThreads > 1 ? numThreads - 1 : 0);
     pthread_mutex_t queueMutex = PTHREAD_MUTEX_INITIALIZER;
     pthread_mutex_t resultsMutex = PTHREAD_MUTEX_INITIALIZER;
 
@@ -565,15 +601,23 @@ std::vector<RankingResult> Ranker::RankResults(ISR_Tree* tree) {
                       .maxResults = maxResults,
                       .queueMutex = &queueMutex,
                       .resultsMutex = &resultsMutex,
-                      .results = &results };
+                      .results = &results,
+                      .scoreToBeat = scoreToBeat };
+
+    // without a query-wide score to beat, this chunk's own top maxResults sets one
+    std::atomic<double> chunkScoreToBeat { std::numeric_limits<double>::lowest() };
+    if (!args.scoreToBeat) {
+        args.scoreToBeat = &chunkScoreToBeat;
+    }
 
-    for (int i = 0; i < NUM_THREADS; ++i) {
-        if (pthread_create(&threads[i], nullptr, WorkerThread, &args) != 0) {
+    for (auto& thread : threads) {
+        if (pthread_create(&thread, nullptr, WorkerThread, &args) != 0) {
             perror("Failed to create thread in ranker");
         }
     }
-    for (int i = 0; i < NUM_THREADS; ++i) {
-        if (pthread_join(threads[i], nullptr) != 0) {
+    WorkerThread(&args);
+    for (auto& thread : threads) {
+        if (pthread_join(thread, nullptr) != 0) {
             perror("Failed to join thread in ranker");
         }
     }
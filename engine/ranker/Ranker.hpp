@@ -3,7 +3,7 @@
 #ifndef RANKER_HPP
 #define RANKER_HPP
 
-// #include <atomic>
+#include <atomic>
 #include <cstdint>
 #include <string>   // TODO: add custom string class
 #include <vector>   // TODO: add custom vector class
@@ -30,6 +30,7 @@ struct ThreadArgs {
     pthread_mutex_t* queueMutex;
     pthread_mutex_t* resultsMutex;
     std::vector<RankingResult>* results;
+    std::atomic<double>* scoreToBeat;
 };
 
 struct Span {
@@ -72,7 +73,11 @@ struct QueryIntent {
 
 class Ranker {
 public:
-    Ranker(IndexBlob* index, size_t maxResults = 10);
+    // RankResults walks the chunk's matches with numThreads threads, the caller among them.
+    // scoreToBeat, if given, is shared by the Rankers of every chunk a query
+    // searches: it is the lowest score in a top maxResults one of them has
+    // found, and pages whose best possible score cannot beat it are skipped.
+    Ranker(IndexBlob* index, size_t maxResults = 10, int numThreads = 14, std::atomic<double>* scoreToBeat = nullptr);
     ~Ranker();
 
     std::vector<RankingResult> RankResults(ISR_Tree* tree);
@@ -80,6 +85,8 @@ public:
 private:
     IndexBlob* index;
     size_t maxResults;
+    int numThreads;
+    std::atomic<double>* scoreToBeat;
     static constexpr size_t CLOSE_THRESHOLD = 10;
     static constexpr size_t TOP_POSITION_THRESHOLD = 100;
     static constexpr double MOST_WORDS_RATIO = 0.7;
@@ -113,6 +120,9 @@ private:
     static constexpr double URL_TERM_MATCH_BOOST = 1.2;
     static constexpr double FREQUENT_THRESHOLD = .01;
 
+    static constexpr double DYNAMIC_SCORE_WEIGHT = 0.75;
+    static constexpr double STATIC_SCORE_WEIGHT = 0.25;
+
     // Feature extraction
     StaticFeatures ExtractStaticFeatures(Location start, Location end, const DocumentAttributes* attr);
     DynamicFeatures ExtractDynamicFeatures(Location start, Location end, const std::vector<ISRWord*>& queryTerms,
@@ -129,6 +139,8 @@ private:
     // Scoring
     double CalculateStaticScore(const StaticFeatures& features, const std::vector<ISRWord*>& queryTerms);
     double CalculateDynamicScore(const DynamicFeatures& features, bool isTitle, uint32_t docLength);
+    static double MaxDynamicScore(Location start, Location end);
+    static void RaiseScoreToBeat(std::atomic<double>& scoreToBeat, double score);
     void InsertResult(std::vector<RankingResult>& results, RankingResult& newResult);
     double GetTLDScore(const std::string& domain);
     static void* WorkerThread(void* arg);
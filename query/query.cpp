@@ -10,7 +10,7 @@
 
 #include "../lib/debug.h"
 #include "../lib/networking.h"
-#include "../lib/stemmer.h"
+#include "../lib/stem_cache.h"
 #include "synsets.h"
 
 using namespace Query;
@@ -77,11 +77,11 @@ bool contains_space(const std::string& term) {
 
 Expr_Leaf_Word::Expr_Leaf_Word(const std::string& t)
     : term { t }
-    , stem { Stemmer::stem(term) } {}
+    , stem { Stem_Cache::stem(term) } {}
 
 Expr_Leaf_Word::Expr_Leaf_Word(std::string&& t)
     : term { std::move(t) }
-    , stem { Stemmer::stem(term) } {}
+    , stem { Stem_Cache::stem(term) } {}
 
 Expr_Leaf_Word::Expr_Leaf_Word(const std::string& t, std::string&& s)
     : term { t }
@@ -115,7 +115,7 @@ Expr_OR_SYN* Expr_Leaf_Word::generate_synonyms() {
         for (const auto& syn : *synset) {
             /* only save synonyms with different stems - otherwise searches are the same ! side-effect of skipping past
              * self */
-            auto stem_syn = Stemmer::stem(syn);
+            auto stem_syn = Stem_Cache::stem(syn);
             if (stem_syn != stem) children.push(new Expr_Leaf_Word { syn, std::move(stem_syn) });
         }
 
@@ -179,7 +179,7 @@ std::vector<std::string> generate_stems(const std::vector<std::string>& terms) {
     std::vector<std::string> stems;
     stems.reserve(terms.size());
     for (const auto& term : terms) {
-        stems.push_back(Stemmer::stem(term));
+        stems.push_back(Stem_Cache::stem(term));
     }
     return stems;
 }
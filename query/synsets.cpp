@@ -18,7 +18,7 @@ void Synsets::init(const std::string& file) {
         synsets.push_back(std::move(synset));
 
         for (const auto& w : synsets.back()) {
-            stem_to_synsets[Stemmer::stem(w)].push_back(&synsets.back());
+            stem_to_synsets[Stem_Cache::stem(w)].push_back(&synsets.back());
         }
     }
 
@@ -10,7 +10,7 @@
 #include <vector>
 #include <string>
 
-#include "../lib/stemmer.h"
+#include "../lib/stem_cache.h"
 
 class Synsets {
 public: